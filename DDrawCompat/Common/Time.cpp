@@ -1,15 +1,71 @@
 #pragma once
 
 #include "Common/Time.h"
+#include "Config/Config.h"
+
+namespace
+{
+	thread_local HANDLE g_waitTimer = nullptr;
+}
 
 namespace Time
 {
 	long long g_qpcFrequency = 0;
 
+	HANDLE createWaitableTimer()
+	{
+		HANDLE timer = CreateWaitableTimerEx(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		return timer ? timer : CreateWaitableTimer(nullptr, FALSE, nullptr);
+	}
+
+	void dllThreadDetach()
+	{
+		if (g_waitTimer)
+		{
+			CloseHandle(g_waitTimer);
+			g_waitTimer = nullptr;
+		}
+	}
+
 	void init()
 	{
 		LARGE_INTEGER qpc;
 		QueryPerformanceFrequency(&qpc);
 		g_qpcFrequency = qpc.QuadPart;
 	}
+
+	void waitForQpc(long long qpcDeadline)
+	{
+		waitForQpc(qpcDeadline, Config::spinWaitTimeUs);
+	}
+
+	void waitForQpc(long long qpcDeadline, unsigned spinWaitTimeUs)
+	{
+		// Sleep on a waitable timer until shortly before the deadline, then spin the rest for precision
+		const long long qpcSleepEnd = qpcDeadline - usToQpc(spinWaitTimeUs);
+		const long long qpcSleep = qpcSleepEnd - queryPerformanceCounter();
+		if (qpcSleep > 0)
+		{
+			if (!g_waitTimer)
+			{
+				g_waitTimer = createWaitableTimer();
+			}
+
+			LARGE_INTEGER dueTime = {};
+			dueTime.QuadPart = -qpcSleep * 10000000 / g_qpcFrequency;
+			if (g_waitTimer && SetWaitableTimer(g_waitTimer, &dueTime, 0, nullptr, nullptr, FALSE))
+			{
+				WaitForSingleObject(g_waitTimer, INFINITE);
+			}
+			else
+			{
+				Sleep(static_cast<DWORD>(qpcToMs(qpcSleep)));
+			}
+		}
+
+		while (queryPerformanceCounter() < qpcDeadline)
+		{
+			YieldProcessor();
+		}
+	}
 }
@@ -2,11 +2,19 @@
 
 #include <Windows.h>
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 namespace Time
 {
 	extern long long g_qpcFrequency;
 
+	HANDLE createWaitableTimer();
+	void dllThreadDetach();
 	void init();
+	void waitForQpc(long long qpcDeadline);
+	void waitForQpc(long long qpcDeadline, unsigned spinWaitTimeUs);
 
 	inline long long msToQpc(long long ms)
 	{
@@ -18,6 +26,11 @@ namespace Time
 		return qpc * 1000 / g_qpcFrequency;
 	}
 
+	inline long long usToQpc(long long us)
+	{
+		return us * g_qpcFrequency / 1000000;
+	}
+
 	inline long long queryPerformanceCounter()
 	{
 		LARGE_INTEGER qpc = {};
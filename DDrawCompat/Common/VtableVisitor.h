@@ -8,10 +8,10 @@ struct VtableForEach;
 template <typename Vtable, typename Visitor>
 void forEach(Visitor& visitor)
 {
-	VtableForEach<Vtable>::forEach<Vtable>(visitor);
+	VtableForEach<Vtable>::template forEach<Vtable>(visitor);
 }
 
-#define DD_VISIT(member) visitor.visit<decltype(&Vtable::member), &Vtable::member>(#member)
+#define DD_VISIT(member) visitor.template visit<decltype(&Vtable::member), &Vtable::member>(#member)
 
 template <>
 struct VtableForEach<IUnknownVtbl>
@@ -0,0 +1,76 @@
+#include <atomic>
+
+#include <Windows.h>
+
+#include "Common/WorkerPool.h"
+
+namespace
+{
+	struct Job
+	{
+		void(*func)(void* context, unsigned index);
+		void* context;
+		unsigned count;
+		std::atomic<unsigned> nextIndex;
+	};
+
+	void runJob(Job& job)
+	{
+		unsigned index = job.nextIndex++;
+		while (index < job.count)
+		{
+			job.func(job.context, index);
+			index = job.nextIndex++;
+		}
+	}
+
+	void CALLBACK workCallback(PTP_CALLBACK_INSTANCE /*instance*/, PVOID context, PTP_WORK /*work*/)
+	{
+		runJob(*static_cast<Job*>(context));
+	}
+}
+
+namespace Compat
+{
+	namespace WorkerPool
+	{
+		unsigned getConcurrency()
+		{
+			DWORD_PTR processAffinityMask = 0;
+			DWORD_PTR systemAffinityMask = 0;
+			if (!GetProcessAffinityMask(GetCurrentProcess(), &processAffinityMask, &systemAffinityMask))
+			{
+				return 1;
+			}
+
+			unsigned count = 0;
+			while (0 != processAffinityMask)
+			{
+				processAffinityMask &= processAffinityMask - 1;
+				++count;
+			}
+			return 0 != count ? count : 1;
+		}
+
+		void parallelFor(unsigned count, void(*func)(void* context, unsigned index), void* context)
+		{
+			Job job = { func, context, count };
+			PTP_WORK work = count > 1 ? CreateThreadpoolWork(&workCallback, &job, nullptr) : nullptr;
+			if (work)
+			{
+				for (unsigned i = 1; i < count; ++i)
+				{
+					SubmitThreadpoolWork(work);
+				}
+			}
+
+			runJob(job);
+
+			if (work)
+			{
+				WaitForThreadpoolWorkCallbacks(work, FALSE);
+				CloseThreadpoolWork(work);
+			}
+		}
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace Compat
+{
+	namespace WorkerPool
+	{
+		unsigned getConcurrency();
+		void parallelFor(unsigned count, void(*func)(void* context, unsigned index), void* context);
+
+		template <typename Func>
+		void parallelFor(unsigned count, Func& func)
+		{
+			parallelFor(count, [](void* context, unsigned index) { (*static_cast<Func*>(context))(index); }, &func);
+		}
+	}
+}
@@ -2,9 +2,24 @@
 
 namespace Config
 {
+	const unsigned accessHistoryHalfLife = 100;
 	const unsigned delayedFlipModeTimeout = 200;
-	const unsigned evictionTimeout = 200;
+	// Limits flips to frameLimitFps frames per second, or else to frameLimitRefreshMultiple times the refresh rate.
+	// Both are disabled when 0.
+	const double frameLimitFps = 0;
+	const double frameLimitRefreshMultiple = 0;
+	const unsigned lockBufferPoolIdleTimeout = 5000;
+	const unsigned maxDirtyRects = 16;
 	const unsigned maxPaletteUpdatesPerMs = 5;
+	const unsigned maxPooledLockBufferSize = 64 * 1024 * 1024;
+	const unsigned maxStripedBltThreads = 8;
 	const unsigned maxUserModeDisplayDrivers = 3;
+	const unsigned minStripedBltSize = 512 * 1024;
+	const unsigned minStripedBltStripeHeight = 16;
+	// Leaves the process affinity unrestricted so that striped blits can run on all CPUs.
+	// Games that rely on running on a single CPU may break when enabled.
+	const bool multiCoreStripedBlts = false;
+	const unsigned spinWaitTimeUs = 1000;
 	const unsigned threadSwitchCycleTime = 3 * 1000 * 1000;
+	const unsigned vblankSpinWaitTimeUs = 50;
 }
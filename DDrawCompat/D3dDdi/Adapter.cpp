@@ -1,12 +1,33 @@
+#include <cstddef>
+
 #include "D3dDdi/Adapter.h"
 #include "D3dDdi/AdapterFuncs.h"
 
+namespace
+{
+	// D3DCAPS9 can't be included alongside the DirectX 7 headers, so it is mirrored as 76 DWORDs.
+	// MaxVertexIndex is the 47th one, between MaxPrimitiveCount and MaxStreams.
+	struct D3d9Caps
+	{
+		DWORD leading[45];
+		DWORD maxPrimitiveCount;
+		DWORD maxVertexIndex;
+		DWORD maxStreams;
+		DWORD trailing[28];
+	};
+
+	static_assert(offsetof(D3d9Caps, maxVertexIndex) == 184, "D3d9Caps::maxVertexIndex must match D3DCAPS9");
+	static_assert(sizeof(D3d9Caps) == 304, "D3d9Caps must match the size of D3DCAPS9");
+}
+
 namespace D3dDdi
 {
 	Adapter::Adapter(HANDLE adapter, HMODULE module)
 		: m_adapter(adapter)
 		, m_module(module)
 		, m_d3dExtendedCaps{}
+		, m_ddrawCaps{}
+		, m_maxVertexIndex(0xFFFF)
 	{
 		if (m_adapter)
 		{
@@ -20,6 +41,16 @@ namespace D3dDdi
 			getCaps.pData = &m_ddrawCaps;
 			getCaps.DataSize = sizeof(m_ddrawCaps);
 			D3dDdi::AdapterFuncs::s_origVtablePtr->pfnGetCaps(adapter, &getCaps);
+
+			D3d9Caps d3d9Caps = {};
+			getCaps.Type = D3DDDICAPS_GETD3D9CAPS;
+			getCaps.pData = &d3d9Caps;
+			getCaps.DataSize = sizeof(d3d9Caps);
+			if (SUCCEEDED(D3dDdi::AdapterFuncs::s_origVtablePtr->pfnGetCaps(adapter, &getCaps)) &&
+				0 != d3d9Caps.maxVertexIndex)
+			{
+				m_maxVertexIndex = d3d9Caps.maxVertexIndex;
+			}
 		}
 	}
 
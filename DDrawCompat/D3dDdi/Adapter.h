@@ -17,6 +17,7 @@ namespace D3dDdi
 
 		const DDRAW_CAPS& getDDrawCaps() const { return m_ddrawCaps; }
 		const D3DNTHAL_D3DEXTENDEDCAPS& getD3dExtendedCaps() const { return m_d3dExtendedCaps; }
+		UINT getMaxVertexIndex() const { return m_maxVertexIndex; }
 		HMODULE getModule() const { return m_module; }
 
 		static void add(HANDLE adapter, HMODULE module);
@@ -28,6 +29,7 @@ namespace D3dDdi
 		HMODULE m_module;
 		D3DNTHAL_D3DEXTENDEDCAPS m_d3dExtendedCaps;
 		DDRAW_CAPS m_ddrawCaps;
+		UINT m_maxVertexIndex;
 
 		static std::map<HANDLE, Adapter> s_adapters;
 	};
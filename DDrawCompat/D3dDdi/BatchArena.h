@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <Windows.h>
+
+namespace D3dDdi
+{
+	// Flat storage for the primitives batched between two flushes. The capacity is reserved once per device
+	// and kept across flushes, so appending is a single bounds check followed by raw writes into the returned
+	// span. Only a single oversized draw call can take the reallocation path.
+	template <typename T>
+	class BatchArena
+	{
+	public:
+		BatchArena() : m_size(0), m_capacity(0)
+		{
+		}
+
+		BatchArena(const BatchArena&) = delete;
+		BatchArena& operator=(const BatchArena&) = delete;
+
+		T* append(UINT count)
+		{
+			if (m_size + count > m_capacity)
+			{
+				grow(m_size + count);
+			}
+			T* span = m_data.get() + m_size;
+			m_size += count;
+			return span;
+		}
+
+		void append(const T* data, UINT count)
+		{
+			std::memcpy(append(count), data, count * sizeof(T));
+		}
+
+		void assign(const T* data, UINT count)
+		{
+			m_size = 0;
+			append(data, count);
+		}
+
+		void push_back(T value)
+		{
+			*append(1) = value;
+		}
+
+		void reserve(UINT capacity)
+		{
+			if (capacity > m_capacity)
+			{
+				grow(capacity);
+			}
+		}
+
+		void resize(UINT size)
+		{
+			reserve(size);
+			m_size = size;
+		}
+
+		void clear() { m_size = 0; }
+
+		T& operator[](UINT index) { return m_data[index]; }
+		T& back() { return m_data[m_size - 1]; }
+		T* begin() { return m_data.get(); }
+		T* end() { return m_data.get() + m_size; }
+		T* data() { return m_data.get(); }
+		bool empty() const { return 0 == m_size; }
+		UINT size() const { return m_size; }
+
+	private:
+		void grow(UINT minCapacity)
+		{
+			UINT capacity = std::max<UINT>(minCapacity, m_capacity * 2);
+			std::unique_ptr<T[]> data(new T[capacity]);
+			if (0 != m_size)
+			{
+				std::memcpy(data.get(), m_data.get(), m_size * sizeof(T));
+			}
+			m_data = std::move(data);
+			m_capacity = capacity;
+		}
+
+		std::unique_ptr<T[]> m_data;
+		UINT m_size;
+		UINT m_capacity;
+	};
+}
@@ -6,6 +6,7 @@
 #include "Common/Log.h"
 #include "Common/VtableVisitor.h"
 #include "Config/Config.h"
+#include "D3dDdi/DdiRecorder.h"
 #include "D3dDdi/ScopedCriticalSection.h"
 
 namespace D3dDdi
@@ -80,6 +81,12 @@ namespace D3dDdi
 			forEach<Vtable>(visitor);
 #endif
 
+			if (DdiRecorder::isEnabled())
+			{
+				DdiRecorder::RecorderVisitor<Vtable, instanceId> recorderVisitor(compatVtable);
+				forEach<Vtable>(recorderVisitor);
+			}
+
 			isHooked = true;
 			CompatVtableInstance<Vtable, instanceId>::hookVtable(vtable, compatVtable);
 			return CompatVtableInstance<Vtable, instanceId>::s_origVtable;
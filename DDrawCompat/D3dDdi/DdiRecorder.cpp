@@ -0,0 +1,465 @@
+#include <iterator>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <Common/Log.h>
+#include <Common/ScopedCriticalSection.h>
+#include <D3dDdi/DdiRecorder.h>
+#include <D3dDdi/DrawPrimitive.h>
+#include <D3dDdi/FormatInfo.h>
+#include <D3dDdi/Hooks.h>
+
+namespace
+{
+	const UINT FLUSH_SIZE = 1024 * 1024;
+
+	struct DeviceInfo
+	{
+		const BYTE* umVertices;
+		UINT umStride;
+		const BYTE* umIndices;
+		UINT umIndexSize;
+	};
+
+	struct SurfaceSize
+	{
+		UINT width;
+		UINT height;
+	};
+
+	struct ResourceInfo
+	{
+		UINT bytesPerPixel;
+		bool isBuffer;
+		std::vector<SurfaceSize> surfaces;
+	};
+
+	struct LockInfo
+	{
+		const void* data;
+		UINT size;
+		std::vector<BYTE> unlockData;
+	};
+
+	Compat::CriticalSection g_cs;
+	HANDLE g_file = INVALID_HANDLE_VALUE;
+	std::vector<BYTE> g_buffer;
+	UINT16 g_nextFuncId = 0;
+	UINT g_recordCount = 0;
+	ULONGLONG g_fileSize = 0;
+
+	std::map<HANDLE, DeviceInfo> g_devices;
+	std::map<std::pair<HANDLE, HANDLE>, ResourceInfo> g_resources;
+	std::map<std::tuple<HANDLE, HANDLE, UINT>, LockInfo> g_locks;
+
+	void append(const void* data, UINT size)
+	{
+		auto bytes = static_cast<const BYTE*>(data);
+		g_buffer.insert(g_buffer.end(), bytes, bytes + size);
+	}
+
+	void flush()
+	{
+		if (INVALID_HANDLE_VALUE == g_file)
+		{
+			g_buffer.clear();
+			return;
+		}
+
+		DWORD bytesWritten = 0;
+		if (!WriteFile(g_file, g_buffer.data(), g_buffer.size(), &bytesWritten, nullptr) ||
+			bytesWritten != g_buffer.size())
+		{
+			Compat::Log() << "ERROR: Failed to write DDI capture file, recording stopped";
+			CloseHandle(g_file);
+			g_file = INVALID_HANDLE_VALUE;
+		}
+		g_fileSize += bytesWritten;
+		g_buffer.clear();
+	}
+
+	const ResourceInfo* getResourceInfo(HANDLE device, HANDLE resource)
+	{
+		auto it = g_resources.find({ device, resource });
+		return it != g_resources.end() ? &it->second : nullptr;
+	}
+
+	DeviceInfo& getDeviceInfo(HANDLE device)
+	{
+		return g_devices[device];
+	}
+
+	UINT getSurfaceDataSize(const ResourceInfo& resource, UINT width, UINT height, UINT pitch)
+	{
+		if (resource.isBuffer)
+		{
+			return width;
+		}
+		if (0 == resource.bytesPerPixel || 0 == height)
+		{
+			return 0;
+		}
+		return (height - 1) * pitch + width * resource.bytesPerPixel;
+	}
+
+	template <typename CreateResourceArg>
+	void addResource(HANDLE device, const CreateResourceArg& data)
+	{
+		ResourceInfo resource = {};
+		resource.bytesPerPixel = D3dDdi::getFormatInfo(data.Format).bytesPerPixel;
+		resource.isBuffer = D3DDDIFMT_VERTEXDATA == data.Format ||
+			D3DDDIFMT_INDEX16 == data.Format || D3DDDIFMT_INDEX32 == data.Format;
+		for (UINT i = 0; i < data.SurfCount; ++i)
+		{
+			resource.surfaces.push_back({ data.pSurfList[i].Width, max(data.pSurfList[i].Height, 1) });
+		}
+		g_resources[{ device, data.hResource }] = resource;
+	}
+
+	void recordBuffer(D3dDdi::DdiRecorder::ChunkType type, const void* data, UINT offset, UINT size)
+	{
+		if (data && 0 != size)
+		{
+			D3dDdi::DdiRecorder::Record::current().addChunk(type, static_cast<const BYTE*>(data) + offset, size);
+		}
+	}
+
+	template <typename SetShaderConstData>
+	void recordShaderConsts(const SetShaderConstData* data, const void* registers, UINT registerSize)
+	{
+		recordBuffer(D3dDdi::DdiRecorder::CHUNK_SHADER_CONSTS, registers, 0, data->Count * registerSize);
+	}
+
+	template <typename CreateResourceArg>
+	void recordCreateResource(HANDLE device, const CreateResourceArg* data)
+	{
+		auto& record = D3dDdi::DdiRecorder::Record::current();
+		record.addChunk(D3dDdi::DdiRecorder::CHUNK_SURFACE_LIST, data->pSurfList,
+			data->SurfCount * sizeof(data->pSurfList[0]));
+
+		addResource(device, *data);
+		const ResourceInfo& resource = *getResourceInfo(device, data->hResource);
+		for (UINT i = 0; i < data->SurfCount; ++i)
+		{
+			const auto& surfaceInfo = data->pSurfList[i];
+			if (surfaceInfo.pSysMem)
+			{
+				// Emitted even when empty, so that the n-th data chunk belongs to the n-th surface with pSysMem
+				const UINT pitch = 0 != surfaceInfo.SysMemPitch
+					? surfaceInfo.SysMemPitch : surfaceInfo.Width * resource.bytesPerPixel;
+				record.addChunk(D3dDdi::DdiRecorder::CHUNK_SURFACE_DATA, surfaceInfo.pSysMem,
+					getSurfaceDataSize(resource, surfaceInfo.Width, resource.surfaces[i].height, pitch));
+			}
+		}
+	}
+
+	void recordUmVertices(const DeviceInfo& deviceInfo, INT baseVertex, UINT vertexCount)
+	{
+		recordBuffer(D3dDdi::DdiRecorder::CHUNK_VERTICES, deviceInfo.umVertices,
+			baseVertex * deviceInfo.umStride, vertexCount * deviceInfo.umStride);
+	}
+}
+
+namespace D3dDdi
+{
+	namespace DdiRecorder
+	{
+		Record* Record::s_current = nullptr;
+
+		Record::Record(UINT16 funcId, long long qpcBegin, long long qpcEnd, HRESULT result)
+			: m_recordOffset(0)
+		{
+			EnterCriticalSection(&g_cs);
+			m_recordOffset = g_buffer.size();
+			s_current = this;
+
+			RecordHeader header = {};
+			header.funcId = funcId;
+			header.threadId = GetCurrentThreadId();
+			header.result = result;
+			header.qpcBegin = qpcBegin;
+			header.qpcEnd = qpcEnd;
+			append(&header, sizeof(header));
+		}
+
+		Record::~Record()
+		{
+			auto& header = reinterpret_cast<RecordHeader&>(g_buffer[m_recordOffset]);
+			header.size = g_buffer.size() - m_recordOffset;
+			++g_recordCount;
+			s_current = nullptr;
+
+			if (g_buffer.size() >= FLUSH_SIZE)
+			{
+				flush();
+			}
+			LeaveCriticalSection(&g_cs);
+		}
+
+		void Record::addChunk(ChunkType type, const void* data, UINT size)
+		{
+			if (INVALID_HANDLE_VALUE == g_file)
+			{
+				return;
+			}
+
+			ChunkHeader chunk = { type, size };
+			append(&chunk, sizeof(chunk));
+			append(data, size);
+			g_buffer.resize((g_buffer.size() + 7) & ~7);
+			++reinterpret_cast<RecordHeader&>(g_buffer[m_recordOffset]).chunkCount;
+		}
+
+		Record& Record::current()
+		{
+			return *s_current;
+		}
+
+		void init()
+		{
+			char path[MAX_PATH] = {};
+			if (0 == GetEnvironmentVariable("DDRAWCOMPAT_DDI_CAPTURE", path, MAX_PATH) || 0 == path[0])
+			{
+				return;
+			}
+
+			g_file = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (INVALID_HANDLE_VALUE == g_file)
+			{
+				Compat::Log() << "ERROR: Failed to create DDI capture file: " << path;
+				return;
+			}
+
+			g_buffer.reserve(FLUSH_SIZE + FLUSH_SIZE / 4);
+
+			FileHeader header = {};
+			memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+			header.version = FILE_VERSION;
+			header.headerSize = sizeof(header);
+			header.qpcFrequency = Time::g_qpcFrequency;
+			header.qpcStart = Time::queryPerformanceCounter();
+			append(&header, sizeof(header));
+
+			Compat::Log() << "Recording DDI calls to " << path;
+		}
+
+		bool isEnabled()
+		{
+			return INVALID_HANDLE_VALUE != g_file;
+		}
+
+		UINT16 registerFunc(const char* funcName)
+		{
+			Record record(FUNC_ID_NAME, 0, 0, getDdiVersion());
+			record.addChunk(CHUNK_FUNC_NAME, funcName, strlen(funcName));
+			return g_nextFuncId++;
+		}
+
+		void uninit()
+		{
+			Compat::ScopedCriticalSection lock(g_cs);
+			if (INVALID_HANDLE_VALUE == g_file)
+			{
+				return;
+			}
+
+			flush();
+			if (INVALID_HANDLE_VALUE != g_file)
+			{
+				CloseHandle(g_file);
+				g_file = INVALID_HANDLE_VALUE;
+			}
+			Compat::Log() << "DDI capture: " << g_recordCount << " records, " << g_fileSize << " bytes";
+		}
+
+		void onClear(HANDLE /*device*/, const D3DDDIARG_CLEAR* /*data*/, UINT numRect, const RECT* rect)
+		{
+			recordBuffer(CHUNK_RECTS, rect, 0, numRect * sizeof(RECT));
+		}
+
+		void onCreateResource(HANDLE device, const D3DDDIARG_CREATERESOURCE* data)
+		{
+			recordCreateResource(device, data);
+		}
+
+		void onCreateResource2(HANDLE device, const D3DDDIARG_CREATERESOURCE2* data)
+		{
+			recordCreateResource(device, data);
+		}
+
+		void onDestroyDevice(HANDLE device)
+		{
+			g_devices.erase(device);
+			auto isDeviceKey = [=](const auto& entry) { return std::get<0>(entry.first) == device; };
+			for (auto it = g_resources.begin(); it != g_resources.end();)
+			{
+				it = isDeviceKey(*it) ? g_resources.erase(it) : std::next(it);
+			}
+			for (auto it = g_locks.begin(); it != g_locks.end();)
+			{
+				it = isDeviceKey(*it) ? g_locks.erase(it) : std::next(it);
+			}
+		}
+
+		void onDestroyResource(HANDLE device, HANDLE resource)
+		{
+			g_resources.erase({ device, resource });
+		}
+
+		void onDrawIndexedPrimitive(HANDLE device, const D3DDDIARG_DRAWINDEXEDPRIMITIVE* data)
+		{
+			const DeviceInfo& deviceInfo = getDeviceInfo(device);
+			const UINT indexCount = getVertexCount(data->PrimitiveType, data->PrimitiveCount);
+			recordBuffer(CHUNK_INDICES, deviceInfo.umIndices,
+				data->StartIndex * deviceInfo.umIndexSize, indexCount * deviceInfo.umIndexSize);
+			recordUmVertices(deviceInfo, data->BaseVertexIndex + data->MinIndex, data->NumVertices);
+		}
+
+		void onDrawIndexedPrimitive2(HANDLE device, const D3DDDIARG_DRAWINDEXEDPRIMITIVE2* data,
+			UINT indicesSize, const void* indexBuffer, const UINT* /*flagBuffer*/)
+		{
+			const DeviceInfo& deviceInfo = getDeviceInfo(device);
+			const UINT indexCount = getVertexCount(data->PrimitiveType, data->PrimitiveCount);
+			recordBuffer(CHUNK_INDICES, indexBuffer, 0, indexCount * indicesSize);
+			recordBuffer(CHUNK_VERTICES, deviceInfo.umVertices,
+				data->BaseVertexOffset + data->MinIndex * deviceInfo.umStride, data->NumVertices * deviceInfo.umStride);
+		}
+
+		void onDrawPrimitive(HANDLE device, const D3DDDIARG_DRAWPRIMITIVE* data, const UINT* /*flagBuffer*/)
+		{
+			recordUmVertices(getDeviceInfo(device), data->VStart,
+				getVertexCount(data->PrimitiveType, data->PrimitiveCount));
+		}
+
+		void onLock(HANDLE device, const D3DDDIARG_LOCK* data)
+		{
+			if (!data->pSurfData || data->Flags.ReadOnly || data->Flags.NotifyOnly)
+			{
+				return;
+			}
+
+			const ResourceInfo* resource = getResourceInfo(device, data->hResource);
+			if (!resource || data->SubResourceIndex >= resource->surfaces.size())
+			{
+				return;
+			}
+
+			const SurfaceSize& surface = resource->surfaces[data->SubResourceIndex];
+			UINT size = 0;
+			if (data->Flags.RangeValid)
+			{
+				size = data->Range.Size;
+			}
+			else if (data->Flags.AreaValid)
+			{
+				size = getSurfaceDataSize(*resource, data->Area.right - data->Area.left,
+					data->Area.bottom - data->Area.top, data->Pitch);
+			}
+			else if (!data->Flags.BoxValid)
+			{
+				size = getSurfaceDataSize(*resource, surface.width, surface.height, data->Pitch);
+			}
+
+			if (0 != size)
+			{
+				g_locks[{ device, data->hResource, data->SubResourceIndex }] = { data->pSurfData, size, {} };
+			}
+		}
+
+		void onPrepareUnlock(HANDLE device, const D3DDDIARG_UNLOCK* data)
+		{
+			if (!isEnabled())
+			{
+				return;
+			}
+
+			// The locked memory may be a driver mapping that is no longer accessible after the unlock
+			Compat::ScopedCriticalSection lock(g_cs);
+			auto it = g_locks.find({ device, data->hResource, data->SubResourceIndex });
+			if (it != g_locks.end())
+			{
+				auto bytes = static_cast<const BYTE*>(it->second.data);
+				it->second.unlockData.assign(bytes, bytes + it->second.size);
+			}
+		}
+
+		void onPresent1(HANDLE /*device*/, const D3DDDIARG_PRESENT1* data)
+		{
+			recordBuffer(CHUNK_PRESENT_SURFACES, data->phSrcResources, 0,
+				data->SrcResources * sizeof(data->phSrcResources[0]));
+		}
+
+		void onSetPixelShaderConst(HANDLE /*device*/, const D3DDDIARG_SETPIXELSHADERCONST* data, const FLOAT* registers)
+		{
+			recordShaderConsts(data, registers, 4 * sizeof(FLOAT));
+		}
+
+		void onSetPixelShaderConstB(HANDLE /*device*/, const D3DDDIARG_SETPIXELSHADERCONSTB* data, const BOOL* registers)
+		{
+			recordShaderConsts(data, registers, sizeof(BOOL));
+		}
+
+		void onSetPixelShaderConstI(HANDLE /*device*/, const D3DDDIARG_SETPIXELSHADERCONSTI* data, const INT* registers)
+		{
+			recordShaderConsts(data, registers, 4 * sizeof(INT));
+		}
+
+		void onSetIndices(HANDLE device, const D3DDDIARG_SETINDICES* /*data*/)
+		{
+			getDeviceInfo(device).umIndices = nullptr;
+		}
+
+		void onSetIndicesUm(HANDLE device, UINT indexSize, const void* umBuffer)
+		{
+			auto& deviceInfo = getDeviceInfo(device);
+			deviceInfo.umIndices = static_cast<const BYTE*>(umBuffer);
+			deviceInfo.umIndexSize = indexSize;
+		}
+
+		void onSetStreamSource(HANDLE device, const D3DDDIARG_SETSTREAMSOURCE* data)
+		{
+			if (0 == data->Stream)
+			{
+				getDeviceInfo(device).umVertices = nullptr;
+			}
+		}
+
+		void onSetStreamSourceUm(HANDLE device, const D3DDDIARG_SETSTREAMSOURCEUM* data, const void* umBuffer)
+		{
+			if (0 == data->Stream)
+			{
+				auto& deviceInfo = getDeviceInfo(device);
+				deviceInfo.umVertices = static_cast<const BYTE*>(umBuffer);
+				deviceInfo.umStride = data->Stride;
+			}
+		}
+
+		void onSetVertexShaderConst(HANDLE /*device*/, const D3DDDIARG_SETVERTEXSHADERCONST* data, const void* registers)
+		{
+			recordShaderConsts(data, registers, 4 * sizeof(FLOAT));
+		}
+
+		void onSetVertexShaderConstB(HANDLE /*device*/, const D3DDDIARG_SETVERTEXSHADERCONSTB* data, const BOOL* registers)
+		{
+			recordShaderConsts(data, registers, sizeof(BOOL));
+		}
+
+		void onSetVertexShaderConstI(HANDLE /*device*/, const D3DDDIARG_SETVERTEXSHADERCONSTI* data, const INT* registers)
+		{
+			recordShaderConsts(data, registers, 4 * sizeof(INT));
+		}
+
+		void onUnlock(HANDLE device, const D3DDDIARG_UNLOCK* data)
+		{
+			auto it = g_locks.find({ device, data->hResource, data->SubResourceIndex });
+			if (it != g_locks.end())
+			{
+				recordBuffer(CHUNK_LOCK_DATA, it->second.unlockData.data(), 0, it->second.unlockData.size());
+				g_locks.erase(it);
+			}
+		}
+	}
+}
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <type_traits>
+
+#include <d3d.h>
+#include <d3dumddi.h>
+
+#include <Common/CompatVtableInstance.h>
+#include <Common/Time.h>
+
+namespace D3dDdi
+{
+	namespace DdiRecorder
+	{
+		// Capture file layout (little-endian, every block 8-byte aligned so that a record can be parsed in place):
+		// FileHeader, then a sequence of records. Each record is a RecordHeader followed by chunkCount chunks,
+		// each chunk being a ChunkHeader followed by its data padded to 8 bytes. RecordHeader::size covers the
+		// header and all chunks. Records with funcId == FUNC_ID_NAME map the next free funcId to a DDI function name;
+		// their result field holds the DDI version the function table was built for.
+
+		const char FILE_MAGIC[8] = { 'D', 'D', 'C', 'D', 'D', 'I', 'C', 'P' };
+		const UINT32 FILE_VERSION = 1;
+		const UINT16 FUNC_ID_NAME = 0xFFFF;
+
+		enum ChunkType : UINT32
+		{
+			CHUNK_VALUE,
+			CHUNK_STRUCT,
+			CHUNK_NULL,
+			CHUNK_FUNC_NAME,
+			CHUNK_VERTICES,
+			CHUNK_INDICES,
+			CHUNK_LOCK_DATA,
+			CHUNK_SURFACE_LIST,
+			CHUNK_SURFACE_DATA,
+			CHUNK_RECTS,
+			CHUNK_PRESENT_SURFACES,
+			CHUNK_SHADER_CONSTS
+		};
+
+		struct FileHeader
+		{
+			char magic[8];
+			UINT32 version;
+			UINT32 headerSize;
+			INT64 qpcFrequency;
+			INT64 qpcStart;
+		};
+
+		struct RecordHeader
+		{
+			UINT32 size;
+			UINT16 funcId;
+			UINT16 chunkCount;
+			UINT32 threadId;
+			INT32 result;
+			INT64 qpcBegin;
+			INT64 qpcEnd;
+		};
+
+		struct ChunkHeader
+		{
+			UINT32 type;
+			UINT32 size;
+		};
+
+		static_assert(0 == sizeof(FileHeader) % 8 && 0 == sizeof(RecordHeader) % 8 && 0 == sizeof(ChunkHeader) % 8,
+			"Capture file blocks must be 8-byte aligned");
+
+		class Record
+		{
+		public:
+			Record(UINT16 funcId, long long qpcBegin, long long qpcEnd, HRESULT result);
+			~Record();
+
+			void addChunk(ChunkType type, const void* data, UINT size);
+
+			static Record& current();
+
+			template <typename T>
+			void addParam(const T& value)
+			{
+				addParam(value, std::is_pointer<T>());
+			}
+
+		private:
+			template <typename T>
+			void addParam(const T& value, std::false_type /*isPointer*/)
+			{
+				addChunk(CHUNK_VALUE, &value, sizeof(value));
+			}
+
+			template <typename T>
+			void addParam(const T& value, std::true_type /*isPointer*/)
+			{
+				addPointee(value, std::is_void<std::remove_cv_t<std::remove_pointer_t<T>>>());
+			}
+
+			template <typename T>
+			void addPointee(const T& value, std::true_type /*isVoid*/)
+			{
+				addChunk(CHUNK_VALUE, &value, sizeof(value));
+			}
+
+			template <typename T>
+			void addPointee(const T& value, std::false_type /*isVoid*/)
+			{
+				if (value)
+				{
+					addChunk(CHUNK_STRUCT, value, sizeof(*value));
+				}
+				else
+				{
+					addChunk(CHUNK_NULL, nullptr, 0);
+				}
+			}
+
+			UINT32 m_recordOffset;
+
+			static Record* s_current;
+		};
+
+		void init();
+		bool isEnabled();
+		void uninit();
+
+		UINT16 registerFunc(const char* funcName);
+
+		void onClear(HANDLE device, const D3DDDIARG_CLEAR* data, UINT numRect, const RECT* rect);
+		void onCreateResource(HANDLE device, const D3DDDIARG_CREATERESOURCE* data);
+		void onCreateResource2(HANDLE device, const D3DDDIARG_CREATERESOURCE2* data);
+		void onDestroyDevice(HANDLE device);
+		void onDestroyResource(HANDLE device, HANDLE resource);
+		void onDrawIndexedPrimitive(HANDLE device, const D3DDDIARG_DRAWINDEXEDPRIMITIVE* data);
+		void onDrawIndexedPrimitive2(HANDLE device, const D3DDDIARG_DRAWINDEXEDPRIMITIVE2* data,
+			UINT indicesSize, const void* indexBuffer, const UINT* flagBuffer);
+		void onDrawPrimitive(HANDLE device, const D3DDDIARG_DRAWPRIMITIVE* data, const UINT* flagBuffer);
+		void onLock(HANDLE device, const D3DDDIARG_LOCK* data);
+		void onPrepareUnlock(HANDLE device, const D3DDDIARG_UNLOCK* data);
+		void onPresent1(HANDLE device, const D3DDDIARG_PRESENT1* data);
+		void onSetPixelShaderConst(HANDLE device, const D3DDDIARG_SETPIXELSHADERCONST* data, const FLOAT* registers);
+		void onSetPixelShaderConstB(HANDLE device, const D3DDDIARG_SETPIXELSHADERCONSTB* data, const BOOL* registers);
+		void onSetPixelShaderConstI(HANDLE device, const D3DDDIARG_SETPIXELSHADERCONSTI* data, const INT* registers);
+		void onSetIndices(HANDLE device, const D3DDDIARG_SETINDICES* data);
+		void onSetIndicesUm(HANDLE device, UINT indexSize, const void* umBuffer);
+		void onSetStreamSource(HANDLE device, const D3DDDIARG_SETSTREAMSOURCE* data);
+		void onSetStreamSourceUm(HANDLE device, const D3DDDIARG_SETSTREAMSOURCEUM* data, const void* umBuffer);
+		void onSetVertexShaderConst(HANDLE device, const D3DDDIARG_SETVERTEXSHADERCONST* data, const void* registers);
+		void onSetVertexShaderConstB(HANDLE device, const D3DDDIARG_SETVERTEXSHADERCONSTB* data, const BOOL* registers);
+		void onSetVertexShaderConstI(HANDLE device, const D3DDDIARG_SETVERTEXSHADERCONSTI* data, const INT* registers);
+		void onUnlock(HANDLE device, const D3DDDIARG_UNLOCK* data);
+
+		// prepare runs before the call is forwarded, for payloads that are no longer valid once it returns.
+		// record runs after the call, while the record of the call is being built.
+		template <typename MemberDataPtr, MemberDataPtr ptr>
+		struct PayloadRecorder
+		{
+			template <typename... Params>
+			static void prepare(Params...)
+			{
+			}
+
+			template <typename... Params>
+			static void record(Params...)
+			{
+			}
+		};
+
+		template <typename... Params>
+		void ignorePayload(Params...)
+		{
+		}
+
+#define DDI_RECORD_PAYLOAD_EX(func, preHandler, handler) \
+		template <> \
+		struct PayloadRecorder<decltype(&D3DDDI_DEVICEFUNCS::func), &D3DDDI_DEVICEFUNCS::func> \
+		{ \
+			template <typename... Params> \
+			static void prepare(Params... params) \
+			{ \
+				preHandler(params...); \
+			} \
+			\
+			template <typename... Params> \
+			static void record(Params... params) \
+			{ \
+				handler(params...); \
+			} \
+		}
+
+#define DDI_RECORD_PAYLOAD(func, handler) DDI_RECORD_PAYLOAD_EX(func, ignorePayload, handler)
+
+		DDI_RECORD_PAYLOAD(pfnClear, onClear);
+		DDI_RECORD_PAYLOAD(pfnCreateResource, onCreateResource);
+		DDI_RECORD_PAYLOAD(pfnCreateResource2, onCreateResource2);
+		DDI_RECORD_PAYLOAD(pfnDestroyDevice, onDestroyDevice);
+		DDI_RECORD_PAYLOAD(pfnDestroyResource, onDestroyResource);
+		DDI_RECORD_PAYLOAD(pfnDrawIndexedPrimitive, onDrawIndexedPrimitive);
+		DDI_RECORD_PAYLOAD(pfnDrawIndexedPrimitive2, onDrawIndexedPrimitive2);
+		DDI_RECORD_PAYLOAD(pfnDrawPrimitive, onDrawPrimitive);
+		DDI_RECORD_PAYLOAD(pfnLock, onLock);
+		DDI_RECORD_PAYLOAD(pfnPresent1, onPresent1);
+		DDI_RECORD_PAYLOAD(pfnSetIndices, onSetIndices);
+		DDI_RECORD_PAYLOAD(pfnSetIndicesUm, onSetIndicesUm);
+		DDI_RECORD_PAYLOAD(pfnSetPixelShaderConst, onSetPixelShaderConst);
+		DDI_RECORD_PAYLOAD(pfnSetPixelShaderConstB, onSetPixelShaderConstB);
+		DDI_RECORD_PAYLOAD(pfnSetPixelShaderConstI, onSetPixelShaderConstI);
+		DDI_RECORD_PAYLOAD(pfnSetStreamSource, onSetStreamSource);
+		DDI_RECORD_PAYLOAD(pfnSetStreamSourceUm, onSetStreamSourceUm);
+		DDI_RECORD_PAYLOAD(pfnSetVertexShaderConst, onSetVertexShaderConst);
+		DDI_RECORD_PAYLOAD(pfnSetVertexShaderConstB, onSetVertexShaderConstB);
+		DDI_RECORD_PAYLOAD(pfnSetVertexShaderConstI, onSetVertexShaderConstI);
+		DDI_RECORD_PAYLOAD_EX(pfnUnlock, onPrepareUnlock, onUnlock);
+
+#undef DDI_RECORD_PAYLOAD
+#undef DDI_RECORD_PAYLOAD_EX
+
+		template <typename MemberDataPtr, MemberDataPtr ptr>
+		struct FuncId
+		{
+			static UINT16 s_id;
+		};
+
+		template <typename MemberDataPtr, MemberDataPtr ptr>
+		UINT16 FuncId<MemberDataPtr, ptr>::s_id = FUNC_ID_NAME;
+
+		template <typename Vtable, int instanceId>
+		class RecorderVisitor
+		{
+		public:
+			RecorderVisitor(Vtable& /*compatVtable*/)
+			{
+			}
+
+			template <typename MemberDataPtr, MemberDataPtr ptr>
+			void visit(const char* /*funcName*/)
+			{
+			}
+		};
+
+		template <int instanceId>
+		class RecorderVisitor<D3DDDI_DEVICEFUNCS, instanceId>
+		{
+		public:
+			RecorderVisitor(D3DDDI_DEVICEFUNCS& compatVtable)
+				: m_compatVtable(compatVtable)
+			{
+			}
+
+			template <typename MemberDataPtr, MemberDataPtr ptr>
+			void visit(const char* funcName)
+			{
+				if (FUNC_ID_NAME == FuncId<MemberDataPtr, ptr>::s_id)
+				{
+					FuncId<MemberDataPtr, ptr>::s_id = registerFunc(funcName);
+				}
+				s_nextVtable.*ptr = m_compatVtable.*ptr;
+				m_compatVtable.*ptr = &recordedFunc<MemberDataPtr, ptr>;
+			}
+
+		private:
+			template <typename MemberDataPtr, MemberDataPtr ptr, typename Result, typename... Params>
+			static Result APIENTRY recordedFunc(Params... params)
+			{
+				auto func = s_nextVtable.*ptr;
+				if (!func)
+				{
+					func = CompatVtableInstance<D3DDDI_DEVICEFUNCS, instanceId>::s_origVtable.*ptr;
+				}
+				PayloadRecorder<MemberDataPtr, ptr>::prepare(params...);
+				const long long qpcBegin = Time::queryPerformanceCounter();
+				Result result = func(params...);
+				const long long qpcEnd = Time::queryPerformanceCounter();
+
+				Record record(FuncId<MemberDataPtr, ptr>::s_id, qpcBegin, qpcEnd, static_cast<HRESULT>(result));
+				(record.addParam(params), ...);
+				PayloadRecorder<MemberDataPtr, ptr>::record(params...);
+				return result;
+			}
+
+			D3DDDI_DEVICEFUNCS& m_compatVtable;
+			static D3DDDI_DEVICEFUNCS s_nextVtable;
+		};
+
+		template <int instanceId>
+		D3DDDI_DEVICEFUNCS RecorderVisitor<D3DDDI_DEVICEFUNCS, instanceId>::s_nextVtable = {};
+	}
+}
@@ -0,0 +1,952 @@
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <Common/Log.h>
+#include <Common/Time.h>
+#include <D3dDdi/DdiRecorder.h>
+#include <D3dDdi/DdiReplay.h>
+#include <D3dDdi/Device.h>
+#include <D3dDdi/DeviceFuncs.h>
+#include <D3dDdi/Hooks.h>
+#include <D3dDdi/SoftwareDevice.h>
+#include <D3dDdi/Visitors/DeviceFuncsVisitor.h>
+
+namespace
+{
+	const UINT UM_BUFFER_SIZE = 16 * 1024 * 1024;
+
+	struct Chunk
+	{
+		UINT32 type;
+		UINT32 size;
+		const BYTE* data;
+	};
+
+	struct LockInfo
+	{
+		BYTE* data;
+		UINT pitch;
+		UINT capturedPitch;
+		bool isLinear;
+	};
+
+	struct UmStreamInfo
+	{
+		UINT stride;
+		UINT indexSize;
+	};
+
+	class ArgReader
+	{
+	public:
+		ArgReader(const D3dDdi::DdiRecorder::RecordHeader& header)
+			: m_nextChunk(0)
+			, m_isValid(true)
+		{
+			const BYTE* data = reinterpret_cast<const BYTE*>(&header) + sizeof(header);
+			const BYTE* end = reinterpret_cast<const BYTE*>(&header) + header.size;
+			for (UINT i = 0; i < header.chunkCount; ++i)
+			{
+				if (static_cast<UINT>(end - data) < sizeof(D3dDdi::DdiRecorder::ChunkHeader))
+				{
+					m_isValid = false;
+					return;
+				}
+
+				auto& chunkHeader = *reinterpret_cast<const D3dDdi::DdiRecorder::ChunkHeader*>(data);
+				data += sizeof(chunkHeader);
+				if (chunkHeader.size > static_cast<UINT>(end - data))
+				{
+					m_isValid = false;
+					return;
+				}
+				m_chunks.push_back({ chunkHeader.type, chunkHeader.size, data });
+				data += (chunkHeader.size + 7) & ~7;
+			}
+		}
+
+		const Chunk* getPayload(D3dDdi::DdiRecorder::ChunkType type, UINT index = 0) const
+		{
+			for (UINT i = m_nextChunk; i < m_chunks.size(); ++i)
+			{
+				if (type == m_chunks[i].type && 0 == index--)
+				{
+					return &m_chunks[i];
+				}
+			}
+			return nullptr;
+		}
+
+		bool isValid() const { return m_isValid; }
+
+		template <typename T>
+		T read()
+		{
+			T value = {};
+			read(value, std::is_pointer<T>());
+			return value;
+		}
+
+	private:
+		const Chunk* nextChunk()
+		{
+			return m_nextChunk < m_chunks.size() ? &m_chunks[m_nextChunk++] : nullptr;
+		}
+
+		template <typename T>
+		void read(T& value, std::false_type /*isPointer*/)
+		{
+			const Chunk* chunk = nextChunk();
+			if (chunk && D3dDdi::DdiRecorder::CHUNK_VALUE == chunk->type && sizeof(value) == chunk->size)
+			{
+				memcpy(&value, chunk->data, sizeof(value));
+			}
+			else
+			{
+				m_isValid = false;
+			}
+		}
+
+		template <typename T>
+		void read(T& value, std::true_type /*isPointer*/)
+		{
+			readPointer(value, std::is_void<std::remove_cv_t<std::remove_pointer_t<T>>>());
+		}
+
+		template <typename T>
+		void readPointer(T& value, std::true_type /*isVoid*/)
+		{
+			read(value, std::false_type());
+		}
+
+		template <typename T>
+		void readPointer(T& value, std::false_type /*isVoid*/)
+		{
+			const Chunk* chunk = nextChunk();
+			if (chunk && D3dDdi::DdiRecorder::CHUNK_NULL == chunk->type)
+			{
+				value = nullptr;
+				return;
+			}
+
+			if (!chunk || D3dDdi::DdiRecorder::CHUNK_STRUCT != chunk->type || sizeof(*value) != chunk->size)
+			{
+				m_isValid = false;
+				return;
+			}
+
+			m_storage.emplace_back(new UINT64[(chunk->size + 7) / 8]);
+			memcpy(m_storage.back().get(), chunk->data, chunk->size);
+			value = reinterpret_cast<T>(m_storage.back().get());
+		}
+
+		std::vector<Chunk> m_chunks;
+		UINT m_nextChunk;
+		std::vector<std::unique_ptr<UINT64[]>> m_storage;
+		bool m_isValid;
+	};
+
+	// Streams the capture one record at a time, so that its size is not limited by the address space
+	class RecordReader
+	{
+	public:
+		RecordReader(HANDLE file, ULONGLONG size)
+			: m_file(file)
+			, m_size(size)
+			, m_offset(0)
+		{
+		}
+
+		bool readFileHeader(D3dDdi::DdiRecorder::FileHeader& header)
+		{
+			return sizeof(header) <= m_size && read(&header, sizeof(header));
+		}
+
+		const D3dDdi::DdiRecorder::RecordHeader* readRecordHeader()
+		{
+			if (m_offset == m_size)
+			{
+				return nullptr;
+			}
+
+			m_buffer.resize(sizeof(D3dDdi::DdiRecorder::RecordHeader));
+			if (m_offset + m_buffer.size() > m_size || !read(m_buffer.data(), m_buffer.size()))
+			{
+				logTruncated();
+				return nullptr;
+			}
+
+			auto record = getRecord();
+			if (record->size < sizeof(*record) || record->size > m_size - m_offset + sizeof(*record))
+			{
+				logTruncated();
+				return nullptr;
+			}
+			return record;
+		}
+
+		const D3dDdi::DdiRecorder::RecordHeader* readRecord()
+		{
+			return readRecordHeader() ? readRecordPayload() : nullptr;
+		}
+
+		const D3dDdi::DdiRecorder::RecordHeader* readRecordPayload()
+		{
+			const UINT headerSize = m_buffer.size();
+			m_buffer.resize(getRecord()->size);
+			if (!read(m_buffer.data() + headerSize, m_buffer.size() - headerSize))
+			{
+				logTruncated();
+				return nullptr;
+			}
+			return getRecord();
+		}
+
+		bool seek(ULONGLONG offset)
+		{
+			LARGE_INTEGER distance = {};
+			distance.QuadPart = offset;
+			if (offset > m_size || !SetFilePointerEx(m_file, distance, nullptr, FILE_BEGIN))
+			{
+				return false;
+			}
+			m_offset = offset;
+			return true;
+		}
+
+		bool skipRecordPayload()
+		{
+			return seek(m_offset + getRecord()->size - m_buffer.size());
+		}
+
+	private:
+		const D3dDdi::DdiRecorder::RecordHeader* getRecord() const
+		{
+			return reinterpret_cast<const D3dDdi::DdiRecorder::RecordHeader*>(m_buffer.data());
+		}
+
+		void logTruncated() const
+		{
+			Compat::Log() << "DDI replay: capture file is truncated at offset " << m_offset;
+		}
+
+		bool read(void* buffer, UINT size)
+		{
+			BYTE* dst = static_cast<BYTE*>(buffer);
+			while (0 != size)
+			{
+				DWORD bytesRead = 0;
+				if (!ReadFile(m_file, dst, size, &bytesRead, nullptr) || 0 == bytesRead)
+				{
+					return false;
+				}
+				dst += bytesRead;
+				size -= bytesRead;
+				m_offset += bytesRead;
+			}
+			return true;
+		}
+
+		HANDLE m_file;
+		ULONGLONG m_size;
+		ULONGLONG m_offset;
+		std::vector<BYTE> m_buffer;
+	};
+
+	typedef bool(*Replayer)(ArgReader&, D3dDdi::DdiReplay::CallStats&);
+
+	D3DDDI_DEVICEFUNCS g_compatVtable = {};
+	D3DDDI_DEVICEFUNCS g_driverVtable = {};
+	long long g_driverQpc = 0;
+	std::map<std::string, Replayer> g_replayers;
+
+	std::set<HANDLE> g_devices;
+	std::map<HANDLE, HANDLE> g_resourceHandles;
+	std::map<HANDLE, std::vector<std::vector<BYTE>>> g_sysMemBuffers;
+	std::map<std::pair<HANDLE, UINT>, LockInfo> g_locks;
+	std::map<HANDLE, UmStreamInfo> g_umStreams;
+	std::unique_ptr<BYTE[]> g_umVertices;
+	std::unique_ptr<BYTE[]> g_umIndices;
+
+	HANDLE g_capturedResource = nullptr;
+	UINT g_capturedPitch = 0;
+	std::vector<D3DDDI_SURFACEINFO> g_surfaceList;
+	std::vector<std::vector<BYTE>> g_pendingSysMemBuffers;
+	std::vector<D3DDDIARG_PRESENTSURFACE> g_presentSurfaces;
+
+	void translateHandle(HANDLE& handle)
+	{
+		auto it = g_resourceHandles.find(handle);
+		if (it != g_resourceHandles.end())
+		{
+			handle = it->second;
+		}
+	}
+
+	template <typename T>
+	void translate(T& /*data*/)
+	{
+	}
+
+	void translate(D3DDDIARG_BLT& data)
+	{
+		translateHandle(data.hSrcResource);
+		translateHandle(data.hDstResource);
+	}
+
+	void translate(D3DDDIARG_BUFFERBLT& data)
+	{
+		translateHandle(data.hSrcResource);
+		translateHandle(data.hDstResource);
+	}
+
+	void translate(D3DDDIARG_COLORFILL& data)
+	{
+		translateHandle(data.hResource);
+	}
+
+	void translate(D3DDDIARG_DEPTHFILL& data)
+	{
+		translateHandle(data.hResource);
+	}
+
+	void translate(D3DDDIARG_LOCK& data)
+	{
+		translateHandle(data.hResource);
+	}
+
+	void translate(D3DDDIARG_PRESENT& data)
+	{
+		translateHandle(data.hSrcResource);
+		translateHandle(data.hDstResource);
+	}
+
+	void translate(D3DDDIARG_PRESENT1& data)
+	{
+		translateHandle(data.hDstResource);
+	}
+
+	void translate(D3DDDIARG_SETDEPTHSTENCIL& data)
+	{
+		translateHandle(data.hZBuffer);
+	}
+
+	void translate(D3DDDIARG_SETINDICES& data)
+	{
+		translateHandle(data.hIndexBuffer);
+	}
+
+	void translate(D3DDDIARG_SETRENDERTARGET& data)
+	{
+		translateHandle(data.hRenderTarget);
+	}
+
+	void translate(D3DDDIARG_SETSTREAMSOURCE& data)
+	{
+		translateHandle(data.hVertexBuffer);
+	}
+
+	void translate(D3DDDIARG_TEXBLT& data)
+	{
+		translateHandle(data.hSrcResource);
+		translateHandle(data.hDstResource);
+	}
+
+	void translate(D3DDDIARG_UNLOCK& data)
+	{
+		translateHandle(data.hResource);
+	}
+
+	template <typename T>
+	void translateHandles(const T& /*value*/)
+	{
+	}
+
+	template <typename T>
+	void translateHandles(T* data)
+	{
+		if (data)
+		{
+			translate(*const_cast<std::remove_const_t<T>*>(data));
+		}
+	}
+
+	void translateHandles(void* /*handle*/)
+	{
+	}
+
+	void translateHandles(const void* /*data*/)
+	{
+	}
+
+	void copyPayload(const Chunk* payload, BYTE* buffer, UINT offset)
+	{
+		if (payload && offset <= UM_BUFFER_SIZE && payload->size <= UM_BUFFER_SIZE - offset)
+		{
+			memcpy(buffer + offset, payload->data, payload->size);
+		}
+	}
+
+	void copyLockData(const LockInfo& lock, const Chunk& payload)
+	{
+		if (lock.isLinear)
+		{
+			memcpy(lock.data, payload.data, payload.size);
+			return;
+		}
+
+		const UINT rowSize = min(lock.pitch, lock.capturedPitch);
+		BYTE* dst = lock.data;
+		for (UINT offset = 0; offset < payload.size; offset += lock.capturedPitch)
+		{
+			memcpy(dst, payload.data + offset, min(rowSize, payload.size - offset));
+			dst += lock.pitch;
+		}
+	}
+
+	template <typename CreateResourceArg>
+	bool beforeCreateResource(ArgReader& reader, CreateResourceArg* data)
+	{
+		const Chunk* surfaceList = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_SURFACE_LIST);
+		if (!surfaceList || surfaceList->size != data->SurfCount * sizeof(D3DDDI_SURFACEINFO))
+		{
+			return false;
+		}
+
+		g_capturedResource = data->hResource;
+		auto surfaces = reinterpret_cast<const D3DDDI_SURFACEINFO*>(surfaceList->data);
+		g_surfaceList.assign(surfaces, surfaces + data->SurfCount);
+		g_pendingSysMemBuffers.clear();
+
+		UINT dataIndex = 0;
+		for (auto& surface : g_surfaceList)
+		{
+			if (surface.pSysMem)
+			{
+				const Chunk* surfaceData = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_SURFACE_DATA, dataIndex++);
+				const UINT dataSize = surfaceData ? surfaceData->size : 0;
+				const UINT minSize = max(surface.SysMemPitch, surface.Width * 4) * max(surface.Height, 1);
+				g_pendingSysMemBuffers.emplace_back(max(dataSize, minSize));
+				if (surfaceData)
+				{
+					memcpy(g_pendingSysMemBuffers.back().data(), surfaceData->data, surfaceData->size);
+				}
+				surface.pSysMem = g_pendingSysMemBuffers.back().data();
+			}
+		}
+
+		data->pSurfList = g_surfaceList.data();
+		return true;
+	}
+
+	template <typename CreateResourceArg>
+	void afterCreateResource(HRESULT result, CreateResourceArg* data)
+	{
+		if (SUCCEEDED(result))
+		{
+			g_resourceHandles[g_capturedResource] = data->hResource;
+			g_sysMemBuffers[data->hResource] = std::move(g_pendingSysMemBuffers);
+		}
+		g_pendingSysMemBuffers.clear();
+	}
+
+	template <typename RegistersPtr>
+	bool setShaderConsts(ArgReader& reader, RegistersPtr& registers)
+	{
+		const Chunk* payload = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_SHADER_CONSTS);
+		if (!payload)
+		{
+			return false;
+		}
+		registers = static_cast<RegistersPtr>(static_cast<const void*>(payload->data));
+		return true;
+	}
+
+	struct ReplayHookBase
+	{
+		template <typename... Params>
+		static bool before(ArgReader& /*reader*/, Params&...)
+		{
+			return true;
+		}
+
+		template <typename... Params>
+		static void after(ArgReader& /*reader*/, HRESULT /*result*/, Params&...)
+		{
+		}
+	};
+
+	template <typename MemberDataPtr, MemberDataPtr ptr>
+	struct ReplayHook : ReplayHookBase
+	{
+	};
+
+#define REPLAY_HOOK(func) \
+	template <> \
+	struct ReplayHook<decltype(&D3DDDI_DEVICEFUNCS::func), &D3DDDI_DEVICEFUNCS::func> : ReplayHookBase
+
+#define REPLAY_SHADER_CONST_HOOK(func) \
+	REPLAY_HOOK(func) \
+	{ \
+		template <typename SetShaderConstData, typename RegistersPtr> \
+		static bool before(ArgReader& reader, HANDLE&, SetShaderConstData&, RegistersPtr& registers) \
+		{ \
+			return setShaderConsts(reader, registers); \
+		} \
+	}
+
+	REPLAY_HOOK(pfnClear)
+	{
+		static bool before(ArgReader& reader, HANDLE&, const D3DDDIARG_CLEAR*&, UINT& numRect, const RECT*& rect)
+		{
+			const Chunk* payload = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_RECTS);
+			rect = payload ? reinterpret_cast<const RECT*>(payload->data) : nullptr;
+			numRect = payload ? payload->size / sizeof(RECT) : 0;
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnCreateResource)
+	{
+		static bool before(ArgReader& reader, HANDLE&, D3DDDIARG_CREATERESOURCE*& data)
+		{
+			return beforeCreateResource(reader, data);
+		}
+
+		static void after(ArgReader&, HRESULT result, HANDLE&, D3DDDIARG_CREATERESOURCE*& data)
+		{
+			afterCreateResource(result, data);
+		}
+	};
+
+	REPLAY_HOOK(pfnCreateResource2)
+	{
+		static bool before(ArgReader& reader, HANDLE&, D3DDDIARG_CREATERESOURCE2*& data)
+		{
+			return beforeCreateResource(reader, data);
+		}
+
+		static void after(ArgReader&, HRESULT result, HANDLE&, D3DDDIARG_CREATERESOURCE2*& data)
+		{
+			afterCreateResource(result, data);
+		}
+	};
+
+	REPLAY_HOOK(pfnDestroyDevice)
+	{
+		static void after(ArgReader&, HRESULT, HANDLE& device)
+		{
+			g_devices.erase(device);
+			g_umStreams.erase(device);
+		}
+	};
+
+	REPLAY_HOOK(pfnDestroyResource)
+	{
+		static bool before(ArgReader&, HANDLE&, HANDLE& resource)
+		{
+			g_capturedResource = resource;
+			translateHandle(resource);
+			return true;
+		}
+
+		static void after(ArgReader&, HRESULT, HANDLE&, HANDLE& resource)
+		{
+			g_resourceHandles.erase(g_capturedResource);
+			g_sysMemBuffers.erase(resource);
+		}
+	};
+
+	REPLAY_HOOK(pfnDrawIndexedPrimitive)
+	{
+		static bool before(ArgReader& reader, HANDLE& device, const D3DDDIARG_DRAWINDEXEDPRIMITIVE*& data)
+		{
+			const UmStreamInfo& um = g_umStreams[device];
+			copyPayload(reader.getPayload(D3dDdi::DdiRecorder::CHUNK_INDICES), g_umIndices.get(),
+				data->StartIndex * um.indexSize);
+			copyPayload(reader.getPayload(D3dDdi::DdiRecorder::CHUNK_VERTICES), g_umVertices.get(),
+				(data->BaseVertexIndex + data->MinIndex) * um.stride);
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnDrawIndexedPrimitive2)
+	{
+		static bool before(ArgReader& reader, HANDLE& device, const D3DDDIARG_DRAWINDEXEDPRIMITIVE2*& data,
+			UINT&, const void*& indexBuffer, const UINT*& flagBuffer)
+		{
+			const Chunk* indices = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_INDICES);
+			if (!indices)
+			{
+				return false;
+			}
+			indexBuffer = indices->data;
+			flagBuffer = nullptr;
+			copyPayload(reader.getPayload(D3dDdi::DdiRecorder::CHUNK_VERTICES), g_umVertices.get(),
+				data->BaseVertexOffset + data->MinIndex * g_umStreams[device].stride);
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnDrawPrimitive)
+	{
+		static bool before(ArgReader& reader, HANDLE& device, const D3DDDIARG_DRAWPRIMITIVE*& data,
+			const UINT*& flagBuffer)
+		{
+			flagBuffer = nullptr;
+			copyPayload(reader.getPayload(D3dDdi::DdiRecorder::CHUNK_VERTICES), g_umVertices.get(),
+				data->VStart * g_umStreams[device].stride);
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnLock)
+	{
+		static bool before(ArgReader&, HANDLE&, D3DDDIARG_LOCK*& data)
+		{
+			g_capturedPitch = data->Pitch;
+			return true;
+		}
+
+		static void after(ArgReader&, HRESULT result, HANDLE&, D3DDDIARG_LOCK*& data)
+		{
+			if (SUCCEEDED(result) && data->pSurfData && !data->Flags.ReadOnly && !data->Flags.NotifyOnly)
+			{
+				LockInfo lock = {};
+				lock.data = static_cast<BYTE*>(data->pSurfData);
+				lock.pitch = data->Pitch;
+				lock.capturedPitch = g_capturedPitch;
+				lock.isLinear = data->Flags.RangeValid || 0 == lock.capturedPitch || lock.pitch == lock.capturedPitch;
+				g_locks[{ data->hResource, data->SubResourceIndex }] = lock;
+			}
+		}
+	};
+
+	REPLAY_HOOK(pfnPresent1)
+	{
+		static bool before(ArgReader& reader, HANDLE&, D3DDDIARG_PRESENT1*& data)
+		{
+			const Chunk* payload = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_PRESENT_SURFACES);
+			if (!payload || payload->size != data->SrcResources * sizeof(D3DDDIARG_PRESENTSURFACE))
+			{
+				data->SrcResources = 0;
+			}
+			else
+			{
+				auto surfaces = reinterpret_cast<const D3DDDIARG_PRESENTSURFACE*>(payload->data);
+				g_presentSurfaces.assign(surfaces, surfaces + data->SrcResources);
+				for (auto& surface : g_presentSurfaces)
+				{
+					translateHandle(surface.hResource);
+				}
+			}
+			data->phSrcResources = g_presentSurfaces.data();
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnSetIndicesUm)
+	{
+		static bool before(ArgReader&, HANDLE& device, UINT& indexSize, const void*& umBuffer)
+		{
+			g_umStreams[device].indexSize = indexSize;
+			umBuffer = g_umIndices.get();
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnSetStreamSourceUm)
+	{
+		static bool before(ArgReader&, HANDLE& device, const D3DDDIARG_SETSTREAMSOURCEUM*& data, const void*& umBuffer)
+		{
+			if (0 == data->Stream)
+			{
+				g_umStreams[device].stride = data->Stride;
+			}
+			umBuffer = g_umVertices.get();
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnSetTexture)
+	{
+		static bool before(ArgReader&, HANDLE&, UINT&, HANDLE& texture)
+		{
+			translateHandle(texture);
+			return true;
+		}
+	};
+
+	REPLAY_HOOK(pfnUnlock)
+	{
+		static bool before(ArgReader& reader, HANDLE&, const D3DDDIARG_UNLOCK*& data)
+		{
+			auto it = g_locks.find({ data->hResource, data->SubResourceIndex });
+			if (it != g_locks.end())
+			{
+				const Chunk* payload = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_LOCK_DATA);
+				if (payload)
+				{
+					copyLockData(it->second, *payload);
+				}
+				g_locks.erase(it);
+			}
+			return true;
+		}
+	};
+
+	REPLAY_SHADER_CONST_HOOK(pfnSetPixelShaderConst);
+	REPLAY_SHADER_CONST_HOOK(pfnSetPixelShaderConstB);
+	REPLAY_SHADER_CONST_HOOK(pfnSetPixelShaderConstI);
+	REPLAY_SHADER_CONST_HOOK(pfnSetVertexShaderConst);
+	REPLAY_SHADER_CONST_HOOK(pfnSetVertexShaderConstB);
+	REPLAY_SHADER_CONST_HOOK(pfnSetVertexShaderConstI);
+
+#undef REPLAY_SHADER_CONST_HOOK
+#undef REPLAY_HOOK
+
+	template <typename MemberDataPtr, MemberDataPtr ptr, typename... Params>
+	bool invoke(HRESULT(APIENTRY* func)(Params...), ArgReader& reader, D3dDdi::DdiReplay::CallStats& stats)
+	{
+		std::tuple<Params...> args{ reader.read<Params>()... };
+		if (!func || !reader.isValid())
+		{
+			return false;
+		}
+
+		const bool isReplayable = std::apply([&](auto&... params)
+			{
+				(translateHandles(params), ...);
+				return ReplayHook<MemberDataPtr, ptr>::before(reader, params...);
+			}, args);
+		if (!isReplayable)
+		{
+			return false;
+		}
+		g_devices.insert(std::get<0>(args));
+
+		const long long driverQpc = g_driverQpc;
+		const long long qpcBegin = Time::queryPerformanceCounter();
+		HRESULT result = std::apply(func, args);
+		const long long qpcEnd = Time::queryPerformanceCounter();
+		stats.driverQpc += g_driverQpc - driverQpc;
+		stats.layerQpc += qpcEnd - qpcBegin - (g_driverQpc - driverQpc);
+
+		std::apply([&](auto&... params) { ReplayHook<MemberDataPtr, ptr>::after(reader, result, params...); }, args);
+		return true;
+	}
+
+	template <typename MemberDataPtr, MemberDataPtr ptr>
+	bool replay(ArgReader& reader, D3dDdi::DdiReplay::CallStats& stats)
+	{
+		return invoke<MemberDataPtr, ptr>(g_compatVtable.*ptr, reader, stats);
+	}
+
+	template <typename MemberDataPtr, MemberDataPtr ptr, typename Result, typename... Params>
+	Result APIENTRY timedDriverFunc(Params... params)
+	{
+		const long long qpcBegin = Time::queryPerformanceCounter();
+		Result result = (D3dDdi::SoftwareDevice::getVtable().*ptr)(params...);
+		g_driverQpc += Time::queryPerformanceCounter() - qpcBegin;
+		return result;
+	}
+
+	class ReplayVisitor
+	{
+	public:
+		template <typename MemberDataPtr, MemberDataPtr ptr>
+		void visit(const char* funcName)
+		{
+			g_driverVtable.*ptr = &timedDriverFunc<MemberDataPtr, ptr>;
+			if (!(g_compatVtable.*ptr))
+			{
+				g_compatVtable.*ptr = g_driverVtable.*ptr;
+			}
+			g_replayers[funcName] = &replay<MemberDataPtr, ptr>;
+		}
+	};
+
+	std::string getFuncName(const D3dDdi::DdiRecorder::RecordHeader& record)
+	{
+		ArgReader reader(record);
+		const Chunk* name = reader.getPayload(D3dDdi::DdiRecorder::CHUNK_FUNC_NAME);
+		return name ? std::string(reinterpret_cast<const char*>(name->data), name->size) : std::string();
+	}
+
+	UINT getDrawCount(const std::map<std::string, UINT>& callCounts)
+	{
+		UINT count = 0;
+		for (auto funcName : { "pfnDrawIndexedPrimitive", "pfnDrawIndexedPrimitive2", "pfnDrawPrimitive", "pfnDrawPrimitive2" })
+		{
+			auto it = callCounts.find(funcName);
+			if (it != callCounts.end())
+			{
+				count += it->second;
+			}
+		}
+		return count;
+	}
+
+	bool replayFile(RecordReader& file, D3dDdi::DdiReplay::Report& report)
+	{
+		D3dDdi::DdiRecorder::FileHeader header = {};
+		if (!file.readFileHeader(header) ||
+			0 != memcmp(header.magic, D3dDdi::DdiRecorder::FILE_MAGIC, sizeof(header.magic)) ||
+			D3dDdi::DdiRecorder::FILE_VERSION != header.version ||
+			!file.seek(header.headerSize))
+		{
+			Compat::Log() << "DDI replay: unsupported capture file";
+			return false;
+		}
+		report.capturedQpcFrequency = header.qpcFrequency;
+
+		std::vector<std::string> funcNames;
+		UINT ddiVersion = 0;
+		for (auto record = file.readRecordHeader(); record; record = file.readRecordHeader())
+		{
+			if (D3dDdi::DdiRecorder::FUNC_ID_NAME != record->funcId)
+			{
+				if (!file.skipRecordPayload())
+				{
+					break;
+				}
+				continue;
+			}
+
+			record = file.readRecordPayload();
+			if (!record)
+			{
+				break;
+			}
+			funcNames.push_back(getFuncName(*record));
+			ddiVersion = max(ddiVersion, static_cast<UINT>(record->result));
+		}
+
+		D3dDdi::setDdiVersion(ddiVersion);
+		D3dDdi::SoftwareDevice::resetStats();
+		D3dDdi::Resource::resetStats();
+
+		g_compatVtable = {};
+		D3dDdi::DeviceFuncs::setCompatVtable(g_compatVtable);
+		ReplayVisitor visitor;
+		forEach<D3DDDI_DEVICEFUNCS>(visitor);
+
+		auto origVtablePtr = D3dDdi::DeviceFuncs::s_origVtablePtr;
+		D3dDdi::DeviceFuncs::s_origVtablePtr = &g_driverVtable;
+		g_umVertices.reset(new BYTE[UM_BUFFER_SIZE]());
+		g_umIndices.reset(new BYTE[UM_BUFFER_SIZE]());
+
+		file.seek(header.headerSize);
+		for (auto record = file.readRecord(); record; record = file.readRecord())
+		{
+			if (D3dDdi::DdiRecorder::FUNC_ID_NAME == record->funcId)
+			{
+				continue;
+			}
+
+			++report.recordCount;
+			if (record->funcId >= funcNames.size())
+			{
+				++report.skippedRecordCount;
+				continue;
+			}
+
+			auto& stats = report.calls[funcNames[record->funcId]];
+			++stats.count;
+			stats.capturedQpc += record->qpcEnd - record->qpcBegin;
+
+			auto it = g_replayers.find(funcNames[record->funcId]);
+			ArgReader reader(*record);
+			if (it == g_replayers.end() || !it->second(reader, stats))
+			{
+				++report.skippedRecordCount;
+			}
+		}
+
+		for (auto device : g_devices)
+		{
+			g_compatVtable.pfnFlush(device);
+			D3dDdi::Device::remove(device);
+		}
+
+		auto driverStats = D3dDdi::SoftwareDevice::getStats();
+		std::map<std::string, UINT> incomingCounts;
+		for (const auto& call : report.calls)
+		{
+			incomingCounts[call.first] = call.second.count;
+		}
+		report.incomingDrawCount = getDrawCount(incomingCounts);
+		report.driverDrawCount = getDrawCount(driverStats.callCounts);
+		report.primitiveCount = driverStats.primitiveCount;
+		report.resourceStats = D3dDdi::Resource::getStats();
+
+		D3dDdi::DeviceFuncs::s_origVtablePtr = origVtablePtr;
+		g_devices.clear();
+		g_resourceHandles.clear();
+		g_sysMemBuffers.clear();
+		g_locks.clear();
+		g_umStreams.clear();
+		g_umVertices.reset();
+		g_umIndices.reset();
+		return true;
+	}
+
+	double toUs(long long qpc, long long qpcFrequency)
+	{
+		return 0 != qpcFrequency ? qpc * 1e6 / qpcFrequency : 0;
+	}
+}
+
+namespace D3dDdi
+{
+	namespace DdiReplay
+	{
+		void logReport(const Report& report)
+		{
+			Compat::Log() << "DDI replay: " << report.recordCount << " calls, " <<
+				report.skippedRecordCount << " skipped";
+
+			std::vector<std::pair<std::string, CallStats>> calls(report.calls.begin(), report.calls.end());
+			std::sort(calls.begin(), calls.end(), [](const auto& a, const auto& b) {
+				return a.second.layerQpc + a.second.driverQpc > b.second.layerQpc + b.second.driverQpc; });
+
+			for (const auto& call : calls)
+			{
+				Compat::Log() << "  " << call.first << ": " << call.second.count << " calls, captured " <<
+					toUs(call.second.capturedQpc, report.capturedQpcFrequency) << " us, layer " <<
+					toUs(call.second.layerQpc, Time::g_qpcFrequency) << " us, driver " <<
+					toUs(call.second.driverQpc, Time::g_qpcFrequency) << " us";
+			}
+
+			Compat::Log() << "DDI replay batching: " << report.incomingDrawCount << " draws in, " <<
+				report.driverDrawCount << " draws out, " << report.primitiveCount << " primitives";
+			Compat::Log() << "DDI replay copySubResource: " << report.resourceStats.copySubResourceCount <<
+				" copies, " << report.resourceStats.copySubResourceBytes << " bytes";
+		}
+
+		bool replay(const char* fileName, Report& report)
+		{
+			report = {};
+			HANDLE file = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (INVALID_HANDLE_VALUE == file)
+			{
+				Compat::Log() << "DDI replay: failed to open " << fileName;
+				return false;
+			}
+
+			LARGE_INTEGER fileSize = {};
+			GetFileSizeEx(file, &fileSize);
+
+			Compat::Log() << "DDI replay: " << fileName;
+			RecordReader recordReader(file, fileSize.QuadPart);
+			const bool result = replayFile(recordReader, report);
+			CloseHandle(file);
+			return result;
+		}
+	}
+}
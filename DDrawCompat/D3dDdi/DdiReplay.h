@@ -0,0 +1,35 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <D3dDdi/Resource.h>
+
+namespace D3dDdi
+{
+	namespace DdiReplay
+	{
+		struct CallStats
+		{
+			UINT count;
+			long long capturedQpc;
+			long long layerQpc;
+			long long driverQpc;
+		};
+
+		struct Report
+		{
+			std::map<std::string, CallStats> calls;
+			long long capturedQpcFrequency;
+			UINT recordCount;
+			UINT skippedRecordCount;
+			UINT incomingDrawCount;
+			UINT driverDrawCount;
+			ULONGLONG primitiveCount;
+			Resource::Stats resourceStats;
+		};
+
+		void logReport(const Report& report);
+		bool replay(const char* fileName, Report& report);
+	}
+}
@@ -170,6 +170,7 @@ namespace D3dDdi
 		{
 			prepareForRendering();
 		}
+		m_state.applyState();
 		return m_origVtable.pfnClear(m_device, data, numRect, rect);
 	}
 
@@ -267,12 +268,14 @@ namespace D3dDdi
 		UINT /*indicesSize*/, const void* indexBuffer, const UINT* flagBuffer)
 	{
 		prepareForRendering();
+		m_state.applyState();
 		return m_drawPrimitive.drawIndexed(*data, static_cast<const UINT16*>(indexBuffer), flagBuffer);
 	}
 
 	HRESULT Device::drawPrimitive(const D3DDDIARG_DRAWPRIMITIVE* data, const UINT* flagBuffer)
 	{
 		prepareForRendering();
+		m_state.applyState();
 		return m_drawPrimitive.draw(*data, flagBuffer);
 	}
 
@@ -321,6 +324,7 @@ namespace D3dDdi
 	{
 		flushPrimitives();
 		prepareForRendering(data->hSrcResource, data->SrcSubResourceIndex, true);
+		m_drawPrimitive.endFrame();
 		return m_origVtable.pfnPresent(m_device, data);
 	}
 
@@ -331,6 +335,7 @@ namespace D3dDdi
 		{
 			prepareForRendering(data->phSrcResources[i].hResource, data->phSrcResources[i].SubResourceIndex, true);
 		}
+		m_drawPrimitive.endFrame();
 		return m_origVtable.pfnPresent1(m_device, data);
 	}
 
@@ -27,6 +27,15 @@ namespace
 		D3dDdi::Device::get(hDevice).flushPrimitives();
 		return (D3dDdi::DeviceFuncs::s_origVtablePtr->*deviceMethod)(hDevice, params...);
 	}
+
+	template <typename DeviceMethodPtr, DeviceMethodPtr deviceMethod, typename... Params>
+	HRESULT APIENTRY flushState(HANDLE hDevice, Params... params)
+	{
+		auto& device = D3dDdi::Device::get(hDevice);
+		device.flushPrimitives();
+		device.getState().applyState();
+		return (D3dDdi::DeviceFuncs::s_origVtablePtr->*deviceMethod)(hDevice, params...);
+	}
 }
 
 #define DEVICE_FUNC(func) deviceFunc<decltype(&Device::func), &Device::func>
@@ -90,10 +99,16 @@ namespace D3dDdi
 		FLUSH_PRIMITIVES(pfnSetPalette);
 		FLUSH_PRIMITIVES(pfnSetScissorRect);
 		FLUSH_PRIMITIVES(pfnSetViewport);
-		FLUSH_PRIMITIVES(pfnStateSet);
 		FLUSH_PRIMITIVES(pfnTexBlt);
 		FLUSH_PRIMITIVES(pfnTexBlt1);
 		FLUSH_PRIMITIVES(pfnUpdatePalette);
 #undef  FLUSH_PRIMITIVES
+
+#define FLUSH_STATE(func) vtable.func = &flushState<decltype(&D3DDDI_DEVICEFUNCS::func), &D3DDDI_DEVICEFUNCS::func>
+		FLUSH_STATE(pfnDrawPrimitive2);
+		FLUSH_STATE(pfnDrawRectPatch);
+		FLUSH_STATE(pfnDrawTriPatch);
+		FLUSH_STATE(pfnStateSet);
+#undef  FLUSH_STATE
 	}
 }
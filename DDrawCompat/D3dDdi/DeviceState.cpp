@@ -1,3 +1,4 @@
+#include <Common/Log.h>
 #include <D3dDdi/Device.h>
 #include <D3dDdi/DeviceState.h>
 
@@ -12,6 +13,15 @@ namespace
 	{
 		return lhs.WNear == rhs.WNear && lhs.WFar == rhs.WFar;
 	}
+
+	void setStage(D3DDDIARG_RENDERSTATE& /*data*/, UINT /*stage*/)
+	{
+	}
+
+	void setStage(D3DDDIARG_TEXTURESTAGESTATE& data, UINT stage)
+	{
+		data.Stage = stage;
+	}
 }
 
 namespace D3dDdi
@@ -19,19 +29,64 @@ namespace D3dDdi
 	DeviceState::DeviceState(Device& device)
 		: m_device(device)
 		, m_pixelShader(nullptr)
+		, m_dirtyPixelShaderConst{}
+		, m_dirtyPixelShaderConstB{}
+		, m_dirtyPixelShaderConstI{}
 		, m_textures{}
+		, m_dirtyVertexShaderConst{}
+		, m_dirtyVertexShaderConstB{}
+		, m_dirtyVertexShaderConstI{}
 		, m_vertexShaderDecl(nullptr)
 		, m_vertexShaderFunc(nullptr)
 		, m_wInfo{ NAN, NAN }
 		, m_zRange{ NAN, NAN }
 	{
 		m_renderState.fill(0xBAADBAAD);
+		m_appliedRenderState.fill(0xBAADBAAD);
 		for (UINT i = 0; i < m_textureStageState.size(); ++i)
 		{
 			m_textureStageState[i].fill(0xBAADBAAD);
+			m_appliedTextureStageState[i].fill(0xBAADBAAD);
 		}
 	}
 
+	void DeviceState::applyState()
+	{
+		bool isDirty = m_dirtyRenderStates.any() ||
+			m_dirtyPixelShaderConst.begin < m_dirtyPixelShaderConst.end ||
+			m_dirtyPixelShaderConstB.begin < m_dirtyPixelShaderConstB.end ||
+			m_dirtyPixelShaderConstI.begin < m_dirtyPixelShaderConstI.end ||
+			m_dirtyVertexShaderConst.begin < m_dirtyVertexShaderConst.end ||
+			m_dirtyVertexShaderConstB.begin < m_dirtyVertexShaderConstB.end ||
+			m_dirtyVertexShaderConstI.begin < m_dirtyVertexShaderConstI.end;
+		for (UINT i = 0; i < m_dirtyTextureStageStates.size() && !isDirty; ++i)
+		{
+			isDirty = m_dirtyTextureStageStates[i].any();
+		}
+
+		if (!isDirty)
+		{
+			return;
+		}
+
+		m_device.flushPrimitives();
+
+		auto& vtable = m_device.getOrigVtable();
+		applyStateArray(0, m_renderState, m_appliedRenderState, m_dirtyRenderStates, vtable.pfnSetRenderState);
+		for (UINT i = 0; i < m_textureStageState.size(); ++i)
+		{
+			applyStateArray(i, m_textureStageState[i], m_appliedTextureStageState[i], m_dirtyTextureStageStates[i],
+				vtable.pfnSetTextureStageState);
+		}
+
+		applyShaderConst(m_pixelShaderConst, m_dirtyPixelShaderConst, vtable.pfnSetPixelShaderConst);
+		applyShaderConst(m_pixelShaderConstB, m_dirtyPixelShaderConstB, vtable.pfnSetPixelShaderConstB);
+		applyShaderConst(m_pixelShaderConstI, m_dirtyPixelShaderConstI, vtable.pfnSetPixelShaderConstI);
+		applyShaderConst(m_vertexShaderConst, m_dirtyVertexShaderConst, vtable.pfnSetVertexShaderConst);
+		applyShaderConst(m_vertexShaderConstB, m_dirtyVertexShaderConstB, vtable.pfnSetVertexShaderConstB);
+		applyShaderConst(m_vertexShaderConstI, m_dirtyVertexShaderConstI, vtable.pfnSetVertexShaderConstI);
+	}
+
 	HRESULT DeviceState::pfnDeletePixelShader(HANDLE shader)
 	{
 		return deleteShader(shader, m_pixelShader, m_device.getOrigVtable().pfnDeletePixelShader);
@@ -54,22 +109,23 @@ namespace D3dDdi
 
 	HRESULT DeviceState::pfnSetPixelShaderConst(const D3DDDIARG_SETPIXELSHADERCONST* data, const FLOAT* registers)
 	{
-		return setShaderConst(data, registers, m_pixelShaderConst, m_device.getOrigVtable().pfnSetPixelShaderConst);
+		return setShaderConst(data, registers, m_pixelShaderConst, m_dirtyPixelShaderConst);
 	}
 
 	HRESULT DeviceState::pfnSetPixelShaderConstB(const D3DDDIARG_SETPIXELSHADERCONSTB* data, const BOOL* registers)
 	{
-		return setShaderConst(data, registers, m_pixelShaderConstB, m_device.getOrigVtable().pfnSetPixelShaderConstB);
+		return setShaderConst(data, registers, m_pixelShaderConstB, m_dirtyPixelShaderConstB);
 	}
 
 	HRESULT DeviceState::pfnSetPixelShaderConstI(const D3DDDIARG_SETPIXELSHADERCONSTI* data, const INT* registers)
 	{
-		return setShaderConst(data, registers, m_pixelShaderConstI, m_device.getOrigVtable().pfnSetPixelShaderConstI);
+		return setShaderConst(data, registers, m_pixelShaderConstI, m_dirtyPixelShaderConstI);
 	}
 
 	HRESULT DeviceState::pfnSetRenderState(const D3DDDIARG_RENDERSTATE* data)
 	{
-		return setStateArray(data, m_renderState, m_device.getOrigVtable().pfnSetRenderState);
+		return setStateArray(data, m_renderState, m_appliedRenderState, m_dirtyRenderStates,
+			m_device.getOrigVtable().pfnSetRenderState);
 	}
 
 	HRESULT DeviceState::pfnSetTexture(UINT stage, HANDLE texture)
@@ -85,12 +141,14 @@ namespace D3dDdi
 			return S_OK;
 		}
 
+		applyState();
 		m_device.flushPrimitives();
 		HRESULT result = m_device.getOrigVtable().pfnSetTexture(m_device, stage, texture);
 		if (SUCCEEDED(result))
 		{
 			m_textures[stage] = texture;
 			m_textureStageState[stage][D3DDDITSS_DISABLETEXTURECOLORKEY] = 0xBAADBAAD;
+			m_appliedTextureStageState[stage][D3DDDITSS_DISABLETEXTURECOLORKEY] = 0xBAADBAAD;
 		}
 		return result;
 	}
@@ -99,9 +157,13 @@ namespace D3dDdi
 	{
 		if (D3DDDITSS_TEXTURECOLORKEYVAL == data->State)
 		{
+			// Setting the color key value implicitly enables color keying, so it must stay ordered
+			// with respect to any pending D3DDDITSS_DISABLETEXTURECOLORKEY change
+			applyState();
 			if (0 != m_textureStageState[data->Stage][D3DDDITSS_DISABLETEXTURECOLORKEY])
 			{
 				m_textureStageState[data->Stage][D3DDDITSS_DISABLETEXTURECOLORKEY] = 0;
+				m_appliedTextureStageState[data->Stage][D3DDDITSS_DISABLETEXTURECOLORKEY] = 0;
 			}
 			else if (data->Value == m_textureStageState[data->Stage][D3DDDITSS_TEXTURECOLORKEYVAL])
 			{
@@ -113,25 +175,27 @@ namespace D3dDdi
 			if (SUCCEEDED(result))
 			{
 				m_textureStageState[data->Stage][D3DDDITSS_TEXTURECOLORKEYVAL] = data->Value;
+				m_appliedTextureStageState[data->Stage][D3DDDITSS_TEXTURECOLORKEYVAL] = data->Value;
 			}
 			return result;
 		}
-		return setStateArray(data, m_textureStageState[data->Stage], m_device.getOrigVtable().pfnSetTextureStageState);
+		return setStateArray(data, m_textureStageState[data->Stage], m_appliedTextureStageState[data->Stage],
+			m_dirtyTextureStageStates[data->Stage], m_device.getOrigVtable().pfnSetTextureStageState);
 	}
 
 	HRESULT DeviceState::pfnSetVertexShaderConst(const D3DDDIARG_SETVERTEXSHADERCONST* data, const void* registers)
 	{
-		return setShaderConst(data, registers, m_vertexShaderConst, m_device.getOrigVtable().pfnSetVertexShaderConst);
+		return setShaderConst(data, registers, m_vertexShaderConst, m_dirtyVertexShaderConst);
 	}
 
 	HRESULT DeviceState::pfnSetVertexShaderConstB(const D3DDDIARG_SETVERTEXSHADERCONSTB* data, const BOOL* registers)
 	{
-		return setShaderConst(data, registers, m_vertexShaderConstB, m_device.getOrigVtable().pfnSetVertexShaderConstB);
+		return setShaderConst(data, registers, m_vertexShaderConstB, m_dirtyVertexShaderConstB);
 	}
 
 	HRESULT DeviceState::pfnSetVertexShaderConstI(const D3DDDIARG_SETVERTEXSHADERCONSTI* data, const INT* registers)
 	{
-		return setShaderConst(data, registers, m_vertexShaderConstI, m_device.getOrigVtable().pfnSetVertexShaderConstI);
+		return setShaderConst(data, registers, m_vertexShaderConstI, m_dirtyVertexShaderConstI);
 	}
 
 	HRESULT DeviceState::pfnSetVertexShaderDecl(HANDLE shader)
@@ -159,6 +223,51 @@ namespace D3dDdi
 		return setState(&wInfo, m_wInfo, m_device.getOrigVtable().pfnUpdateWInfo);
 	}
 
+	template <typename SetShaderConstData, typename ShaderConst, typename Registers>
+	void DeviceState::applyShaderConst(const std::vector<ShaderConst>& shaderConst, ShaderConstRange& dirtyRange,
+		HRESULT(APIENTRY* origSetShaderConstFunc)(HANDLE, const SetShaderConstData*, const Registers*))
+	{
+		if (dirtyRange.begin < dirtyRange.end)
+		{
+			SetShaderConstData data = {};
+			data.Register = dirtyRange.begin;
+			data.Count = dirtyRange.end - dirtyRange.begin;
+			origSetShaderConstFunc(m_device, &data, reinterpret_cast<const Registers*>(&shaderConst[data.Register]));
+			dirtyRange = {};
+		}
+	}
+
+	template <typename StateData, std::size_t size>
+	void DeviceState::applyStateArray(UINT stage, std::array<UINT, size>& currentState,
+		std::array<UINT, size>& appliedState, std::bitset<size>& dirtyStates,
+		HRESULT(APIENTRY* origSetState)(HANDLE, const StateData*))
+	{
+		for (UINT i = 0; i < size && dirtyStates.any(); ++i)
+		{
+			if (!dirtyStates.test(i))
+			{
+				continue;
+			}
+
+			StateData data = {};
+			setStage(data, stage);
+			data.State = static_cast<decltype(data.State)>(i);
+			data.Value = currentState[i];
+			HRESULT result = origSetState(m_device, &data);
+			if (SUCCEEDED(result))
+			{
+				appliedState[i] = currentState[i];
+			}
+			else
+			{
+				LOG_ONCE("ERROR: Failed to apply deferred state " << data.State << " (stage " << stage <<
+					", value " << data.Value << "): " << Compat::hex(result));
+				currentState[i] = appliedState[i];
+			}
+			dirtyStates.reset(i);
+		}
+	}
+
 	HRESULT DeviceState::deleteShader(HANDLE shader, HANDLE& currentShader,
 		HRESULT(APIENTRY* origDeleteShaderFunc)(HANDLE, HANDLE))
 	{
@@ -194,8 +303,7 @@ namespace D3dDdi
 
 	template <typename SetShaderConstData, typename ShaderConst, typename Registers>
 	HRESULT DeviceState::setShaderConst(const SetShaderConstData* data, const Registers* registers,
-		std::vector<ShaderConst>& shaderConst,
-		HRESULT(APIENTRY* origSetShaderConstFunc)(HANDLE, const SetShaderConstData*, const Registers*))
+		std::vector<ShaderConst>& shaderConst, ShaderConstRange& dirtyRange)
 	{
 		if (data->Register + data->Count > shaderConst.size())
 		{
@@ -207,13 +315,17 @@ namespace D3dDdi
 			return S_OK;
 		}
 
-		m_device.flushPrimitives();
-		HRESULT result = origSetShaderConstFunc(m_device, data, registers);
-		if (SUCCEEDED(result))
+		memcpy(&shaderConst[data->Register], registers, data->Count * sizeof(ShaderConst));
+		if (dirtyRange.begin < dirtyRange.end)
 		{
-			memcpy(&shaderConst[data->Register], registers, data->Count * sizeof(ShaderConst));
+			dirtyRange.begin = min(dirtyRange.begin, data->Register);
+			dirtyRange.end = max(dirtyRange.end, data->Register + data->Count);
 		}
-		return result;
+		else
+		{
+			dirtyRange = { data->Register, data->Register + data->Count };
+		}
+		return S_OK;
 	}
 
 	template <typename StateData>
@@ -234,12 +346,14 @@ namespace D3dDdi
 		return result;
 	}
 
-	template <typename StateData, UINT size>
+	template <typename StateData, std::size_t size>
 	HRESULT DeviceState::setStateArray(const StateData* data, std::array<UINT, size>& currentState,
+		const std::array<UINT, size>& appliedState, std::bitset<size>& dirtyStates,
 		HRESULT(APIENTRY* origSetState)(HANDLE, const StateData*))
 	{
 		if (data->State >= static_cast<INT>(currentState.size()))
 		{
+			applyState();
 			m_device.flushPrimitives();
 			return origSetState(m_device, data);
 		}
@@ -249,12 +363,8 @@ namespace D3dDdi
 			return S_OK;
 		}
 
-		m_device.flushPrimitives();
-		HRESULT result = origSetState(m_device, data);
-		if (SUCCEEDED(result))
-		{
-			currentState[data->State] = data->Value;
-		}
-		return result;
+		currentState[data->State] = data->Value;
+		dirtyStates.set(data->State, data->Value != appliedState[data->State]);
+		return S_OK;
 	}
 }
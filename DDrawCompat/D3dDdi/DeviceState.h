@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <bitset>
 #include <vector>
 
 namespace D3dDdi
@@ -11,7 +12,9 @@ namespace D3dDdi
 	{
 	public:
 		DeviceState(Device& device);
-		
+
+		void applyState();
+
 		HRESULT pfnDeletePixelShader(HANDLE shader);
 		HRESULT pfnDeleteVertexShaderDecl(HANDLE shader);
 		HRESULT pfnDeleteVertexShaderFunc(HANDLE shader);
@@ -31,8 +34,22 @@ namespace D3dDdi
 		HRESULT pfnUpdateWInfo(const D3DDDIARG_WINFO* data);
 
 	private:
-		typedef std::tuple<FLOAT, FLOAT, FLOAT, FLOAT> ShaderConstF;
-		typedef std::tuple<INT, INT, INT, INT> ShaderConstI;
+		typedef std::array<FLOAT, 4> ShaderConstF;
+		typedef std::array<INT, 4> ShaderConstI;
+
+		struct ShaderConstRange
+		{
+			UINT begin;
+			UINT end;
+		};
+
+		template <typename SetShaderConstData, typename ShaderConst, typename Registers>
+		void applyShaderConst(const std::vector<ShaderConst>& shaderConst, ShaderConstRange& dirtyRange,
+			HRESULT(APIENTRY* origSetShaderConstFunc)(HANDLE, const SetShaderConstData*, const Registers*));
+
+		template <typename StateData, std::size_t size>
+		void applyStateArray(UINT stage, std::array<UINT, size>& currentState, std::array<UINT, size>& appliedState,
+			std::bitset<size>& dirtyStates, HRESULT(APIENTRY* origSetState)(HANDLE, const StateData*));
 
 		HRESULT deleteShader(HANDLE shader, HANDLE& currentShader,
 			HRESULT(APIENTRY* origDeleteShaderFunc)(HANDLE, HANDLE));
@@ -41,15 +58,15 @@ namespace D3dDdi
 
 		template <typename SetShaderConstData, typename ShaderConst, typename Registers>
 		HRESULT setShaderConst(const SetShaderConstData* data, const Registers* registers,
-			std::vector<ShaderConst>& shaderConst,
-			HRESULT(APIENTRY* origSetShaderConstFunc)(HANDLE, const SetShaderConstData*, const Registers*));
+			std::vector<ShaderConst>& shaderConst, ShaderConstRange& dirtyRange);
 
 		template <typename StateData>
 		HRESULT setState(const StateData* data, StateData& currentState,
 			HRESULT(APIENTRY* origSetState)(HANDLE, const StateData*));
 
-		template <typename StateData, UINT size>
+		template <typename StateData, std::size_t size>
 		HRESULT setStateArray(const StateData* data, std::array<UINT, size>& currentState,
+			const std::array<UINT, size>& appliedState, std::bitset<size>& dirtyStates,
 			HRESULT(APIENTRY* origSetState)(HANDLE, const StateData*));
 
 		Device& m_device;
@@ -57,12 +74,22 @@ namespace D3dDdi
 		std::vector<ShaderConstF> m_pixelShaderConst;
 		std::vector<BOOL> m_pixelShaderConstB;
 		std::vector<ShaderConstI> m_pixelShaderConstI;
+		ShaderConstRange m_dirtyPixelShaderConst;
+		ShaderConstRange m_dirtyPixelShaderConstB;
+		ShaderConstRange m_dirtyPixelShaderConstI;
 		std::array<UINT, D3DDDIRS_BLENDOPALPHA + 1> m_renderState;
+		std::array<UINT, D3DDDIRS_BLENDOPALPHA + 1> m_appliedRenderState;
+		std::bitset<D3DDDIRS_BLENDOPALPHA + 1> m_dirtyRenderStates;
 		std::array<HANDLE, 8> m_textures;
 		std::array<std::array<UINT, D3DDDITSS_TEXTURECOLORKEYVAL + 1>, 8> m_textureStageState;
+		std::array<std::array<UINT, D3DDDITSS_TEXTURECOLORKEYVAL + 1>, 8> m_appliedTextureStageState;
+		std::array<std::bitset<D3DDDITSS_TEXTURECOLORKEYVAL + 1>, 8> m_dirtyTextureStageStates;
 		std::vector<ShaderConstF> m_vertexShaderConst;
 		std::vector<BOOL> m_vertexShaderConstB;
 		std::vector<ShaderConstI> m_vertexShaderConstI;
+		ShaderConstRange m_dirtyVertexShaderConst;
+		ShaderConstRange m_dirtyVertexShaderConstB;
+		ShaderConstRange m_dirtyVertexShaderConstI;
 		HANDLE m_vertexShaderDecl;
 		HANDLE m_vertexShaderFunc;
 		D3DDDIARG_WINFO m_wInfo;
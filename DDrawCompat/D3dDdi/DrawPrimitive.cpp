@@ -1,34 +1,20 @@
 #include <algorithm>
+#include <climits>
+#include <cstring>
 
 #include <Common/Log.h>
+#include <D3dDdi/Adapter.h>
 #include <D3dDdi/DrawPrimitive.h>
 #include <D3dDdi/Device.h>
+#include <D3dDdi/IndexKernels.h>
 #include <D3dDdi/Resource.h>
 
 namespace
 {
 	const UINT INDEX_BUFFER_SIZE = 256 * 1024;
+	const UINT INDEX32_BUFFER_SIZE = 1024 * 1024;
 	const UINT VERTEX_BUFFER_SIZE = 1024 * 1024;
 
-	UINT getVertexCount(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount)
-	{
-		switch (primitiveType)
-		{
-		case D3DPT_POINTLIST:
-			return primitiveCount;
-		case D3DPT_LINELIST:
-			return primitiveCount * 2;
-		case D3DPT_LINESTRIP:
-			return primitiveCount + 1;
-		case D3DPT_TRIANGLELIST:
-			return primitiveCount * 3;
-		case D3DPT_TRIANGLESTRIP:
-		case D3DPT_TRIANGLEFAN:
-			return primitiveCount + 2;
-		}
-		return 0;
-	}
-
 	void updateMax(UINT& max, UINT value)
 	{
 		if (value > max)
@@ -48,24 +34,60 @@ namespace
 
 namespace D3dDdi
 {
+	UINT getVertexCount(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount)
+	{
+		switch (primitiveType)
+		{
+		case D3DPT_POINTLIST:
+			return primitiveCount;
+		case D3DPT_LINELIST:
+			return primitiveCount * 2;
+		case D3DPT_LINESTRIP:
+			return primitiveCount + 1;
+		case D3DPT_TRIANGLELIST:
+			return primitiveCount * 3;
+		case D3DPT_TRIANGLESTRIP:
+		case D3DPT_TRIANGLEFAN:
+			return primitiveCount + 2;
+		}
+		return 0;
+	}
+
 	DrawPrimitive::DrawPrimitive(Device& device)
 		: m_device(device)
 		, m_origVtable(device.getOrigVtable())
 		, m_vertexBuffer(device, VERTEX_BUFFER_SIZE)
-		, m_indexBuffer(device, m_vertexBuffer ? INDEX_BUFFER_SIZE : 0)
+		, m_indexBuffer(device, m_vertexBuffer && device.getAdapter().getMaxVertexIndex() > 0xFFFF
+			? INDEX32_BUFFER_SIZE : 0, D3DDDIFMT_INDEX32)
 		, m_streamSource{}
 		, m_batched{}
+		, m_maxBatchedIndexCount(D3DMAXNUMVERTICES)
 	{
+		if (!m_indexBuffer)
+		{
+			m_indexBuffer.resize(m_vertexBuffer ? INDEX_BUFFER_SIZE : 0, D3DDDIFMT_INDEX16);
+		}
+
 		LOG_ONCE("Dynamic vertex buffers are " << (m_vertexBuffer ? "" : "not ") << "available");
 		LOG_ONCE("Dynamic index buffers are " << (m_indexBuffer ? "" : "not ") << "available");
 
 		if (m_indexBuffer)
 		{
+			LOG_ONCE("Dynamic index buffer format: " << (4 == m_indexBuffer.getStride() ? "INDEX32" : "INDEX16") <<
+				", max vertex index: " << device.getAdapter().getMaxVertexIndex());
+			if (4 == m_indexBuffer.getStride())
+			{
+				m_maxBatchedIndexCount = INDEX32_BUFFER_SIZE / sizeof(UINT);
+			}
+
 			D3DDDIARG_SETINDICES si = {};
 			si.hIndexBuffer = m_indexBuffer;
-			si.Stride = 2;
+			si.Stride = m_indexBuffer.getStride();
 			m_origVtable.pfnSetIndices(m_device, &si);
 		}
+
+		m_batched.vertices.reserve(VERTEX_BUFFER_SIZE);
+		m_batched.indices.reserve(m_maxBatchedIndexCount);
 	}
 
 	void DrawPrimitive::addSysMemVertexBuffer(HANDLE resource, BYTE* vertices, UINT fvf)
@@ -87,15 +109,12 @@ namespace D3dDdi
 		if (vertexCount <= count)
 		{
 			INT delta = getBatchedVertexCount() - minIndex;
-			for (UINT i = 0; i < count; ++i)
-			{
-				m_batched.indices.push_back(static_cast<UINT16>(indices[i] + delta));
-			}
+			IndexKernels::addIndexOffset(m_batched.indices.append(count), indices, count, delta);
 			appendVertices(baseVertexIndex + minIndex, vertexCount);
 			return;
 		}
 
-		static UINT16 indexMap[D3DMAXNUMVERTICES] = {};
+		static UINT indexMap[D3DMAXNUMVERTICES] = {};
 		static BYTE indexCycles[D3DMAXNUMVERTICES] = {};
 		static BYTE currentCycle = 0;
 		static UINT maxVertexCount = 0;
@@ -112,7 +131,8 @@ namespace D3dDdi
 			updateMax(maxVertexCount, vertexCount);
 		}
 
-		UINT16 newIndex = static_cast<UINT16>(getBatchedVertexCount());
+		UINT newIndex = getBatchedVertexCount();
+		UINT* newIndices = m_batched.indices.append(count);
 		for (UINT i = 0; i < count; ++i)
 		{
 			const UINT16 zeroBasedIndex = static_cast<UINT16>(indices[i] - minIndex);
@@ -121,16 +141,28 @@ namespace D3dDdi
 				appendVertices(baseVertexIndex + indices[i], 1);
 				indexMap[zeroBasedIndex] = newIndex;
 				indexCycles[zeroBasedIndex] = currentCycle;
-				m_batched.indices.push_back(newIndex);
+				newIndices[i] = newIndex;
 				++newIndex;
 			}
 			else
 			{
-				m_batched.indices.push_back(indexMap[zeroBasedIndex]);
+				newIndices[i] = indexMap[zeroBasedIndex];
 			}
 		}
 	}
 
+	void DrawPrimitive::appendGatheredVertices(INT baseVertexIndex, const UINT16* indices, UINT count)
+	{
+		const UINT stride = m_streamSource.stride;
+		const BYTE* vertices = m_streamSource.vertices + baseVertexIndex * stride;
+		BYTE* dst = m_batched.vertices.append(count * stride);
+		for (UINT i = 0; i < count; ++i)
+		{
+			memcpy(dst, vertices + indices[i] * stride, stride);
+			dst += stride;
+		}
+	}
+
 	void DrawPrimitive::appendIndexRange(UINT base, UINT count)
 	{
 		rebaseIndices();
@@ -139,10 +171,7 @@ namespace D3dDdi
 
 	void DrawPrimitive::appendIndexRangeWithoutRebase(UINT base, UINT count)
 	{
-		for (UINT i = base; i < base + count; ++i)
-		{
-			m_batched.indices.push_back(static_cast<UINT16>(i));
-		}
+		IndexKernels::generateIndexRange(m_batched.indices.append(count), base, count);
 		updateMin(m_batched.minIndex, base);
 		updateMax(m_batched.maxIndex, base + count - 1);
 	}
@@ -151,10 +180,7 @@ namespace D3dDdi
 		INT baseVertexIndex, UINT minIndex, UINT maxIndex)
 	{
 		rebaseIndices();
-		for (UINT i = 0; i < count; ++i)
-		{
-			m_batched.indices.push_back(static_cast<UINT16>(baseVertexIndex + indices[i]));
-		}
+		IndexKernels::addIndexOffset(m_batched.indices.append(count), indices, count, baseVertexIndex);
 		updateMin(m_batched.minIndex, baseVertexIndex + minIndex);
 		updateMax(m_batched.maxIndex, baseVertexIndex + maxIndex);
 	}
@@ -199,10 +225,36 @@ namespace D3dDdi
 		}
 	}
 
+	void DrawPrimitive::appendLineStrip(INT baseVertexIndex, UINT primitiveCount,
+		const UINT16* indices, UINT minIndex, UINT maxIndex)
+	{
+		convertToLineList();
+		rebaseIndices();
+		appendIndicesAndVertices(indices, primitiveCount + 1, baseVertexIndex, minIndex, maxIndex);
+		convertIndexedLineStripToList(m_batched.primitiveCount, primitiveCount);
+	}
+
+	void DrawPrimitive::appendPoints(INT baseVertexIndex, UINT primitiveCount, const UINT16* indices)
+	{
+		if (!m_streamSource.vertices)
+		{
+			return;
+		}
+
+		if (indices)
+		{
+			appendGatheredVertices(baseVertexIndex, indices, primitiveCount);
+		}
+		else
+		{
+			appendVertices(baseVertexIndex, primitiveCount);
+		}
+	}
+
 	bool DrawPrimitive::appendPrimitives(D3DPRIMITIVETYPE primitiveType, INT baseVertexIndex, UINT primitiveCount,
 		const UINT16* indices, UINT minIndex, UINT maxIndex)
 	{
-		if ((m_batched.primitiveCount + primitiveCount) * 3 > D3DMAXNUMVERTICES)
+		if ((m_batched.primitiveCount + primitiveCount) * 3 > m_maxBatchedIndexCount)
 		{
 			return false;
 		}
@@ -211,26 +263,30 @@ namespace D3dDdi
 		{
 		case D3DPT_POINTLIST:
 			if (D3DPT_POINTLIST != m_batched.primitiveType ||
-				!m_streamSource.vertices &&
-				m_batched.baseVertexIndex + static_cast<INT>(m_batched.primitiveCount) != baseVertexIndex)
+				(!m_streamSource.vertices &&
+				(indices || !m_batched.indices.empty() ||
+					m_batched.baseVertexIndex + static_cast<INT>(m_batched.primitiveCount) != baseVertexIndex)))
 			{
 				return false;
 			}
-			if (m_streamSource.vertices)
+			appendPoints(baseVertexIndex, primitiveCount, indices);
+			break;
+
+		case D3DPT_LINELIST:
+			if (D3DPT_LINELIST != m_batched.primitiveType && D3DPT_LINESTRIP != m_batched.primitiveType)
 			{
-				appendVertices(baseVertexIndex, primitiveCount);
+				return false;
 			}
+			convertToLineList();
+			appendLineOrTriangleList(baseVertexIndex, primitiveCount, 2, indices, minIndex, maxIndex);
 			break;
 
 		case D3DPT_LINESTRIP:
-			return false;
-
-		case D3DPT_LINELIST:
-			if (D3DPT_LINELIST != m_batched.primitiveType)
+			if (D3DPT_LINELIST != m_batched.primitiveType && D3DPT_LINESTRIP != m_batched.primitiveType)
 			{
 				return false;
 			}
-			appendLineOrTriangleList(baseVertexIndex, primitiveCount, 2, indices, minIndex, maxIndex);
+			appendLineStrip(baseVertexIndex, primitiveCount, indices, minIndex, maxIndex);
 			break;
 
 		case D3DPT_TRIANGLELIST:
@@ -284,7 +340,7 @@ namespace D3dDdi
 			return;
 		}
 
-		if (!m_streamSource.vertices || !m_batched.indices.empty())
+		if (!m_streamSource.vertices || !m_batched.indices.empty() || indices)
 		{
 			rebaseIndices();
 		}
@@ -298,31 +354,22 @@ namespace D3dDdi
 		if (m_batched.indices.empty())
 		{
 			appendVertices(baseVertexIndex, 1);
+			m_batched.primitiveCount += 3;
+			appendIndicesAndVertices(indices, primitiveCount + 2, baseVertexIndex, minIndex, maxIndex);
+			return;
 		}
-		else
-		{
-			if (m_streamSource.vertices)
-			{
-				m_batched.indices.push_back(static_cast<UINT16>(getBatchedVertexCount()));
-			}
-			else if (indices)
-			{
-				m_batched.indices.push_back(static_cast<UINT16>(baseVertexIndex + indices[0]));
-			}
-			else
-			{
-				m_batched.indices.push_back(static_cast<UINT16>(baseVertexIndex));
-			}
-		}
-		m_batched.primitiveCount += 3;
 
+		// The joining index repeats the first index of the appended strip, which is only known after appending it
+		const UINT joinIndexPos = m_batched.indices.size();
+		m_batched.indices.push_back(0);
+		m_batched.primitiveCount += 3;
 		appendIndicesAndVertices(indices, primitiveCount + 2, baseVertexIndex, minIndex, maxIndex);
+		m_batched.indices.data()[joinIndexPos] = m_batched.indices.data()[joinIndexPos + 1];
 	}
 
 	void DrawPrimitive::appendVertices(UINT base, UINT count)
 	{
-		auto vertices = m_streamSource.vertices + base * m_streamSource.stride;
-		m_batched.vertices.insert(m_batched.vertices.end(), vertices, vertices + count * m_streamSource.stride);
+		m_batched.vertices.append(m_streamSource.vertices + base * m_streamSource.stride, count * m_streamSource.stride);
 	}
 
 	void DrawPrimitive::clearBatchedPrimitives()
@@ -332,58 +379,55 @@ namespace D3dDdi
 		m_batched.indices.clear();
 	}
 
-	void DrawPrimitive::convertIndexedTriangleFanToList(UINT startPrimitive, UINT primitiveCount)
+	void DrawPrimitive::convertIndexedLineStripToList(UINT startPrimitive, UINT primitiveCount)
 	{
-		const UINT totalPrimitiveCount = startPrimitive + primitiveCount;
-		m_batched.indices.resize(totalPrimitiveCount * 3);
-
-		INT startIndexPos = startPrimitive * 3;
-		INT oldIndexPos = startIndexPos + primitiveCount - 1;
-		INT newIndexPos = (totalPrimitiveCount - 1) * 3;
-		const UINT16 startIndex = m_batched.indices[startIndexPos];
-
-		while (newIndexPos > startIndexPos)
+		m_batched.indices.resize((startPrimitive + primitiveCount) * 2);
+		if (0 != primitiveCount)
 		{
-			m_batched.indices[newIndexPos + 2] = startIndex;
-			m_batched.indices[newIndexPos + 1] = m_batched.indices[oldIndexPos + 2];
-			m_batched.indices[newIndexPos] = m_batched.indices[oldIndexPos + 1];
-			newIndexPos -= 3;
-			oldIndexPos--;
+			IndexKernels::expandIndexedLineStrip(m_batched.indices.data() + startPrimitive * 2, primitiveCount);
 		}
+	}
 
-		m_batched.indices[newIndexPos] = m_batched.indices[oldIndexPos + 1];
-		m_batched.indices[newIndexPos + 1] = m_batched.indices[oldIndexPos + 2];
-		m_batched.indices[newIndexPos + 2] = startIndex;
+	void DrawPrimitive::convertIndexedTriangleFanToList(UINT startPrimitive, UINT primitiveCount)
+	{
+		m_batched.indices.resize((startPrimitive + primitiveCount) * 3);
+		if (0 != primitiveCount)
+		{
+			IndexKernels::expandIndexedTriangleFan(m_batched.indices.data() + startPrimitive * 3, primitiveCount);
+		}
 	}
 
 	void DrawPrimitive::convertIndexedTriangleStripToList(UINT startPrimitive, UINT primitiveCount)
 	{
-		const UINT totalPrimitiveCount = startPrimitive + primitiveCount;
-		m_batched.indices.resize(totalPrimitiveCount * 3);
-
-		INT oldIndexPos = startPrimitive * 3 + primitiveCount - 2;
-		INT newIndexPos = (totalPrimitiveCount - 2) * 3;
+		m_batched.indices.resize((startPrimitive + primitiveCount) * 3);
+		if (0 != primitiveCount)
+		{
+			IndexKernels::expandIndexedTriangleStrip(m_batched.indices.data() + startPrimitive * 3, primitiveCount);
+		}
+	}
 
-		if (0 != primitiveCount % 2)
+	void DrawPrimitive::convertToLineList()
+	{
+		if (D3DPT_LINESTRIP != m_batched.primitiveType)
 		{
-			m_batched.indices[newIndexPos + 5] = m_batched.indices[oldIndexPos + 3];
-			m_batched.indices[newIndexPos + 4] = m_batched.indices[oldIndexPos + 2];
-			m_batched.indices[newIndexPos + 3] = m_batched.indices[oldIndexPos + 1];
-			newIndexPos -= 3;
-			oldIndexPos--;
+			return;
 		}
 
-		while (newIndexPos >= oldIndexPos)
+		const bool alreadyIndexed = !m_batched.indices.empty();
+		if (alreadyIndexed)
 		{
-			m_batched.indices[newIndexPos + 5] = m_batched.indices[oldIndexPos + 2];
-			m_batched.indices[newIndexPos + 4] = m_batched.indices[oldIndexPos + 3];
-			m_batched.indices[newIndexPos + 3] = m_batched.indices[oldIndexPos + 1];
-			m_batched.indices[newIndexPos + 2] = m_batched.indices[oldIndexPos + 2];
-			m_batched.indices[newIndexPos + 1] = m_batched.indices[oldIndexPos + 1];
-			m_batched.indices[newIndexPos] = m_batched.indices[oldIndexPos];
-			newIndexPos -= 6;
-			oldIndexPos -= 2;
+			rebaseIndices();
+			convertIndexedLineStripToList(0, m_batched.primitiveCount);
+		}
+		else
+		{
+			IndexKernels::generateLineStripList(m_batched.indices.append(m_batched.primitiveCount * 2),
+				m_batched.baseVertexIndex, m_batched.primitiveCount);
+			m_batched.minIndex = m_batched.baseVertexIndex;
+			m_batched.maxIndex = m_batched.baseVertexIndex + m_batched.primitiveCount;
+			m_batched.baseVertexIndex = 0;
 		}
+		m_batched.primitiveType = D3DPT_LINELIST;
 	}
 
 	void DrawPrimitive::convertToTriangleList()
@@ -403,23 +447,8 @@ namespace D3dDdi
 			}
 			else
 			{
-				const UINT baseVertexIndex = static_cast<UINT>(m_batched.baseVertexIndex);
-				UINT i = baseVertexIndex;
-				for (; i < baseVertexIndex + m_batched.primitiveCount - 1; i += 2)
-				{
-					m_batched.indices.push_back(static_cast<UINT16>(i));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 1));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 2));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 1));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 3));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 2));
-				}
-				if (i < baseVertexIndex + m_batched.primitiveCount)
-				{
-					m_batched.indices.push_back(static_cast<UINT16>(i));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 1));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 2));
-				}
+				IndexKernels::generateTriangleStripList(m_batched.indices.append(m_batched.primitiveCount * 3),
+					m_batched.baseVertexIndex, m_batched.primitiveCount);
 			}
 			break;
 
@@ -431,14 +460,13 @@ namespace D3dDdi
 			}
 			else
 			{
-				for (UINT i = m_batched.baseVertexIndex; i < m_batched.baseVertexIndex + m_batched.primitiveCount; ++i)
-				{
-					m_batched.indices.push_back(static_cast<UINT16>(i + 1));
-					m_batched.indices.push_back(static_cast<UINT16>(i + 2));
-					m_batched.indices.push_back(static_cast<UINT16>(m_batched.baseVertexIndex));
-				}
+				IndexKernels::generateTriangleFanList(m_batched.indices.append(m_batched.primitiveCount * 3),
+					m_batched.baseVertexIndex, m_batched.primitiveCount);
 			}
 			break;
+
+		default:
+			return;
 		}
 
 		m_batched.primitiveType = D3DPT_TRIANGLELIST;
@@ -465,7 +493,7 @@ namespace D3dDdi
 			else
 			{
 				m_batched.baseVertexIndex = data.VStart;
-				m_batched.minIndex = D3DMAXNUMVERTICES;
+				m_batched.minIndex = UINT_MAX;
 				m_batched.maxIndex = 0;
 			}
 			m_batched.primitiveType = data.PrimitiveType;
@@ -496,12 +524,19 @@ namespace D3dDdi
 			m_batched.baseVertexIndex = data.BaseVertexOffset / static_cast<INT>(m_streamSource.stride);
 			if (m_streamSource.vertices)
 			{
-				appendIndexedVerticesWithoutRebase(indices, indexCount, m_batched.baseVertexIndex, *min, *max);
+				if (D3DPT_POINTLIST == data.PrimitiveType)
+				{
+					appendGatheredVertices(m_batched.baseVertexIndex, indices, indexCount);
+				}
+				else
+				{
+					appendIndexedVerticesWithoutRebase(indices, indexCount, m_batched.baseVertexIndex, *min, *max);
+				}
 				m_batched.baseVertexIndex = 0;
 			}
 			else
 			{
-				m_batched.indices.assign(indices, indices + indexCount);
+				IndexKernels::addIndexOffset(m_batched.indices.append(indexCount), indices, indexCount, 0);
 				m_batched.minIndex = *min;
 				m_batched.maxIndex = *max;
 			}
@@ -567,10 +602,17 @@ namespace D3dDdi
 			data.BaseVertexOffset = baseVertexIndex * static_cast<INT>(m_streamSource.stride);
 		}
 
+		const UINT indexSize = m_indexBuffer.getStride();
+		const void* indices = m_batched.indices.data();
+		if (2 == indexSize)
+		{
+			indices = IndexKernels::narrowIndices(m_batched.indices.data(), m_batched.indices.size());
+		}
+
 		INT startIndex = -1;
 		if ((!m_streamSource.vertices || m_vertexBuffer) && m_indexBuffer && !flagBuffer)
 		{
-			startIndex = loadIndices(m_batched.indices.data(), m_batched.indices.size());
+			startIndex = loadIndices(indices, m_batched.indices.size());
 		}
 
 		HRESULT result = S_OK;
@@ -587,13 +629,19 @@ namespace D3dDdi
 		}
 		else
 		{
-			result = m_origVtable.pfnDrawIndexedPrimitive2(m_device, &data, 2, m_batched.indices.data(), flagBuffer);
+			result = m_origVtable.pfnDrawIndexedPrimitive2(m_device, &data, indexSize, indices, flagBuffer);
 		}
 
 		clearBatchedPrimitives();
 		return result;
 	}
 
+	void DrawPrimitive::endFrame()
+	{
+		m_vertexBuffer.endFrame();
+		m_indexBuffer.endFrame();
+	}
+
 	HRESULT DrawPrimitive::flushPrimitives(const UINT* flagBuffer)
 	{
 		if (0 == m_batched.primitiveCount)
@@ -618,7 +666,7 @@ namespace D3dDdi
 			return startIndex;
 		}
 
-		LOG_ONCE("WARN: Dynamic index buffer lock failed");
+		LOG_ONCE("WARN: Dynamic index buffer load failed");
 		m_indexBuffer.resize(0);
 		return -1;
 	}
@@ -627,32 +675,12 @@ namespace D3dDdi
 	{
 		if (m_vertexBuffer)
 		{
-			UINT size = count * m_streamSource.stride;
-			if (size > m_vertexBuffer.getSize())
+			INT baseVertexIndex = m_vertexBuffer.load(vertices, count);
+			if (baseVertexIndex >= 0)
 			{
-				m_vertexBuffer.resize((size + VERTEX_BUFFER_SIZE - 1) / VERTEX_BUFFER_SIZE * VERTEX_BUFFER_SIZE);
-				if (m_vertexBuffer)
-				{
-					D3DDDIARG_SETSTREAMSOURCE ss = {};
-					ss.hVertexBuffer = m_vertexBuffer;
-					ss.Stride = m_streamSource.stride;
-					m_origVtable.pfnSetStreamSource(m_device, &ss);
-				}
-				else
-				{
-					LOG_ONCE("WARN: Dynamic vertex buffer resize failed");
-				}
-			}
-
-			if (m_vertexBuffer)
-			{
-				INT baseVertexIndex = m_vertexBuffer.load(vertices, count);
-				if (baseVertexIndex >= 0)
-				{
-					return baseVertexIndex;
-				}
-				LOG_ONCE("WARN: Dynamic vertex buffer lock failed");
+				return baseVertexIndex;
 			}
+			LOG_ONCE("WARN: Dynamic vertex buffer load failed");
 
 			m_vertexBuffer.resize(0);
 			m_indexBuffer.resize(0);
@@ -675,10 +703,7 @@ namespace D3dDdi
 			}
 			else
 			{
-				for (auto& index : m_batched.indices)
-				{
-					index = static_cast<UINT16>(m_batched.baseVertexIndex + index);
-				}
+				IndexKernels::addIndexOffset(m_batched.indices.data(), m_batched.indices.size(), m_batched.baseVertexIndex);
 				m_batched.minIndex += m_batched.baseVertexIndex;
 				m_batched.maxIndex += m_batched.baseVertexIndex;
 			}
@@ -690,9 +715,8 @@ namespace D3dDdi
 	{
 		if (m_batched.indices.empty())
 		{
-			m_batched.vertices.reserve(m_batched.vertices.size() + m_streamSource.stride);
-			m_batched.vertices.insert(m_batched.vertices.end(),
-				m_batched.vertices.end() - m_streamSource.stride, m_batched.vertices.end());
+			BYTE* newVertex = m_batched.vertices.append(m_streamSource.stride);
+			memcpy(newVertex, newVertex - m_streamSource.stride, m_streamSource.stride);
 		}
 		else
 		{
@@ -1,17 +1,19 @@
 #pragma once
 
 #include <map>
-#include <vector>
 
 #include <d3d.h>
 #include <d3dumddi.h>
 
+#include <D3dDdi/BatchArena.h>
 #include <D3dDdi/DynamicBuffer.h>
 
 namespace D3dDdi
 {
 	class Device;
 
+	UINT getVertexCount(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount);
+
 	class DrawPrimitive
 	{
 	public:
@@ -20,6 +22,7 @@ namespace D3dDdi
 		void addSysMemVertexBuffer(HANDLE resource, BYTE* vertices, UINT fvf);
 		void removeSysMemVertexBuffer(HANDLE resource);
 
+		void endFrame();
 		HRESULT flushPrimitives(const UINT* flagBuffer = nullptr);
 
 		HRESULT draw(D3DDDIARG_DRAWPRIMITIVE data, const UINT* flagBuffer);
@@ -35,8 +38,8 @@ namespace D3dDdi
 			INT baseVertexIndex;
 			UINT minIndex;
 			UINT maxIndex;
-			std::vector<BYTE> vertices;
-			std::vector<UINT16> indices;
+			BatchArena<BYTE> vertices;
+			BatchArena<UINT> indices;
 		};
 
 		struct StreamSource
@@ -56,6 +59,7 @@ namespace D3dDdi
 			INT baseVertexIndex, UINT minIndex, UINT maxIndex);
 		void appendIndexedVerticesWithoutRebase(const UINT16* indices, UINT count,
 			INT baseVertexIndex, UINT minIndex, UINT maxIndex);
+		void appendGatheredVertices(INT baseVertexIndex, const UINT16* indices, UINT count);
 		void appendIndexRange(UINT base, UINT count);
 		void appendIndexRangeWithoutRebase(UINT base, UINT count);
 		void appendIndices(const UINT16* indices, UINT count,
@@ -64,6 +68,9 @@ namespace D3dDdi
 			INT baseVertexIndex, UINT minIndex, UINT maxIndex);
 		void appendLineOrTriangleList(INT baseVertexIndex, UINT primitiveCount, UINT vpp,
 			const UINT16* indices, UINT minIndex, UINT maxIndex);
+		void appendLineStrip(INT baseVertexIndex, UINT primitiveCount,
+			const UINT16* indices, UINT minIndex, UINT maxIndex);
+		void appendPoints(INT baseVertexIndex, UINT primitiveCount, const UINT16* indices);
 		bool appendPrimitives(D3DPRIMITIVETYPE primitiveType, INT baseVertexIndex, UINT primitiveCount,
 			const UINT16* indices, UINT minIndex, UINT maxIndex);
 		void appendTriangleFan(INT baseVertexIndex, UINT primitiveCount,
@@ -72,8 +79,10 @@ namespace D3dDdi
 			const UINT16* indices, UINT minIndex, UINT maxIndex);
 		void appendVertices(UINT base, UINT count);
 		void clearBatchedPrimitives();
+		void convertIndexedLineStripToList(UINT startPrimitive, UINT primitiveCount);
 		void convertIndexedTriangleFanToList(UINT startPrimitive, UINT primitiveCount);
 		void convertIndexedTriangleStripToList(UINT startPrimitive, UINT primitiveCount);
+		void convertToLineList();
 		void convertToTriangleList();
 		void fixFirstVertexRhw();
 		HRESULT flush(const UINT* flagBuffer);
@@ -93,5 +102,6 @@ namespace D3dDdi
 		StreamSource m_streamSource;
 		std::map<HANDLE, SysMemVertexBuffer> m_sysMemVertexBuffers;
 		BatchedPrimitives m_batched;
+		UINT m_maxBatchedIndexCount;
 	};
 }
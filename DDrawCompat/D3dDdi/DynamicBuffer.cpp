@@ -3,6 +3,9 @@
 
 namespace
 {
+	const UINT MAX_SIZE = 16 * 1024 * 1024;
+	const UINT SHRINK_FRAME_COUNT = 256;
+
 	D3DDDI_RESOURCEFLAGS getIndexBufferFlag()
 	{
 		D3DDDI_RESOURCEFLAGS flags = {};
@@ -16,6 +19,20 @@ namespace
 		flags.VertexBuffer = 1;
 		return flags;
 	}
+
+	UINT getGrowSize(UINT size, UINT minSize)
+	{
+		if (0 == size)
+		{
+			return 0;
+		}
+
+		while (size < minSize && size < MAX_SIZE)
+		{
+			size *= 2;
+		}
+		return size;
+	}
 }
 
 namespace D3dDdi
@@ -28,66 +45,93 @@ namespace D3dDdi
 		, m_resourceFlag(resourceFlag)
 		, m_stride(0)
 		, m_pos(0)
+		, m_segments{}
+		, m_minSize(0)
+		, m_targetSize(0)
+		, m_latencySize(0)
+		, m_frameUsage(0)
+		, m_peakFrameUsage(0)
+		, m_frameCount(0)
 	{
+		auto& origVtable = device.getOrigVtable();
+		if (origVtable.pfnCreateQuery && origVtable.pfnIssueQuery && origVtable.pfnGetQueryData)
+		{
+			for (auto& segment : m_segments)
+			{
+				D3DDDIARG_CREATEQUERY cq = {};
+				cq.QueryType = D3DDDIQUERYTYPE_EVENT;
+				if (SUCCEEDED(origVtable.pfnCreateQuery(device, &cq)))
+				{
+					segment.fence = decltype(segment.fence)(cq.hQuery,
+						[&](HANDLE query) { device.getOrigVtable().pfnDestroyQuery(device, query); });
+				}
+			}
+		}
+
 		resize(size);
 	}
 
-	void* DynamicBuffer::lock(UINT size)
+	bool DynamicBuffer::acquireSegments(UINT size)
 	{
-		D3DDDIARG_LOCK lock = {};
-		lock.hResource = m_resource.get();
-		lock.Range.Offset = m_pos;
-		lock.Range.Size = size;
-		lock.Flags.RangeValid = 1;
+		const UINT firstSegment = getSegment(m_pos);
+		const UINT lastSegment = getSegment(m_pos + size - 1);
 
-		if (0 == m_pos)
-		{
-			lock.Flags.Discard = 1;
-		}
-		else
+		for (UINT i = 0; i < SEGMENT_COUNT; ++i)
 		{
-			lock.Flags.WriteOnly = 1;
-			lock.Flags.NoOverwrite = 1;
+			if (m_segments[i].isInUse && !m_segments[i].isFenceIssued && (i < firstSegment || i > lastSegment))
+			{
+				issueFence(m_segments[i]);
+			}
 		}
 
-		HRESULT result = m_device.getOrigVtable().pfnLock(m_device, &lock);
-		if (FAILED(result))
-		{
-			return nullptr;
-		}
-		return lock.pSurfData;
-	}
+		auto areSegmentsAvailable = [&]()
+			{
+				for (UINT i = firstSegment; i <= lastSegment; ++i)
+				{
+					if (!isSegmentAvailable(m_segments[i]))
+					{
+						return false;
+					}
+				}
+				return true;
+			};
 
-	INT DynamicBuffer::load(const void* src, UINT count)
-	{
-		UINT size = count * m_stride;
-		if (m_pos + size > m_size)
+		if (!areSegmentsAvailable())
 		{
-			m_pos = 0;
+			if (!m_segments[0].fence)
+			{
+				return false;
+			}
+
+			// The fences may still be sitting in the driver's command buffer, where they can never be signaled
+			m_device.getOrigVtable().pfnFlush(m_device);
+			if (!areSegmentsAvailable())
+			{
+				return false;
+			}
 		}
 
-		UINT pos = m_pos;
-		auto dst = lock(size);
-		if (!dst)
+		for (UINT i = firstSegment; i <= lastSegment; ++i)
 		{
-			return -1;
+			m_segments[i].isInUse = true;
 		}
-
-		memcpy(dst, src, size);
-		unlock();
-		m_pos += size;
-		return pos / m_stride;
+		return true;
 	}
 
-	void DynamicBuffer::resize(UINT size)
+	void DynamicBuffer::create(UINT size)
 	{
 		m_size = 0;
+		m_pos = 0;
+		resetSegments();
 		if (0 == size)
 		{
 			m_resource.reset();
 			return;
 		}
 
+		// Each segment must span at least one byte
+		size = max(size, SEGMENT_COUNT);
+
 		D3DDDI_SURFACEINFO surfaceInfo = {};
 		surfaceInfo.Width = size;
 		surfaceInfo.Height = 1;
@@ -110,6 +154,200 @@ namespace D3dDdi
 		}
 	}
 
+	void DynamicBuffer::endFrame()
+	{
+		if (0 == m_size)
+		{
+			return;
+		}
+
+		if (m_frameUsage > m_peakFrameUsage)
+		{
+			m_peakFrameUsage = m_frameUsage;
+		}
+
+		if (m_frameUsage > m_size / 2)
+		{
+			m_targetSize = getGrowSize(m_size, 2 * m_frameUsage);
+			m_peakFrameUsage = 0;
+			m_frameCount = 0;
+		}
+		else if (++m_frameCount >= SHRINK_FRAME_COUNT)
+		{
+			if (m_peakFrameUsage <= m_size / 8 && m_size / 2 >= max(m_minSize, m_latencySize))
+			{
+				m_targetSize = m_size / 2;
+			}
+			m_peakFrameUsage = 0;
+			m_frameCount = 0;
+		}
+
+		m_frameUsage = 0;
+	}
+
+	UINT DynamicBuffer::getSegment(UINT pos) const
+	{
+		return min(pos / (m_size / SEGMENT_COUNT), SEGMENT_COUNT - 1);
+	}
+
+	bool DynamicBuffer::isSegmentAvailable(Segment& segment)
+	{
+		if (!segment.isInUse || !segment.isFenceIssued)
+		{
+			return true;
+		}
+
+		if (!segment.fence)
+		{
+			return false;
+		}
+
+		BOOL isSignaled = FALSE;
+		D3DDDIARG_GETQUERYDATA gqd = {};
+		gqd.hQuery = segment.fence.get();
+		gqd.pData = &isSignaled;
+		if (S_OK != m_device.getOrigVtable().pfnGetQueryData(m_device, &gqd) || !isSignaled)
+		{
+			return false;
+		}
+
+		segment.isInUse = false;
+		segment.isFenceIssued = false;
+		return true;
+	}
+
+	void DynamicBuffer::issueFence(Segment& segment)
+	{
+		if (segment.fence)
+		{
+			D3DDDIARG_ISSUEQUERY iq = {};
+			iq.hQuery = segment.fence.get();
+			iq.Flags.End = 1;
+			m_device.getOrigVtable().pfnIssueQuery(m_device, &iq);
+		}
+		segment.isFenceIssued = true;
+	}
+
+	INT DynamicBuffer::load(const void* src, UINT count)
+	{
+		UINT size = count * m_stride;
+		m_frameUsage += size;
+
+		if (size > m_size)
+		{
+			m_targetSize = getGrowSize(m_size, size);
+			if (size > m_targetSize)
+			{
+				return -1;
+			}
+		}
+
+		if (m_pos + size > m_size)
+		{
+			// Every segment written since the last wrap, including the one just left, may still be read by the GPU
+			for (auto& segment : m_segments)
+			{
+				if (segment.isInUse && !segment.isFenceIssued)
+				{
+					issueFence(segment);
+				}
+			}
+			m_pos = 0;
+		}
+
+		bool discard = false;
+		if (m_targetSize == m_size && !acquireSegments(size))
+		{
+			if (m_segments[0].fence)
+			{
+				// Low per-frame usage doesn't mean the GPU caught up, so this size is kept until the next resize
+				m_targetSize = getGrowSize(m_size, 2 * m_size);
+				m_latencySize = m_targetSize;
+			}
+			discard = m_targetSize == m_size;
+		}
+
+		if (m_targetSize != m_size)
+		{
+			const UINT prevSize = m_size;
+			create(m_targetSize);
+			if (!m_resource && m_targetSize > prevSize)
+			{
+				create(prevSize);
+			}
+			m_targetSize = m_size;
+			if (!m_resource || FAILED(bind()) || size > m_size)
+			{
+				return -1;
+			}
+			acquireSegments(size);
+		}
+		else if (discard)
+		{
+			m_pos = 0;
+			resetSegments();
+			acquireSegments(size);
+		}
+
+		UINT pos = m_pos;
+		auto dst = lock(size, discard);
+		if (!dst)
+		{
+			return -1;
+		}
+
+		memcpy(dst, src, size);
+		unlock();
+		m_pos += size;
+		return pos / m_stride;
+	}
+
+	void* DynamicBuffer::lock(UINT size, bool discard)
+	{
+		D3DDDIARG_LOCK lock = {};
+		lock.hResource = m_resource.get();
+		lock.Range.Offset = m_pos;
+		lock.Range.Size = size;
+		lock.Flags.RangeValid = 1;
+
+		if (discard)
+		{
+			lock.Flags.Discard = 1;
+		}
+		else
+		{
+			lock.Flags.WriteOnly = 1;
+			lock.Flags.NoOverwrite = 1;
+		}
+
+		HRESULT result = m_device.getOrigVtable().pfnLock(m_device, &lock);
+		if (FAILED(result))
+		{
+			return nullptr;
+		}
+		return lock.pSurfData;
+	}
+
+	void DynamicBuffer::resetSegments()
+	{
+		for (auto& segment : m_segments)
+		{
+			segment.isInUse = false;
+			segment.isFenceIssued = false;
+		}
+	}
+
+	void DynamicBuffer::resize(UINT size)
+	{
+		m_minSize = size;
+		m_latencySize = 0;
+		create(size);
+		m_targetSize = m_size;
+		m_frameUsage = 0;
+		m_peakFrameUsage = 0;
+		m_frameCount = 0;
+	}
+
 	void DynamicBuffer::setStride(UINT stride)
 	{
 		m_stride = stride;
@@ -123,14 +361,37 @@ namespace D3dDdi
 		m_device.getOrigVtable().pfnUnlock(m_device, &unlock);
 	}
 
-	DynamicIndexBuffer::DynamicIndexBuffer(Device& device, UINT size)
-		: DynamicBuffer(device, size, D3DDDIFMT_INDEX16, getIndexBufferFlag())
+	DynamicIndexBuffer::DynamicIndexBuffer(Device& device, UINT size, D3DDDIFORMAT format)
+		: DynamicBuffer(device, size, format, getIndexBufferFlag())
 	{
-		m_stride = 2;
+		m_stride = D3DDDIFMT_INDEX32 == format ? 4 : 2;
+	}
+
+	HRESULT DynamicIndexBuffer::bind()
+	{
+		D3DDDIARG_SETINDICES si = {};
+		si.hIndexBuffer = m_resource.get();
+		si.Stride = m_stride;
+		return m_device.getOrigVtable().pfnSetIndices(m_device, &si);
+	}
+
+	void DynamicIndexBuffer::resize(UINT size, D3DDDIFORMAT format)
+	{
+		m_format = format;
+		m_stride = D3DDDIFMT_INDEX32 == format ? 4 : 2;
+		DynamicBuffer::resize(size);
 	}
 
 	DynamicVertexBuffer::DynamicVertexBuffer(Device& device, UINT size)
 		: DynamicBuffer(device, size, D3DDDIFMT_VERTEXDATA, getVertexBufferFlag())
 	{
 	}
+
+	HRESULT DynamicVertexBuffer::bind()
+	{
+		D3DDDIARG_SETSTREAMSOURCE ss = {};
+		ss.hVertexBuffer = m_resource.get();
+		ss.Stride = m_stride;
+		return m_device.getOrigVtable().pfnSetStreamSource(m_device, &ss);
+	}
 }
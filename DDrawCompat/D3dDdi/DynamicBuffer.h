@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <functional>
 #include <memory>
 
@@ -10,10 +11,17 @@ namespace D3dDdi
 {
 	class Device;
 
+	// Ring of SEGMENT_COUNT segments. Each segment that is left behind gets an event query issued, and the ring
+	// only wraps into a segment once its query is signaled, so the driver never has to rename the buffer on a
+	// discard. If the GPU is still using the next segment after flushing the pending commands, the buffer is
+	// grown instead. The size also adapts to the peak per-frame usage, from the initial size up to MAX_SIZE, but
+	// never shrinks below the size that the GPU latency required.
 	class DynamicBuffer
 	{
 	public:
+		void endFrame();
 		UINT getSize() const { return m_size; }
+		UINT getStride() const { return m_stride; }
 		INT load(const void* src, UINT count);
 		void resize(UINT size);
 
@@ -22,9 +30,8 @@ namespace D3dDdi
 	protected:
 		DynamicBuffer(Device& device, UINT size, D3DDDIFORMAT format, D3DDDI_RESOURCEFLAGS resourceFlag);
 
-		void* lock(UINT size);
+		virtual HRESULT bind() = 0;
 		void setStride(UINT stride);
-		void unlock();
 
 		Device& m_device;
 		std::unique_ptr<void, std::function<void(HANDLE)>> m_resource;
@@ -33,12 +40,45 @@ namespace D3dDdi
 		D3DDDI_RESOURCEFLAGS m_resourceFlag;
 		UINT m_stride;
 		UINT m_pos;
+
+	private:
+		static const UINT SEGMENT_COUNT = 4;
+
+		struct Segment
+		{
+			std::unique_ptr<void, std::function<void(HANDLE)>> fence;
+			bool isInUse;
+			bool isFenceIssued;
+		};
+
+		bool acquireSegments(UINT size);
+		void create(UINT size);
+		UINT getSegment(UINT pos) const;
+		bool isSegmentAvailable(Segment& segment);
+		void issueFence(Segment& segment);
+		void* lock(UINT size, bool discard);
+		void resetSegments();
+		void unlock();
+
+		std::array<Segment, SEGMENT_COUNT> m_segments;
+		UINT m_minSize;
+		UINT m_targetSize;
+		UINT m_latencySize;
+		UINT m_frameUsage;
+		UINT m_peakFrameUsage;
+		UINT m_frameCount;
 	};
 
 	class DynamicIndexBuffer : public DynamicBuffer
 	{
 	public:
-		DynamicIndexBuffer(Device& device, UINT size);
+		DynamicIndexBuffer(Device& device, UINT size, D3DDDIFORMAT format);
+
+		using DynamicBuffer::resize;
+		void resize(UINT size, D3DDDIFORMAT format);
+
+	private:
+		virtual HRESULT bind() override;
 	};
 
 	class DynamicVertexBuffer : public DynamicBuffer
@@ -47,5 +87,8 @@ namespace D3dDdi
 		DynamicVertexBuffer(Device& device, UINT size);
 
 		using DynamicBuffer::setStride;
+
+	private:
+		virtual HRESULT bind() override;
 	};
 }
@@ -97,6 +97,11 @@ namespace D3dDdi
 		}
 	}
 
+	void setDdiVersion(UINT version)
+	{
+		g_ddiVersion = version;
+	}
+
 	void uninstallHooks()
 	{
 		unhookOpenAdapter();
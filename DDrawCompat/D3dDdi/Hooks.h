@@ -7,5 +7,6 @@ namespace D3dDdi
 	UINT getDdiVersion();
 	void installHooks(HMODULE origDDrawModule);
 	void onUmdFileNameQueried(const std::wstring& umdFileName);
+	void setDdiVersion(UINT version);
 	void uninstallHooks();
 }
@@ -0,0 +1,254 @@
+#include <cstring>
+
+#include <emmintrin.h>
+
+#include <D3dDdi/IndexKernels.h>
+
+namespace
+{
+	// The indexed expansions run in place. The source indices are first moved to the tail of the output range,
+	// then triangles are written front to back. Each write stays below the source indices that are still to be read.
+	UINT* moveToTail(UINT* indices, UINT srcCount, UINT dstCount)
+	{
+		UINT* src = indices + dstCount - srcCount;
+		memmove(src, indices, srcCount * sizeof(UINT));
+		return src;
+	}
+}
+
+namespace D3dDdi
+{
+	namespace IndexKernels
+	{
+		void addIndexOffset(UINT* dst, const UINT16* src, UINT count, INT offset)
+		{
+			const __m128i offsetVec = _mm_set1_epi32(offset);
+			const __m128i zero = _mm_setzero_si128();
+			UINT i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m128i vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+					_mm_add_epi32(_mm_unpacklo_epi16(vec, zero), offsetVec));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4),
+					_mm_add_epi32(_mm_unpackhi_epi16(vec, zero), offsetVec));
+			}
+			for (; i < count; ++i)
+			{
+				dst[i] = src[i] + offset;
+			}
+		}
+
+		void addIndexOffset(UINT* indices, UINT count, INT offset)
+		{
+			const __m128i offsetVec = _mm_set1_epi32(offset);
+			UINT i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i* vec = reinterpret_cast<__m128i*>(indices + i);
+				_mm_storeu_si128(vec, _mm_add_epi32(_mm_loadu_si128(vec), offsetVec));
+			}
+			for (; i < count; ++i)
+			{
+				indices[i] += offset;
+			}
+		}
+
+		void generateIndexRange(UINT* dst, UINT base, UINT count)
+		{
+			__m128i vec = _mm_add_epi32(_mm_set1_epi32(base), _mm_setr_epi32(0, 1, 2, 3));
+			const __m128i step = _mm_set1_epi32(4);
+			UINT i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), vec);
+				vec = _mm_add_epi32(vec, step);
+			}
+			for (; i < count; ++i)
+			{
+				dst[i] = base + i;
+			}
+		}
+
+		void generateLineStripList(UINT* dst, UINT base, UINT primitiveCount)
+		{
+			__m128i vec = _mm_add_epi32(_mm_set1_epi32(base), _mm_setr_epi32(0, 1, 1, 2));
+			const __m128i step = _mm_set1_epi32(2);
+			UINT i = 0;
+			for (; i + 2 <= primitiveCount; i += 2)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), vec);
+				vec = _mm_add_epi32(vec, step);
+			}
+			if (i < primitiveCount)
+			{
+				dst[2 * i] = base + i;
+				dst[2 * i + 1] = base + i + 1;
+			}
+		}
+
+		void generateTriangleFanList(UINT* dst, UINT base, UINT primitiveCount)
+		{
+			const __m128i offsets[3] = {
+				_mm_setr_epi32(1, 2, 0, 2),
+				_mm_setr_epi32(3, 0, 3, 4),
+				_mm_setr_epi32(0, 4, 5, 0)
+			};
+			const __m128i centerMasks[3] = {
+				_mm_setr_epi32(0, 0, -1, 0),
+				_mm_setr_epi32(0, -1, 0, 0),
+				_mm_setr_epi32(-1, 0, 0, -1)
+			};
+			const __m128i center = _mm_set1_epi32(base);
+			const __m128i step = _mm_set1_epi32(4);
+			__m128i first = center;
+
+			UINT i = 0;
+			for (; i + 4 <= primitiveCount; i += 4)
+			{
+				for (UINT j = 0; j < 3; ++j)
+				{
+					const __m128i vec = _mm_add_epi32(first, offsets[j]);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * j),
+						_mm_or_si128(_mm_andnot_si128(centerMasks[j], vec), _mm_and_si128(centerMasks[j], center)));
+				}
+				first = _mm_add_epi32(first, step);
+				dst += 12;
+			}
+			for (; i < primitiveCount; ++i)
+			{
+				dst[0] = base + i + 1;
+				dst[1] = base + i + 2;
+				dst[2] = base;
+				dst += 3;
+			}
+		}
+
+		void generateTriangleStripList(UINT* dst, UINT base, UINT primitiveCount)
+		{
+			const __m128i offsets[3] = {
+				_mm_setr_epi32(0, 1, 2, 1),
+				_mm_setr_epi32(3, 2, 2, 3),
+				_mm_setr_epi32(4, 3, 5, 4)
+			};
+			const __m128i step = _mm_set1_epi32(4);
+			__m128i first = _mm_set1_epi32(base);
+
+			UINT i = 0;
+			for (; i + 4 <= primitiveCount; i += 4)
+			{
+				for (UINT j = 0; j < 3; ++j)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * j), _mm_add_epi32(first, offsets[j]));
+				}
+				first = _mm_add_epi32(first, step);
+				dst += 12;
+			}
+			for (; i < primitiveCount; ++i)
+			{
+				dst[0] = base + i;
+				dst[1] = base + i + 1 + i % 2;
+				dst[2] = base + i + 2 - i % 2;
+				dst += 3;
+			}
+		}
+
+		void expandIndexedLineStrip(UINT* indices, UINT primitiveCount)
+		{
+			const UINT* src = moveToTail(indices, primitiveCount + 1, primitiveCount * 2);
+			UINT* dst = indices;
+
+			UINT i = 0;
+			for (; i + 3 <= primitiveCount; i += 2)
+			{
+				const __m128i vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi32(vec, _MM_SHUFFLE(2, 1, 1, 0)));
+				dst += 4;
+			}
+			for (; i < primitiveCount; ++i)
+			{
+				const UINT i0 = src[i];
+				const UINT i1 = src[i + 1];
+				dst[0] = i0;
+				dst[1] = i1;
+				dst += 2;
+			}
+		}
+
+		void expandIndexedTriangleFan(UINT* indices, UINT primitiveCount)
+		{
+			const UINT* src = moveToTail(indices, primitiveCount + 2, primitiveCount * 3);
+			const UINT center = src[0];
+			const __m128i centerVec = _mm_set1_epi32(center);
+			const __m128i lowMask = _mm_setr_epi32(0, 0, -1, 0);
+			const __m128i highMask = _mm_setr_epi32(0, -1, 0, 0);
+			UINT* dst = indices;
+
+			UINT i = 0;
+			for (; i + 2 < primitiveCount; i += 2)
+			{
+				const __m128i vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 1));
+				const __m128i low = _mm_shuffle_epi32(vec, _MM_SHUFFLE(1, 0, 1, 0));
+				const __m128i high = _mm_shuffle_epi32(vec, _MM_SHUFFLE(2, 2, 2, 2));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+					_mm_or_si128(_mm_andnot_si128(lowMask, low), _mm_and_si128(lowMask, centerVec)));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4),
+					_mm_or_si128(_mm_andnot_si128(highMask, high), _mm_and_si128(highMask, centerVec)));
+				dst += 6;
+			}
+			for (; i < primitiveCount; ++i)
+			{
+				const UINT i1 = src[i + 1];
+				const UINT i2 = src[i + 2];
+				dst[0] = i1;
+				dst[1] = i2;
+				dst[2] = center;
+				dst += 3;
+			}
+		}
+
+		void expandIndexedTriangleStrip(UINT* indices, UINT primitiveCount)
+		{
+			const UINT* src = moveToTail(indices, primitiveCount + 2, primitiveCount * 3);
+			UINT* dst = indices;
+
+			UINT i = 0;
+			for (; i + 2 < primitiveCount; i += 2)
+			{
+				const __m128i vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi32(vec, _MM_SHUFFLE(1, 2, 1, 0)));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4), _mm_shuffle_epi32(vec, _MM_SHUFFLE(3, 2, 2, 3)));
+				dst += 6;
+			}
+			for (; i < primitiveCount; ++i)
+			{
+				const UINT i0 = src[i];
+				const UINT i1 = src[i + 1];
+				const UINT i2 = src[i + 2];
+				dst[0] = i0;
+				dst[1] = 0 == i % 2 ? i1 : i2;
+				dst[2] = 0 == i % 2 ? i2 : i1;
+				dst += 3;
+			}
+		}
+
+		UINT16* narrowIndices(UINT* indices, UINT count)
+		{
+			UINT16* dst = reinterpret_cast<UINT16*>(indices);
+			UINT i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+				__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i + 4));
+				low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+				high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(low, high));
+			}
+			for (; i < count; ++i)
+			{
+				dst[i] = static_cast<UINT16>(indices[i]);
+			}
+			return dst;
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Windows.h>
+
+namespace D3dDdi
+{
+	// SSE2 index kernels for primitive batching. Batched indices are kept as 32-bit values and narrowed to
+	// 16 bits on flush when the dynamic index buffer is INDEX16.
+	namespace IndexKernels
+	{
+		void addIndexOffset(UINT* dst, const UINT16* src, UINT count, INT offset);
+		void addIndexOffset(UINT* indices, UINT count, INT offset);
+
+		// Expand primitiveCount strip or fan primitives in place into a list. indices must have room for the
+		// expanded list, with the strip or fan indices at its start.
+		void expandIndexedLineStrip(UINT* indices, UINT primitiveCount);
+		void expandIndexedTriangleFan(UINT* indices, UINT primitiveCount);
+		void expandIndexedTriangleStrip(UINT* indices, UINT primitiveCount);
+
+		// Generate the list indices of primitiveCount non-indexed strip or fan primitives starting at vertex base
+		void generateIndexRange(UINT* dst, UINT base, UINT count);
+		void generateLineStripList(UINT* dst, UINT base, UINT primitiveCount);
+		void generateTriangleFanList(UINT* dst, UINT base, UINT primitiveCount);
+		void generateTriangleStripList(UINT* dst, UINT base, UINT primitiveCount);
+
+		// Narrows in place; the 16-bit output never overtakes the 32-bit input.
+		UINT16* narrowIndices(UINT* indices, UINT count);
+	}
+}
@@ -1,15 +1,18 @@
+#include <atomic>
 #include <string>
 
 #include <Common/Log.h>
 #include <Common/Hook.h>
 #include <Common/ScopedSrwLock.h>
 #include <Common/Time.h>
+#include <Config/Config.h>
 #include <D3dDdi/Device.h>
 #include <D3dDdi/Hooks.h>
 #include <D3dDdi/KernelModeThunks.h>
 #include <D3dDdi/Log/KernelModeThunksLog.h>
 #include <D3dDdi/Resource.h>
 #include <D3dDdi/ScopedCriticalSection.h>
+#include <D3dDdi/VsyncModel.h>
 #include <DDraw/RealPrimarySurface.h>
 #include <DDraw/ScopedThreadLock.h>
 #include <DDraw/Surfaces/PrimarySurface.h>
@@ -32,11 +35,17 @@ namespace
 	Compat::SrwLock g_lastOpenAdapterInfoSrwLock;
 	std::string g_lastDDrawCreateDcDevice;
 
+	const DWORD VSYNC_RESYNC_INTERVAL_MS = 500;
+
 	HANDLE g_vsyncThread = nullptr;
+	HANDLE g_stopVsyncThreadEvent = nullptr;
 	bool g_stopVsyncThread = false;
-	UINT g_vsyncCounter = 0;
-	CONDITION_VARIABLE g_vsyncCounterCv = CONDITION_VARIABLE_INIT;
-	Compat::SrwLock g_vsyncCounterSrwLock;
+
+	// Published VsyncModel::Phase, written only by the vsync thread and read seqlock style
+	std::atomic<UINT> g_vsyncPhaseSeq = 0;
+	std::atomic<long long> g_vsyncPhaseAnchor = 0;
+	std::atomic<long long> g_vsyncPhasePeriod = 0;
+	std::atomic<UINT> g_vsyncPhaseAnchorCounter = 0;
 
 	void waitForVerticalBlank();
 
@@ -147,6 +156,21 @@ namespace
 		return adapterInfo;
 	}
 
+	D3dDdi::VsyncModel::Phase getVsyncPhase()
+	{
+		D3dDdi::VsyncModel::Phase phase = {};
+		UINT seq = 0;
+		do
+		{
+			seq = g_vsyncPhaseSeq.load(std::memory_order_acquire);
+			phase.anchor = g_vsyncPhaseAnchor.load(std::memory_order_relaxed);
+			phase.period = g_vsyncPhasePeriod.load(std::memory_order_relaxed);
+			phase.anchorCounter = g_vsyncPhaseAnchorCounter.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while ((seq & 1) || seq != g_vsyncPhaseSeq.load(std::memory_order_relaxed));
+		return phase;
+	}
+
 	NTSTATUS APIENTRY openAdapterFromHdc(D3DKMT_OPENADAPTERFROMHDC* pData)
 	{
 		LOG_FUNC("D3DKMTOpenAdapterFromHdc", pData);
@@ -159,6 +183,17 @@ namespace
 		return LOG_RESULT(result);
 	}
 
+	void publishVsyncPhase(const D3dDdi::VsyncModel::Phase& phase)
+	{
+		const UINT seq = g_vsyncPhaseSeq.load(std::memory_order_relaxed);
+		g_vsyncPhaseSeq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		g_vsyncPhaseAnchor.store(phase.anchor, std::memory_order_relaxed);
+		g_vsyncPhasePeriod.store(phase.period, std::memory_order_relaxed);
+		g_vsyncPhaseAnchorCounter.store(phase.anchorCounter, std::memory_order_relaxed);
+		g_vsyncPhaseSeq.store(seq + 2, std::memory_order_release);
+	}
+
 	NTSTATUS APIENTRY queryAdapterInfo(const D3DKMT_QUERYADAPTERINFO* pData)
 	{
 		LOG_FUNC("D3DKMTQueryAdapterInfo", pData);
@@ -242,16 +277,21 @@ namespace
 
 	DWORD WINAPI vsyncThreadProc(LPVOID /*lpParameter*/)
 	{
+		// Real vblank waits are only needed to train the model. Once it is locked to the refresh phase,
+		// it is only resynchronized periodically. A resync unlocks it until the following vblank confirms the period.
+		D3dDdi::VsyncModel model;
+		bool isNextVblank = false;
 		while (!g_stopVsyncThread)
 		{
 			waitForVerticalBlank();
+			model.addVblank(Time::queryPerformanceCounter(), isNextVblank);
+			publishVsyncPhase(model.getPhase());
 
+			isNextVblank = !model.isLocked();
+			if (model.isLocked())
 			{
-				Compat::ScopedSrwLockExclusive lock(g_vsyncCounterSrwLock);
-				++g_vsyncCounter;
+				WaitForSingleObject(g_stopVsyncThreadEvent, VSYNC_RESYNC_INTERVAL_MS);
 			}
-
-			WakeAllConditionVariable(&g_vsyncCounterCv);
 		}
 		return 0;
 	}
@@ -310,8 +350,17 @@ namespace D3dDdi
 
 		UINT getVsyncCounter()
 		{
-			Compat::ScopedSrwLockShared lock(g_vsyncCounterSrwLock);
-			return g_vsyncCounter;
+			return VsyncModel::getCounter(getVsyncPhase(), Time::queryPerformanceCounter());
+		}
+
+		long long getQpcVsync(UINT vsyncCounter)
+		{
+			return VsyncModel::getVblankTime(getVsyncPhase(), vsyncCounter);
+		}
+
+		long long getQpcVsyncPeriod()
+		{
+			return getVsyncPhase().period;
 		}
 
 		void installHooks(HMODULE origDDrawModule)
@@ -323,6 +372,7 @@ namespace D3dDdi
 			Compat::hookIatFunction(origDDrawModule, "gdi32.dll", "D3DKMTQueryAdapterInfo", queryAdapterInfo);
 			Compat::hookIatFunction(origDDrawModule, "gdi32.dll", "D3DKMTSetGammaRamp", setGammaRamp);
 
+			g_stopVsyncThreadEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 			g_vsyncThread = CreateThread(nullptr, 0, &vsyncThreadProc, nullptr, 0, nullptr);
 			SetThreadPriority(g_vsyncThread, THREAD_PRIORITY_TIME_CRITICAL);
 		}
@@ -340,6 +390,7 @@ namespace D3dDdi
 		void stopVsyncThread()
 		{
 			g_stopVsyncThread = true;
+			SetEvent(g_stopVsyncThreadEvent);
 			if (WAIT_OBJECT_0 != WaitForSingleObject(g_vsyncThread, 100))
 			{
 				TerminateThread(g_vsyncThread, 0);
@@ -356,12 +407,20 @@ namespace D3dDdi
 		bool waitForVsyncCounter(UINT counter)
 		{
 			bool waited = false;
-			Compat::ScopedSrwLockShared lock(g_vsyncCounterSrwLock);
-			while (static_cast<INT>(g_vsyncCounter - counter) < 0)
+			auto phase = getVsyncPhase();
+			while (static_cast<INT>(VsyncModel::getCounter(phase, Time::queryPerformanceCounter()) - counter) < 0)
 			{
-				SleepConditionVariableSRW(&g_vsyncCounterCv, &g_vsyncCounterSrwLock, INFINITE,
-					CONDITION_VARIABLE_LOCKMODE_SHARED);
+				if (0 == phase.period)
+				{
+					Sleep(1);
+				}
+				else
+				{
+					// Spin only briefly, a millisecond of busy waiting per vblank would cost a lot of CPU time
+					Time::waitForQpc(VsyncModel::getVblankTime(phase, counter), Config::vblankSpinWaitTimeUs);
+				}
 				waited = true;
+				phase = getVsyncPhase();
 			}
 			return waited;
 		}
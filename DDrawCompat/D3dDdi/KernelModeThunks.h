@@ -7,6 +7,8 @@ namespace D3dDdi
 	namespace KernelModeThunks
 	{
 		RECT getMonitorRect();
+		long long getQpcVsync(UINT vsyncCounter);
+		long long getQpcVsyncPeriod();
 		UINT getVsyncCounter();
 		void installHooks(HMODULE origDDrawModule);
 		void setDcFormatOverride(UINT format);
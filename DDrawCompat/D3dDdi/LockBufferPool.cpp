@@ -0,0 +1,244 @@
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+
+#include <Common/ScopedCriticalSection.h>
+#include <Common/Time.h>
+#include <Config/Config.h>
+#include <D3dDdi/LockBufferPool.h>
+
+namespace
+{
+	struct BlockHeader
+	{
+		void* block;
+		std::size_t blockSize;
+	};
+
+	struct FreeBlock
+	{
+		void* block;
+		long long qpcReleased;
+	};
+
+	// Lock buffers can be released by resources destroyed during static destruction in other translation units,
+	// so the pool state is never destroyed
+	struct PoolState
+	{
+		Compat::CriticalSection cs;
+		std::map<std::size_t, std::vector<FreeBlock>> freeBlocks;
+		D3dDdi::LockBufferPool::Stats stats = {};
+		long long qpcLastTrim = 0;
+	};
+
+	const std::size_t MIN_BLOCK_SIZE = 4096;
+	const std::size_t MIN_VIRTUAL_ALLOC_SIZE = 1024 * 1024;
+	const long long TRIM_INTERVAL_MS = 1000;
+
+	void* allocateBlock(std::size_t blockSize, bool zeroFill)
+	{
+		// Fresh pages from VirtualAlloc are zeroed by the system on first access
+		if (blockSize >= MIN_VIRTUAL_ALLOC_SIZE)
+		{
+			return VirtualAlloc(nullptr, blockSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		}
+		return HeapAlloc(GetProcessHeap(), zeroFill ? HEAP_ZERO_MEMORY : 0, blockSize);
+	}
+
+	void freeBlock(void* block, std::size_t blockSize)
+	{
+		if (blockSize >= MIN_VIRTUAL_ALLOC_SIZE)
+		{
+			VirtualFree(block, 0, MEM_RELEASE);
+		}
+		else
+		{
+			HeapFree(GetProcessHeap(), 0, block);
+		}
+	}
+
+	PoolState& getState()
+	{
+		static PoolState* state = new PoolState();
+		return *state;
+	}
+
+	void trimIdleBlocks(PoolState& state, long long qpcNow, std::vector<std::pair<void*, std::size_t>>& trimmedBlocks)
+	{
+		if (qpcNow - state.qpcLastTrim < Time::msToQpc(TRIM_INTERVAL_MS))
+		{
+			return;
+		}
+		state.qpcLastTrim = qpcNow;
+
+		const long long qpcMinReleased = qpcNow - Time::msToQpc(Config::lockBufferPoolIdleTimeout);
+		for (auto& freeBlocks : state.freeBlocks)
+		{
+			// Blocks are reused from the back, so the idle ones are at the front
+			auto it = freeBlocks.second.begin();
+			while (it != freeBlocks.second.end() && it->qpcReleased < qpcMinReleased)
+			{
+				trimmedBlocks.push_back({ it->block, freeBlocks.first });
+				state.stats.bytesPooled -= freeBlocks.first;
+				++it;
+			}
+			freeBlocks.second.erase(freeBlocks.second.begin(), it);
+		}
+	}
+
+	void freeBlocks(const std::vector<std::pair<void*, std::size_t>>& blocks)
+	{
+		for (const auto& block : blocks)
+		{
+			freeBlock(block.first, block.second);
+		}
+	}
+
+	std::size_t getBlockSize(std::size_t size)
+	{
+		if (size <= MIN_BLOCK_SIZE)
+		{
+			return MIN_BLOCK_SIZE;
+		}
+
+		// Four size classes per power of two limit the unused tail of a block to 25%
+		const std::size_t n = size - 1;
+		unsigned msb = 0;
+		while (n >> (msb + 1))
+		{
+			++msb;
+		}
+
+		const unsigned shift = msb - 2;
+		return ((n >> shift) + 1) << shift;
+	}
+
+	BlockHeader& getHeader(void* buffer)
+	{
+		return *(static_cast<BlockHeader*>(buffer) - 1);
+	}
+
+	void* initBlock(void* block, std::size_t blockSize, std::size_t alignment)
+	{
+		std::uintptr_t buffer = reinterpret_cast<std::uintptr_t>(block) + sizeof(BlockHeader);
+		buffer = (buffer + alignment - 1) & ~(alignment - 1);
+		auto& header = getHeader(reinterpret_cast<void*>(buffer));
+		header.block = block;
+		header.blockSize = blockSize;
+		return reinterpret_cast<void*>(buffer);
+	}
+}
+
+namespace D3dDdi
+{
+	namespace LockBufferPool
+	{
+		void* allocate(std::size_t size, std::size_t alignment, bool zeroFill)
+		{
+			if (alignment < alignof(BlockHeader))
+			{
+				alignment = alignof(BlockHeader);
+			}
+
+			const std::size_t blockSize = getBlockSize(size + sizeof(BlockHeader) + alignment - 1);
+			void* block = nullptr;
+			std::vector<std::pair<void*, std::size_t>> trimmedBlocks;
+			auto& state = getState();
+
+			{
+				Compat::ScopedCriticalSection lock(state.cs);
+				auto it = state.freeBlocks.find(blockSize);
+				if (it != state.freeBlocks.end() && !it->second.empty())
+				{
+					block = it->second.back().block;
+					it->second.pop_back();
+					state.stats.bytesPooled -= blockSize;
+					++state.stats.hits;
+				}
+				else
+				{
+					++state.stats.misses;
+				}
+				state.stats.bytesInUse += blockSize;
+				trimIdleBlocks(state, Time::queryPerformanceCounter(), trimmedBlocks);
+			}
+			freeBlocks(trimmedBlocks);
+
+			if (block)
+			{
+				if (zeroFill && blockSize >= MIN_VIRTUAL_ALLOC_SIZE)
+				{
+					// Recommitted pages are zeroed lazily by the system on first access, like fresh ones
+					VirtualFree(block, blockSize, MEM_DECOMMIT);
+					if (VirtualAlloc(block, blockSize, MEM_COMMIT, PAGE_READWRITE))
+					{
+						return initBlock(block, blockSize, alignment);
+					}
+					freeBlock(block, blockSize);
+					block = nullptr;
+				}
+				else
+				{
+					void* buffer = initBlock(block, blockSize, alignment);
+					if (zeroFill)
+					{
+						memset(buffer, 0, size);
+					}
+					return buffer;
+				}
+			}
+
+			block = allocateBlock(blockSize, zeroFill);
+			if (!block)
+			{
+				Compat::ScopedCriticalSection lock(state.cs);
+				state.stats.bytesInUse -= blockSize;
+				return nullptr;
+			}
+			return initBlock(block, blockSize, alignment);
+		}
+
+		Stats getStats()
+		{
+			auto& state = getState();
+			Compat::ScopedCriticalSection lock(state.cs);
+			return state.stats;
+		}
+
+		void release(void* buffer)
+		{
+			if (!buffer)
+			{
+				return;
+			}
+
+			const auto header = getHeader(buffer);
+			std::vector<std::pair<void*, std::size_t>> trimmedBlocks;
+			auto& state = getState();
+			bool isPooled = false;
+
+			{
+				Compat::ScopedCriticalSection lock(state.cs);
+				const long long qpcNow = Time::queryPerformanceCounter();
+				state.stats.bytesInUse -= header.blockSize;
+				if (state.stats.bytesPooled + header.blockSize <= Config::maxPooledLockBufferSize)
+				{
+					state.freeBlocks[header.blockSize].push_back({ header.block, qpcNow });
+					state.stats.bytesPooled += header.blockSize;
+					isPooled = true;
+				}
+				trimIdleBlocks(state, qpcNow, trimmedBlocks);
+			}
+
+			freeBlocks(trimmedBlocks);
+			if (!isPooled)
+			{
+				freeBlock(header.block, header.blockSize);
+			}
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+namespace D3dDdi
+{
+	namespace LockBufferPool
+	{
+		struct Stats
+		{
+			unsigned long long hits;
+			unsigned long long misses;
+			std::size_t bytesInUse;
+			std::size_t bytesPooled;
+		};
+
+		void* allocate(std::size_t size, std::size_t alignment, bool zeroFill = true);
+		Stats getStats();
+		void release(void* buffer);
+	}
+}
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <type_traits>
 
 #include <Common/HResultException.h>
@@ -7,6 +8,7 @@
 #include <D3dDdi/Adapter.h>
 #include <D3dDdi/Device.h>
 #include <D3dDdi/KernelModeThunks.h>
+#include <D3dDdi/LockBufferPool.h>
 #include <D3dDdi/Log/DeviceFuncsLog.h>
 #include <D3dDdi/Resource.h>
 #include <DDraw/Blitter.h>
@@ -18,6 +20,11 @@ namespace
 	void splitToTiles(D3DDDIARG_CREATERESOURCE& data, const UINT tileWidth, const UINT tileHeight);
 
 	const UINT g_resourceTypeFlags = getResourceTypeFlags().Value;
+	const UINT MIN_COST_SAMPLE_SIZE = 64 * 1024;
+
+	double g_cpuBltNsPerByte = 0.25;
+	double g_syncNsPerByte = 1;
+	D3dDdi::Resource::Stats g_stats = {};
 
 	LONG divCeil(LONG n, LONG d)
 	{
@@ -48,6 +55,11 @@ namespace
 		}
 	}
 
+	double getArea(const RECT& rect)
+	{
+		return IsRectEmpty(&rect) ? 0 : static_cast<double>(rect.right - rect.left) * (rect.bottom - rect.top);
+	}
+
 	D3DDDI_RESOURCEFLAGS getResourceTypeFlags()
 	{
 		D3DDDI_RESOURCEFLAGS flags = {};
@@ -72,11 +84,6 @@ namespace
 		return flags;
 	}
 
-	void heapFree(void* p)
-	{
-		HeapFree(GetProcessHeap(), 0, p);
-	}
-
 	void splitToTiles(D3DDDIARG_CREATERESOURCE& data, const UINT tileWidth, const UINT tileHeight)
 	{
 		static std::vector<D3DDDI_SURFACEINFO> tiles;
@@ -103,6 +110,15 @@ namespace
 		data.Flags.Texture = 0;
 	}
 
+	void updateCost(double& nsPerByte, long long qpcStart, double byteCount)
+	{
+		if (byteCount >= MIN_COST_SAMPLE_SIZE)
+		{
+			const double ns = (Time::queryPerformanceCounter() - qpcStart) * 1e9 / Time::g_qpcFrequency;
+			nsPerByte += (ns / byteCount - nsPerByte) / 8;
+		}
+	}
+
 	D3DDDIARG_CREATERESOURCE2 upgradeResourceData(const D3DDDIARG_CREATERESOURCE& data)
 	{
 		D3DDDIARG_CREATERESOURCE2 data2 = {};
@@ -140,7 +156,7 @@ namespace D3dDdi
 		, m_handle(nullptr)
 		, m_origData(data)
 		, m_fixedData(data)
-		, m_lockBuffer(nullptr, &heapFree)
+		, m_lockBuffer(nullptr, &LockBufferPool::release)
 		, m_lockResource(nullptr, ResourceDeleter(device))
 	{
 		if (m_origData.Flags.VertexBuffer &&
@@ -194,7 +210,11 @@ namespace D3dDdi
 			{
 				copyToSysMem(0);
 			}
-			m_lockData[0].isVidMemUpToDate &= isReadOnly;
+			if (!isReadOnly)
+			{
+				markSysMemDirty(0, getRect(0));
+			}
+			recordAccess(0, getRect(0), false);
 		}
 	}
 
@@ -229,7 +249,7 @@ namespace D3dDdi
 		{
 			if (srcResource->isOversized())
 			{
-				prepareForRendering(data.DstSubResourceIndex, false);
+				prepareForBlt(data.DstSubResourceIndex, data.DstRect);
 				return srcResource->splitBlt(data, data.SrcSubResourceIndex, data.SrcRect, data.DstRect);
 			}
 			else if (m_fixedData.Flags.Primary)
@@ -241,7 +261,7 @@ namespace D3dDdi
 				return sysMemPreferredBlt(data, *srcResource);
 			}
 		}
-		prepareForRendering(data.DstSubResourceIndex, false);
+		prepareForBlt(data.DstSubResourceIndex, data.DstRect);
 		return m_device.getOrigVtable().pfnBlt(m_device, &data);
 	}
 
@@ -254,8 +274,16 @@ namespace D3dDdi
 		{
 			copyToSysMem(data.SubResourceIndex);
 		}
-		lockData.isVidMemUpToDate &= data.Flags.ReadOnly;
-		lockData.qpcLastForcedLock = Time::queryPerformanceCounter();
+		RECT rect = getRect(data.SubResourceIndex);
+		if (data.Flags.AreaValid)
+		{
+			IntersectRect(&rect, &rect, &data.Area);
+		}
+		if (!data.Flags.ReadOnly)
+		{
+			markSysMemDirty(data.SubResourceIndex, rect);
+		}
+		recordAccess(data.SubResourceIndex, rect, false);
 
 		unsigned char* ptr = static_cast<unsigned char*>(lockData.data);
 		if (data.Flags.AreaValid)
@@ -308,21 +336,24 @@ namespace D3dDdi
 					data.DstRect.right - data.DstRect.left, data.DstRect.bottom - data.DstRect.top,
 					m_formatInfo.bytesPerPixel, colorConvert(m_formatInfo, data.Color));
 
-				m_lockData[data.SubResourceIndex].isVidMemUpToDate = false;
+				markSysMemDirty(data.SubResourceIndex, data.DstRect);
+				recordAccess(data.SubResourceIndex, data.DstRect, false);
 				return LOG_RESULT(S_OK);
 			}
 		}
-		prepareForRendering(data.SubResourceIndex, false);
+		prepareForBlt(data.SubResourceIndex, data.DstRect);
 		return LOG_RESULT(m_device.getOrigVtable().pfnColorFill(m_device, &data));
 	}
 
-	HRESULT Resource::copySubResource(HANDLE dstResource, HANDLE srcResource, UINT subResourceIndex)
+	HRESULT Resource::copySubResource(HANDLE dstResource, HANDLE srcResource, UINT subResourceIndex, const RECT& rect)
 	{
-		LOG_FUNC("Resource::copySubResource", dstResource, srcResource, subResourceIndex);
-		RECT rect = {};
-		rect.right = m_fixedData.pSurfList[subResourceIndex].Width;
-		rect.bottom = m_fixedData.pSurfList[subResourceIndex].Height;
+		LOG_FUNC("Resource::copySubResource", dstResource, srcResource, subResourceIndex, rect);
+		if (IsRectEmpty(&rect))
+		{
+			return LOG_RESULT(S_OK);
+		}
 
+		const long long qpcStart = Time::queryPerformanceCounter();
 		D3DDDIARG_BLT data = {};
 		data.hSrcResource = srcResource;
 		data.SrcSubResourceIndex = subResourceIndex;
@@ -349,19 +380,29 @@ namespace D3dDdi
 		unlock.Flags.NotifyOnly = 1;
 		m_device.getOrigVtable().pfnUnlock(m_device, &unlock);
 
+		if (SUCCEEDED(result))
+		{
+			updateCost(g_syncNsPerByte, qpcStart, getArea(rect) * m_formatInfo.bytesPerPixel);
+		}
+		++g_stats.copySubResourceCount;
+		g_stats.copySubResourceBytes += static_cast<ULONGLONG>(getArea(rect)) * m_formatInfo.bytesPerPixel;
 		return LOG_RESULT(result);
 	}
 
 	void Resource::copyToSysMem(UINT subResourceIndex)
 	{
-		copySubResource(m_lockResource.get(), m_handle, subResourceIndex);
-		m_lockData[subResourceIndex].isSysMemUpToDate = true;
+		auto& lockData = m_lockData[subResourceIndex];
+		copySubResource(m_lockResource.get(), m_handle, subResourceIndex, lockData.vidMemDirtyRect);
+		lockData.isSysMemUpToDate = true;
+		lockData.vidMemDirtyRect = {};
 	}
 
 	void Resource::copyToVidMem(UINT subResourceIndex)
 	{
-		copySubResource(m_handle, m_lockResource.get(), subResourceIndex);
-		m_lockData[subResourceIndex].isVidMemUpToDate = true;
+		auto& lockData = m_lockData[subResourceIndex];
+		copySubResource(m_handle, m_lockResource.get(), subResourceIndex, lockData.sysMemDirtyRect);
+		lockData.isVidMemUpToDate = true;
+		lockData.sysMemDirtyRect = {};
 	}
 
 	void Resource::createGdiLockResource()
@@ -382,7 +423,7 @@ namespace D3dDdi
 		createSysMemResource({ surfaceInfo });
 		if (m_lockResource)
 		{
-			m_lockData[0].isVidMemUpToDate = false;
+			markSysMemDirty(0, getRect(0));
 		}
 		else
 		{
@@ -418,14 +459,14 @@ namespace D3dDdi
 
 		std::uintptr_t bufferSize = reinterpret_cast<std::uintptr_t>(surfaceInfo.back().pSysMem) +
 			surfaceInfo.back().SysMemPitch * surfaceInfo.back().Height + 8;
-		m_lockBuffer.reset(HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, bufferSize));
-
-		BYTE* bufferStart = static_cast<BYTE*>(m_lockBuffer.get());
-		if (0 == reinterpret_cast<std::uintptr_t>(bufferStart) % 16)
+		m_lockBuffer.reset(LockBufferPool::allocate(bufferSize, 16));
+		if (!m_lockBuffer)
 		{
-			bufferStart += 8;
+			return;
 		}
 
+		BYTE* bufferStart = static_cast<BYTE*>(m_lockBuffer.get()) + 8;
+
 		for (UINT i = 0; i < m_fixedData.SurfCount; ++i)
 		{
 			surfaceInfo[i].pSysMem = bufferStart + reinterpret_cast<uintptr_t>(surfaceInfo[i].pSysMem);
@@ -454,14 +495,17 @@ namespace D3dDdi
 		{
 			m_lockResource.reset(data.hResource);
 			m_lockData.resize(surfaceInfo.size());
-			auto qpcLastForcedLock = Time::queryPerformanceCounter() - Time::msToQpc(Config::evictionTimeout);
 			for (std::size_t i = 0; i < surfaceInfo.size(); ++i)
 			{
 				m_lockData[i].data = const_cast<void*>(surfaceInfo[i].pSysMem);
 				m_lockData[i].pitch = surfaceInfo[i].SysMemPitch;
-				m_lockData[i].qpcLastForcedLock = qpcLastForcedLock;
+				m_lockData[i].qpcLastAccess = 0;
+				m_lockData[i].cpuAccessBytes = 0;
+				m_lockData[i].gpuAccessBytes = 0;
 				m_lockData[i].isSysMemUpToDate = true;
 				m_lockData[i].isVidMemUpToDate = true;
+				m_lockData[i].sysMemDirtyRect = {};
+				m_lockData[i].vidMemDirtyRect = {};
 			}
 		}
 
@@ -474,7 +518,7 @@ namespace D3dDdi
 	{
 		if (m_lockResource && !isReadOnly && m_lockData[0].isSysMemUpToDate)
 		{
-			m_lockData[0].isVidMemUpToDate = false;
+			markSysMemDirty(0, getRect(0));
 		}
 	}
 
@@ -483,11 +527,48 @@ namespace D3dDdi
 		return m_lockData.empty() ? nullptr : m_lockData[subResourceIndex].data;
 	}
 
+	RECT Resource::getRect(UINT subResourceIndex) const
+	{
+		const auto& surfaceInfo = m_fixedData.pSurfList[subResourceIndex];
+		return { 0, 0, static_cast<LONG>(surfaceInfo.Width), static_cast<LONG>(surfaceInfo.Height) };
+	}
+
+	Resource::Stats Resource::getStats()
+	{
+		return g_stats;
+	}
+
 	bool Resource::isOversized() const
 	{
 		return m_fixedData.SurfCount != m_origData.SurfCount;
 	}
 
+	bool Resource::isSysMemBltPreferred(const D3DDDIARG_BLT& data, Resource& srcResource)
+	{
+		const auto& dstLockData = m_lockData[data.DstSubResourceIndex];
+		const auto& srcLockData = srcResource.m_lockData[data.SrcSubResourceIndex];
+		const UINT dstBpp = m_formatInfo.bytesPerPixel;
+		const UINT srcBpp = srcResource.m_formatInfo.bytesPerPixel;
+
+		const double toSysMemBytes =
+			(dstLockData.isSysMemUpToDate ? 0 : getArea(dstLockData.vidMemDirtyRect) * dstBpp) +
+			(srcLockData.isSysMemUpToDate ? 0 : getArea(srcLockData.vidMemDirtyRect) * srcBpp);
+		const double toVidMemBytes =
+			(dstLockData.isVidMemUpToDate ? 0 : getArea(dstLockData.sysMemDirtyRect) * dstBpp) +
+			(srcLockData.isVidMemUpToDate ? 0 : getArea(srcLockData.sysMemDirtyRect) * srcBpp);
+
+		// The blitted area has to be synchronized again later if the other side is accessed next, which is
+		// estimated from the recent CPU/GPU access history of the destination.
+		const double bltBytes = getArea(data.DstRect) * dstBpp;
+		const double totalAccessBytes = dstLockData.cpuAccessBytes + dstLockData.gpuAccessBytes;
+		const double cpuAccessRatio = 0 != totalAccessBytes ? dstLockData.cpuAccessBytes / totalAccessBytes : 0;
+
+		const double sysMemCost = (toSysMemBytes + (1 - cpuAccessRatio) * bltBytes) * g_syncNsPerByte +
+			bltBytes * g_cpuBltNsPerByte;
+		const double vidMemCost = (toVidMemBytes + cpuAccessRatio * bltBytes) * g_syncNsPerByte;
+		return sysMemCost < vidMemCost;
+	}
+
 	bool Resource::isValidRect(UINT subResourceIndex, const RECT& rect)
 	{
 		return rect.left >= 0 && rect.top >= 0 && rect.left < rect.right && rect.top < rect.bottom &&
@@ -516,6 +597,49 @@ namespace D3dDdi
 		return m_device.getOrigVtable().pfnLock(m_device, &data);
 	}
 
+	void Resource::markSysMemDirty(UINT subResourceIndex, const RECT& rect)
+	{
+		auto& lockData = m_lockData[subResourceIndex];
+		if (lockData.isVidMemUpToDate)
+		{
+			lockData.isVidMemUpToDate = false;
+			lockData.sysMemDirtyRect = rect;
+		}
+		else
+		{
+			UnionRect(&lockData.sysMemDirtyRect, &lockData.sysMemDirtyRect, &rect);
+		}
+	}
+
+	void Resource::markVidMemDirty(UINT subResourceIndex, const RECT& rect)
+	{
+		auto& lockData = m_lockData[subResourceIndex];
+		if (lockData.isSysMemUpToDate)
+		{
+			lockData.isSysMemUpToDate = false;
+			lockData.vidMemDirtyRect = rect;
+		}
+		else
+		{
+			UnionRect(&lockData.vidMemDirtyRect, &lockData.vidMemDirtyRect, &rect);
+		}
+	}
+
+	void Resource::prepareForBlt(UINT subResourceIndex, const RECT& dstRect)
+	{
+		if (m_lockResource && 0 == m_lockData[subResourceIndex].lockCount)
+		{
+			if (!m_lockData[subResourceIndex].isVidMemUpToDate)
+			{
+				copyToVidMem(subResourceIndex);
+			}
+			RECT rect = getRect(subResourceIndex);
+			IntersectRect(&rect, &rect, &dstRect);
+			markVidMemDirty(subResourceIndex, rect);
+			recordAccess(subResourceIndex, rect, true);
+		}
+	}
+
 	void Resource::prepareForRendering(UINT subResourceIndex, bool isReadOnly)
 	{
 		if (m_lockResource && 0 == m_lockData[subResourceIndex].lockCount)
@@ -524,7 +648,11 @@ namespace D3dDdi
 			{
 				copyToVidMem(subResourceIndex);
 			}
-			m_lockData[subResourceIndex].isSysMemUpToDate &= isReadOnly;
+			if (!isReadOnly)
+			{
+				markVidMemDirty(subResourceIndex, getRect(subResourceIndex));
+			}
+			recordAccess(subResourceIndex, getRect(subResourceIndex), true);
 		}
 	}
 
@@ -533,11 +661,33 @@ namespace D3dDdi
 		if (srcResource.m_lockResource &&
 			srcResource.m_lockData[data.SrcSubResourceIndex].isSysMemUpToDate)
 		{
+			if (srcResource.m_lockData[data.SrcSubResourceIndex].isVidMemUpToDate)
+			{
+				srcResource.markSysMemDirty(data.SrcSubResourceIndex, srcResource.getRect(data.SrcSubResourceIndex));
+			}
 			srcResource.copyToVidMem(data.SrcSubResourceIndex);
 		}
 		return m_device.getOrigVtable().pfnBlt(m_device, &data);
 	}
 
+	void Resource::recordAccess(UINT subResourceIndex, const RECT& rect, bool isGpuAccess)
+	{
+		auto& lockData = m_lockData[subResourceIndex];
+		const long long now = Time::queryPerformanceCounter();
+		const double decay = std::pow(0.5,
+			static_cast<double>(now - lockData.qpcLastAccess) / Time::msToQpc(Config::accessHistoryHalfLife));
+		lockData.qpcLastAccess = now;
+		lockData.cpuAccessBytes *= decay;
+		lockData.gpuAccessBytes *= decay;
+		(isGpuAccess ? lockData.gpuAccessBytes : lockData.cpuAccessBytes) +=
+			getArea(rect) * m_formatInfo.bytesPerPixel;
+	}
+
+	void Resource::resetStats()
+	{
+		g_stats = {};
+	}
+
 	void Resource::setAsGdiResource(bool isGdiResource)
 	{
 		m_lockResource.reset();
@@ -612,63 +762,87 @@ namespace D3dDdi
 
 	HRESULT Resource::sysMemPreferredBlt(const D3DDDIARG_BLT& data, Resource& srcResource)
 	{
-		if (m_fixedData.Format == srcResource.m_fixedData.Format &&
+		const bool isFormatConversion = m_fixedData.Format != srcResource.m_fixedData.Format;
+		if ((!isFormatConversion ||
+				!data.Flags.MirrorLeftRight && !data.Flags.MirrorUpDown &&
+				!data.Flags.SrcColorKey && !data.Flags.DstColorKey &&
+				DDraw::Blitter::isFilterSupported(m_formatInfo) &&
+				DDraw::Blitter::isFilterSupported(srcResource.m_formatInfo)) &&
 			!m_lockData.empty() &&
 			!srcResource.m_lockData.empty())
 		{
 			auto& dstLockData = m_lockData[data.DstSubResourceIndex];
 			auto& srcLockData = srcResource.m_lockData[data.SrcSubResourceIndex];
 
-			bool isSysMemBltPreferred = true;
-			auto now = Time::queryPerformanceCounter();
-			if (data.Flags.MirrorLeftRight || data.Flags.MirrorUpDown ||
-				(data.Flags.SrcColorKey && !m_device.isSrcColorKeySupported()))
-			{
-				dstLockData.qpcLastForcedLock = now;
-				srcLockData.qpcLastForcedLock = now;
-			}
-			else
-			{
-				isSysMemBltPreferred = dstLockData.isSysMemUpToDate &&
-					Time::qpcToMs(now - dstLockData.qpcLastForcedLock) <= Config::evictionTimeout;
-			}
+			const bool isSysMemBltForced = data.Flags.MirrorLeftRight || data.Flags.MirrorUpDown ||
+				(data.Flags.SrcColorKey && !m_device.isSrcColorKeySupported());
 
-			if (isSysMemBltPreferred)
+			if (isSysMemBltForced || isSysMemBltPreferred(data, srcResource))
 			{
 				if (!dstLockData.isSysMemUpToDate)
 				{
 					copyToSysMem(data.DstSubResourceIndex);
 				}
-				dstLockData.isVidMemUpToDate = false;
+				markSysMemDirty(data.DstSubResourceIndex, data.DstRect);
 
 				if (!srcLockData.isSysMemUpToDate)
 				{
 					srcResource.copyToSysMem(data.SrcSubResourceIndex);
 				}
+				recordAccess(data.DstSubResourceIndex, data.DstRect, false);
+				srcResource.recordAccess(data.SrcSubResourceIndex, data.SrcRect, false);
 
 				auto dstBuf = static_cast<BYTE*>(dstLockData.data) +
 					data.DstRect.top * dstLockData.pitch + data.DstRect.left * m_formatInfo.bytesPerPixel;
 				auto srcBuf = static_cast<const BYTE*>(srcLockData.data) +
-					data.SrcRect.top * srcLockData.pitch + data.SrcRect.left * m_formatInfo.bytesPerPixel;
-
-				DDraw::Blitter::blt(
-					dstBuf,
-					dstLockData.pitch,
-					data.DstRect.right - data.DstRect.left,
-					data.DstRect.bottom - data.DstRect.top,
-					srcBuf,
-					srcLockData.pitch,
-					(1 - 2 * data.Flags.MirrorLeftRight) * (data.SrcRect.right - data.SrcRect.left),
-					(1 - 2 * data.Flags.MirrorUpDown) * (data.SrcRect.bottom - data.SrcRect.top),
-					m_formatInfo.bytesPerPixel,
-					data.Flags.DstColorKey ? reinterpret_cast<const DWORD*>(&data.ColorKey) : nullptr,
-					data.Flags.SrcColorKey ? reinterpret_cast<const DWORD*>(&data.ColorKey) : nullptr);
+					data.SrcRect.top * srcLockData.pitch + data.SrcRect.left * srcResource.m_formatInfo.bytesPerPixel;
+
+				const DWORD dstWidth = data.DstRect.right - data.DstRect.left;
+				const DWORD dstHeight = data.DstRect.bottom - data.DstRect.top;
+				const DWORD srcWidth = data.SrcRect.right - data.SrcRect.left;
+				const DWORD srcHeight = data.SrcRect.bottom - data.SrcRect.top;
+
+				const bool isFilteredStretch = data.Flags.Linear && &srcResource != this &&
+					(dstWidth != srcWidth || dstHeight != srcHeight) &&
+					!data.Flags.MirrorLeftRight && !data.Flags.MirrorUpDown &&
+					!data.Flags.DstColorKey && !data.Flags.SrcColorKey &&
+					DDraw::Blitter::isFilterSupported(m_formatInfo);
+
+				const long long qpcBltStart = Time::queryPerformanceCounter();
+				if (isFormatConversion || isFilteredStretch)
+				{
+					auto filter = DDraw::Blitter::FILTER_POINT;
+					if (isFilteredStretch)
+					{
+						filter = dstWidth >= srcWidth && dstHeight >= srcHeight
+							? DDraw::Blitter::FILTER_BILINEAR : DDraw::Blitter::FILTER_BOX;
+					}
+
+					DDraw::Blitter::filteredBlt(dstBuf, dstLockData.pitch, dstWidth, dstHeight, m_formatInfo,
+						srcBuf, srcLockData.pitch, srcWidth, srcHeight, srcResource.m_formatInfo, filter);
+				}
+				else
+				{
+					DDraw::Blitter::blt(
+						dstBuf,
+						dstLockData.pitch,
+						dstWidth,
+						dstHeight,
+						srcBuf,
+						srcLockData.pitch,
+						(1 - 2 * data.Flags.MirrorLeftRight) * static_cast<LONG>(srcWidth),
+						(1 - 2 * data.Flags.MirrorUpDown) * static_cast<LONG>(srcHeight),
+						m_formatInfo.bytesPerPixel,
+						data.Flags.DstColorKey ? reinterpret_cast<const DWORD*>(&data.ColorKey) : nullptr,
+						data.Flags.SrcColorKey ? reinterpret_cast<const DWORD*>(&data.ColorKey) : nullptr);
+				}
 
+				updateCost(g_cpuBltNsPerByte, qpcBltStart, getArea(data.DstRect) * m_formatInfo.bytesPerPixel);
 				return S_OK;
 			}
 		}
 
-		prepareForRendering(data.DstSubResourceIndex, false);
+		prepareForBlt(data.DstSubResourceIndex, data.DstRect);
 		srcResource.prepareForRendering(data.SrcSubResourceIndex, true);
 		return m_device.getOrigVtable().pfnBlt(m_device, &data);
 	}
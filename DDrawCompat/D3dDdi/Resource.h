@@ -15,6 +15,12 @@ namespace D3dDdi
 	class Resource
 	{
 	public:
+		struct Stats
+		{
+			UINT copySubResourceCount;
+			ULONGLONG copySubResourceBytes;
+		};
+
 		Resource(Device& device, D3DDDIARG_CREATERESOURCE& data);
 		Resource(Device& device, D3DDDIARG_CREATERESOURCE2& data);
 
@@ -36,6 +42,9 @@ namespace D3dDdi
 		void setAsGdiResource(bool isGdiResource);
 		HRESULT unlock(const D3DDDIARG_UNLOCK& data);
 
+		static Stats getStats();
+		static void resetStats();
+
 	private:
 		class Data : public D3DDDIARG_CREATERESOURCE2
 		{
@@ -58,9 +67,13 @@ namespace D3dDdi
 			void* data;
 			UINT pitch;
 			UINT lockCount;
-			long long qpcLastForcedLock;
+			long long qpcLastAccess;
+			double cpuAccessBytes;
+			double gpuAccessBytes;
 			bool isSysMemUpToDate;
 			bool isVidMemUpToDate;
+			RECT sysMemDirtyRect;
+			RECT vidMemDirtyRect;
 		};
 
 		class ResourceDeleter
@@ -79,15 +92,21 @@ namespace D3dDdi
 		HRESULT bltLock(D3DDDIARG_LOCK& data);
 		HRESULT bltUnlock(const D3DDDIARG_UNLOCK& data);
 		void clipRect(UINT subResourceIndex, RECT& rect);
-		HRESULT copySubResource(HANDLE dstResource, HANDLE srcResource, UINT subResourceIndex);
+		HRESULT copySubResource(HANDLE dstResource, HANDLE srcResource, UINT subResourceIndex, const RECT& rect);
 		void copyToSysMem(UINT subResourceIndex);
 		void copyToVidMem(UINT subResourceIndex);
 		void createGdiLockResource();
 		void createLockResource();
 		void createSysMemResource(const std::vector<D3DDDI_SURFACEINFO>& surfaceInfo);
+		RECT getRect(UINT subResourceIndex) const;
 		bool isOversized() const;
+		bool isSysMemBltPreferred(const D3DDDIARG_BLT& data, Resource& srcResource);
 		bool isValidRect(UINT subResourceIndex, const RECT& rect);
+		void markSysMemDirty(UINT subResourceIndex, const RECT& rect);
+		void markVidMemDirty(UINT subResourceIndex, const RECT& rect);
+		void prepareForBlt(UINT subResourceIndex, const RECT& dstRect);
 		HRESULT presentationBlt(const D3DDDIARG_BLT& data, Resource& srcResource);
+		void recordAccess(UINT subResourceIndex, const RECT& rect, bool isGpuAccess);
 		HRESULT splitBlt(D3DDDIARG_BLT& data, UINT& subResourceIndex, RECT& rect, RECT& otherRect);
 
 		template <typename Arg>
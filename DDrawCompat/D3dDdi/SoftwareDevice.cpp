@@ -0,0 +1,688 @@
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <Common/ScopedCriticalSection.h>
+#include <D3dDdi/DrawPrimitive.h>
+#include <D3dDdi/FormatInfo.h>
+#include <D3dDdi/SoftwareDevice.h>
+#include <D3dDdi/Visitors/DeviceFuncsVisitor.h>
+#include <DDraw/Blitter.h>
+
+namespace
+{
+	struct Surface
+	{
+		BYTE* data;
+		UINT width;
+		UINT height;
+		UINT pitch;
+		std::unique_ptr<BYTE[]> buffer;
+	};
+
+	struct Resource
+	{
+		D3DDDIFORMAT format;
+		D3dDdi::FormatInfo formatInfo;
+		UINT bytesPerPixel;
+		std::vector<Surface> surfaces;
+	};
+
+	template <typename MemberDataPtr, MemberDataPtr ptr>
+	struct FuncName
+	{
+		static const char* s_name;
+	};
+
+	template <typename MemberDataPtr, MemberDataPtr ptr>
+	const char* FuncName<MemberDataPtr, ptr>::s_name = nullptr;
+
+	struct StreamSource
+	{
+		HANDLE vertexBuffer;
+		const BYTE* umBuffer;
+		UINT offset;
+		UINT stride;
+	};
+
+	struct Indices
+	{
+		HANDLE indexBuffer;
+		UINT stride;
+	};
+
+	struct Query
+	{
+		bool isIssued;
+	};
+
+	Compat::CriticalSection g_cs;
+	D3dDdi::SoftwareDevice::Stats g_stats = {};
+	std::unordered_map<HANDLE, std::unique_ptr<Resource>> g_resources;
+	std::unordered_map<HANDLE, std::unique_ptr<Query>> g_queries;
+	bool g_areQueriesSupported = true;
+	bool g_areQueriesSignaled = true;
+	HANDLE g_renderTarget = nullptr;
+	UINT g_renderTargetSubResourceIndex = 0;
+	StreamSource g_streamSource = {};
+	Indices g_indices = {};
+	std::vector<BYTE>* g_primitiveVertices = nullptr;
+
+	void countCall(const char* funcName)
+	{
+		++g_stats.callCounts[funcName];
+	}
+
+	Surface* getSurface(HANDLE resource, UINT subResourceIndex, Resource** res = nullptr)
+	{
+		auto it = g_resources.find(resource);
+		if (it == g_resources.end() || subResourceIndex >= it->second->surfaces.size())
+		{
+			return nullptr;
+		}
+		if (res)
+		{
+			*res = it->second.get();
+		}
+		return &it->second->surfaces[subResourceIndex];
+	}
+
+	void countPrimitives(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount)
+	{
+		g_stats.primitiveCount += primitiveCount;
+		g_stats.vertexCount += D3dDdi::getVertexCount(primitiveType, primitiveCount);
+	}
+
+	const BYTE* getBufferData(HANDLE buffer)
+	{
+		Surface* surface = getSurface(buffer, 0);
+		return surface ? surface->data : nullptr;
+	}
+
+	const BYTE* getVertexData()
+	{
+		if (g_streamSource.umBuffer)
+		{
+			return g_streamSource.umBuffer;
+		}
+		const BYTE* data = getBufferData(g_streamSource.vertexBuffer);
+		return data ? data + g_streamSource.offset : nullptr;
+	}
+
+	template <typename GetVertex>
+	void capturePrimitives(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount, GetVertex getVertex)
+	{
+		if (!g_primitiveVertices || 0 == g_streamSource.stride)
+		{
+			return;
+		}
+
+		auto captureVertex = [&](UINT i)
+			{
+				const BYTE* vertex = getVertex(i);
+				if (vertex)
+				{
+					g_primitiveVertices->insert(g_primitiveVertices->end(), vertex, vertex + g_streamSource.stride);
+				}
+			};
+
+		for (UINT i = 0; i < primitiveCount; ++i)
+		{
+			switch (primitiveType)
+			{
+			case D3DPT_POINTLIST:
+				captureVertex(i);
+				break;
+			case D3DPT_LINELIST:
+				captureVertex(2 * i);
+				captureVertex(2 * i + 1);
+				break;
+			case D3DPT_LINESTRIP:
+				captureVertex(i);
+				captureVertex(i + 1);
+				break;
+			case D3DPT_TRIANGLELIST:
+				captureVertex(3 * i);
+				captureVertex(3 * i + 1);
+				captureVertex(3 * i + 2);
+				break;
+			case D3DPT_TRIANGLESTRIP:
+				captureVertex(i);
+				captureVertex(i + 1 + i % 2);
+				captureVertex(i + 2 - i % 2);
+				break;
+			case D3DPT_TRIANGLEFAN:
+				captureVertex(i + 1);
+				captureVertex(i + 2);
+				captureVertex(0);
+				break;
+			}
+		}
+	}
+
+	template <typename Index>
+	void captureIndexedPrimitives(D3DPRIMITIVETYPE primitiveType, UINT primitiveCount, const Index* indices,
+		INT baseVertexIndex, UINT minIndex, UINT numVertices)
+	{
+		const BYTE* vertices = getVertexData();
+		capturePrimitives(primitiveType, primitiveCount, [&](UINT i) -> const BYTE*
+			{
+				if (indices[i] < minIndex || indices[i] >= minIndex + numVertices)
+				{
+					++g_stats.invalidIndexCount;
+				}
+				return vertices ? vertices + (baseVertexIndex + static_cast<INT>(indices[i])) * g_streamSource.stride : nullptr;
+			});
+	}
+
+	template <typename Index>
+	void captureIndexedPrimitives(const D3DDDIARG_DRAWINDEXEDPRIMITIVE& data, UINT indexStride, const void* indices)
+	{
+		if (sizeof(Index) == indexStride)
+		{
+			captureIndexedPrimitives(data.PrimitiveType, data.PrimitiveCount,
+				static_cast<const Index*>(indices) + data.StartIndex, data.BaseVertexIndex, data.MinIndex, data.NumVertices);
+		}
+	}
+
+	void fillRect(Resource& resource, Surface& surface, RECT rect, D3DCOLOR color)
+	{
+		RECT bounds = { 0, 0, static_cast<LONG>(surface.width), static_cast<LONG>(surface.height) };
+		if (IntersectRect(&rect, &rect, &bounds))
+		{
+			const UINT width = rect.right - rect.left;
+			const UINT height = rect.bottom - rect.top;
+			DDraw::Blitter::colorFill(surface.data + rect.top * surface.pitch + rect.left * resource.bytesPerPixel,
+				surface.pitch, width, height, resource.bytesPerPixel, D3dDdi::colorConvert(resource.formatInfo, color));
+			g_stats.colorFillBytes += width * height * resource.bytesPerPixel;
+		}
+	}
+
+	HRESULT APIENTRY blt(HANDLE /*hDevice*/, const D3DDDIARG_BLT* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnBlt");
+
+		Resource* dstResource = nullptr;
+		Resource* srcResource = nullptr;
+		Surface* dst = getSurface(data->hDstResource, data->DstSubResourceIndex, &dstResource);
+		Surface* src = getSurface(data->hSrcResource, data->SrcSubResourceIndex, &srcResource);
+		if (!dst || !src)
+		{
+			return E_INVALIDARG;
+		}
+
+		const RECT& dr = data->DstRect;
+		const RECT& sr = data->SrcRect;
+		if (dr.left < 0 || dr.top < 0 || dr.right > static_cast<LONG>(dst->width) ||
+			dr.bottom > static_cast<LONG>(dst->height) || dr.left >= dr.right || dr.top >= dr.bottom ||
+			sr.left < 0 || sr.top < 0 || sr.right > static_cast<LONG>(src->width) ||
+			sr.bottom > static_cast<LONG>(src->height) || sr.left >= sr.right || sr.top >= sr.bottom)
+		{
+			return E_INVALIDARG;
+		}
+
+		const DWORD dstWidth = dr.right - dr.left;
+		const DWORD dstHeight = dr.bottom - dr.top;
+		const DWORD srcWidth = sr.right - sr.left;
+		const DWORD srcHeight = sr.bottom - sr.top;
+		BYTE* dstBuf = dst->data + dr.top * dst->pitch + dr.left * dstResource->bytesPerPixel;
+		const BYTE* srcBuf = src->data + sr.top * src->pitch + sr.left * srcResource->bytesPerPixel;
+
+		if (dstResource->format == srcResource->format)
+		{
+			DDraw::Blitter::blt(dstBuf, dst->pitch, dstWidth, dstHeight, srcBuf, src->pitch,
+				(1 - 2 * data->Flags.MirrorLeftRight) * static_cast<LONG>(srcWidth),
+				(1 - 2 * data->Flags.MirrorUpDown) * static_cast<LONG>(srcHeight),
+				dstResource->bytesPerPixel,
+				data->Flags.DstColorKey ? reinterpret_cast<const DWORD*>(&data->ColorKey) : nullptr,
+				data->Flags.SrcColorKey ? reinterpret_cast<const DWORD*>(&data->ColorKey) : nullptr);
+		}
+		else if (DDraw::Blitter::isFilterSupported(dstResource->formatInfo) &&
+			DDraw::Blitter::isFilterSupported(srcResource->formatInfo))
+		{
+			DDraw::Blitter::filteredBlt(dstBuf, dst->pitch, dstWidth, dstHeight, dstResource->formatInfo,
+				srcBuf, src->pitch, srcWidth, srcHeight, srcResource->formatInfo, DDraw::Blitter::FILTER_POINT);
+		}
+		else
+		{
+			return E_NOTIMPL;
+		}
+
+		g_stats.bltBytes += dstWidth * dstHeight * dstResource->bytesPerPixel;
+		return S_OK;
+	}
+
+	HRESULT APIENTRY clear(HANDLE /*hDevice*/, const D3DDDIARG_CLEAR* data, UINT numRect, const RECT* rect)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnClear");
+
+		Resource* resource = nullptr;
+		Surface* surface = getSurface(g_renderTarget, g_renderTargetSubResourceIndex, &resource);
+		if (!surface || !(data->Flags & D3DCLEAR_TARGET))
+		{
+			return S_OK;
+		}
+
+		if (0 == numRect)
+		{
+			fillRect(*resource, *surface, { 0, 0, static_cast<LONG>(surface->width), static_cast<LONG>(surface->height) },
+				data->FillColor);
+		}
+		for (UINT i = 0; i < numRect; ++i)
+		{
+			fillRect(*resource, *surface, rect[i], data->FillColor);
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY colorFill(HANDLE /*hDevice*/, const D3DDDIARG_COLORFILL* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnColorFill");
+
+		Resource* resource = nullptr;
+		Surface* surface = getSurface(data->hResource, data->SubResourceIndex, &resource);
+		if (!surface)
+		{
+			return E_INVALIDARG;
+		}
+
+		fillRect(*resource, *surface, data->DstRect, data->Color);
+		return S_OK;
+	}
+
+	HRESULT createResource(D3DDDIARG_CREATERESOURCE2& data)
+	{
+		auto resource(std::make_unique<Resource>());
+		resource->format = data.Format;
+		resource->formatInfo = D3dDdi::getFormatInfo(data.Format);
+		resource->bytesPerPixel = resource->formatInfo.bytesPerPixel;
+		if (0 == resource->bytesPerPixel)
+		{
+			// Vertex and index buffers are sized in bytes
+			resource->bytesPerPixel = 1;
+		}
+
+		for (UINT i = 0; i < data.SurfCount; ++i)
+		{
+			const auto& surfaceInfo = data.pSurfList[i];
+			Surface surface = {};
+			surface.width = surfaceInfo.Width;
+			surface.height = max(surfaceInfo.Height, 1u);
+
+			if (D3DDDIPOOL_SYSTEMMEM == data.Pool && surfaceInfo.pSysMem)
+			{
+				surface.data = static_cast<BYTE*>(const_cast<void*>(surfaceInfo.pSysMem));
+				surface.pitch = surfaceInfo.SysMemPitch;
+			}
+			else
+			{
+				surface.pitch = (surface.width * resource->bytesPerPixel + 15) & ~15;
+				surface.buffer.reset(new BYTE[surface.pitch * surface.height]());
+				surface.data = surface.buffer.get();
+				g_stats.resourceBytes += surface.pitch * surface.height;
+
+				if (surfaceInfo.pSysMem)
+				{
+					const UINT rowSize = surface.width * resource->bytesPerPixel;
+					const UINT srcPitch = 0 != surfaceInfo.SysMemPitch ? surfaceInfo.SysMemPitch : rowSize;
+					for (UINT y = 0; y < surface.height; ++y)
+					{
+						memcpy(surface.data + y * surface.pitch,
+							static_cast<const BYTE*>(surfaceInfo.pSysMem) + y * srcPitch, rowSize);
+					}
+				}
+			}
+			resource->surfaces.push_back(std::move(surface));
+		}
+
+		data.hResource = resource.get();
+		g_resources[data.hResource] = std::move(resource);
+		++g_stats.resourceCount;
+		return S_OK;
+	}
+
+	HRESULT APIENTRY createQuery(HANDLE /*hDevice*/, D3DDDIARG_CREATEQUERY* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnCreateQuery");
+		if (!g_areQueriesSupported || D3DDDIQUERYTYPE_EVENT != data->QueryType)
+		{
+			return E_NOTIMPL;
+		}
+
+		auto query = std::make_unique<Query>();
+		data->hQuery = query.get();
+		g_queries[data->hQuery] = std::move(query);
+		return S_OK;
+	}
+
+	HRESULT APIENTRY createResource(HANDLE /*hDevice*/, D3DDDIARG_CREATERESOURCE* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnCreateResource");
+		D3DDDIARG_CREATERESOURCE2 data2 = {};
+		reinterpret_cast<D3DDDIARG_CREATERESOURCE&>(data2) = *data;
+		HRESULT result = createResource(data2);
+		data->hResource = data2.hResource;
+		return result;
+	}
+
+	HRESULT APIENTRY createResource2(HANDLE /*hDevice*/, D3DDDIARG_CREATERESOURCE2* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnCreateResource2");
+		return createResource(*data);
+	}
+
+	HRESULT APIENTRY destroyQuery(HANDLE /*hDevice*/, HANDLE hQuery)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnDestroyQuery");
+		return g_queries.erase(hQuery) ? S_OK : E_INVALIDARG;
+	}
+
+	HRESULT APIENTRY destroyResource(HANDLE /*hDevice*/, HANDLE hResource)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnDestroyResource");
+
+		auto it = g_resources.find(hResource);
+		if (it == g_resources.end())
+		{
+			return E_INVALIDARG;
+		}
+
+		for (const auto& surface : it->second->surfaces)
+		{
+			if (surface.buffer)
+			{
+				g_stats.resourceBytes -= surface.pitch * surface.height;
+			}
+		}
+		if (g_renderTarget == hResource)
+		{
+			g_renderTarget = nullptr;
+		}
+		if (g_streamSource.vertexBuffer == hResource)
+		{
+			g_streamSource = {};
+		}
+		if (g_indices.indexBuffer == hResource)
+		{
+			g_indices = {};
+		}
+		g_resources.erase(it);
+		--g_stats.resourceCount;
+		return S_OK;
+	}
+
+	HRESULT APIENTRY drawIndexedPrimitive(HANDLE /*hDevice*/, const D3DDDIARG_DRAWINDEXEDPRIMITIVE* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnDrawIndexedPrimitive");
+		countPrimitives(data->PrimitiveType, data->PrimitiveCount);
+
+		const BYTE* indices = getBufferData(g_indices.indexBuffer);
+		if (indices)
+		{
+			captureIndexedPrimitives<UINT16>(*data, g_indices.stride, indices);
+			captureIndexedPrimitives<UINT>(*data, g_indices.stride, indices);
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY drawIndexedPrimitive2(HANDLE /*hDevice*/, const D3DDDIARG_DRAWINDEXEDPRIMITIVE2* data,
+		UINT indicesSize, const void* indexBuffer, const UINT* /*flagBuffer*/)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnDrawIndexedPrimitive2");
+		countPrimitives(data->PrimitiveType, data->PrimitiveCount);
+
+		if (indexBuffer && 0 != g_streamSource.stride)
+		{
+			D3DDDIARG_DRAWINDEXEDPRIMITIVE dp = {};
+			dp.PrimitiveType = data->PrimitiveType;
+			dp.BaseVertexIndex = data->BaseVertexOffset / static_cast<INT>(g_streamSource.stride);
+			dp.MinIndex = data->MinIndex;
+			dp.NumVertices = data->NumVertices;
+			dp.StartIndex = 0 != indicesSize ? data->StartIndexOffset / indicesSize : 0;
+			dp.PrimitiveCount = data->PrimitiveCount;
+			captureIndexedPrimitives<UINT16>(dp, indicesSize, indexBuffer);
+			captureIndexedPrimitives<UINT>(dp, indicesSize, indexBuffer);
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY drawPrimitive(HANDLE /*hDevice*/, const D3DDDIARG_DRAWPRIMITIVE* data, const UINT* /*flagBuffer*/)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnDrawPrimitive");
+		countPrimitives(data->PrimitiveType, data->PrimitiveCount);
+
+		const BYTE* vertices = getVertexData();
+		if (vertices)
+		{
+			capturePrimitives(data->PrimitiveType, data->PrimitiveCount,
+				[&](UINT i) { return vertices + (data->VStart + i) * g_streamSource.stride; });
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY getQueryData(HANDLE /*hDevice*/, const D3DDDIARG_GETQUERYDATA* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnGetQueryData");
+
+		auto it = g_queries.find(data->hQuery);
+		if (it == g_queries.end() || !it->second->isIssued)
+		{
+			return E_INVALIDARG;
+		}
+
+		if (data->pData)
+		{
+			*static_cast<BOOL*>(data->pData) = g_areQueriesSignaled;
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY issueQuery(HANDLE /*hDevice*/, const D3DDDIARG_ISSUEQUERY* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnIssueQuery");
+
+		auto it = g_queries.find(data->hQuery);
+		if (it == g_queries.end())
+		{
+			return E_INVALIDARG;
+		}
+
+		if (data->Flags.End)
+		{
+			it->second->isIssued = true;
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY lock(HANDLE /*hDevice*/, D3DDDIARG_LOCK* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnLock");
+
+		Resource* resource = nullptr;
+		Surface* surface = getSurface(data->hResource, data->SubResourceIndex, &resource);
+		if (!surface)
+		{
+			return E_INVALIDARG;
+		}
+
+		if (data->Flags.NotifyOnly)
+		{
+			return S_OK;
+		}
+
+		if (data->Flags.Discard)
+		{
+			++g_stats.discardCount;
+		}
+
+		BYTE* ptr = surface->data;
+		UINT size = surface->pitch * surface->height;
+		if (data->Flags.RangeValid)
+		{
+			ptr += data->Range.Offset;
+			size = data->Range.Size;
+		}
+		else if (data->Flags.AreaValid)
+		{
+			ptr += data->Area.top * surface->pitch + data->Area.left * resource->bytesPerPixel;
+			size = (data->Area.bottom - data->Area.top) * surface->pitch;
+		}
+
+		data->pSurfData = ptr;
+		data->Pitch = surface->pitch;
+		data->SlicePitch = surface->pitch * surface->height;
+		g_stats.lockedBytes += size;
+		return S_OK;
+	}
+
+	HRESULT APIENTRY setIndices(HANDLE /*hDevice*/, const D3DDDIARG_SETINDICES* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnSetIndices");
+		g_indices = { data->hIndexBuffer, data->Stride };
+		return S_OK;
+	}
+
+	HRESULT APIENTRY setRenderTarget(HANDLE /*hDevice*/, const D3DDDIARG_SETRENDERTARGET* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnSetRenderTarget");
+		if (0 == data->RenderTargetIndex)
+		{
+			g_renderTarget = data->hRenderTarget;
+			g_renderTargetSubResourceIndex = data->SubResourceIndex;
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY setStreamSource(HANDLE /*hDevice*/, const D3DDDIARG_SETSTREAMSOURCE* data)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnSetStreamSource");
+		if (0 == data->Stream)
+		{
+			g_streamSource = { data->hVertexBuffer, nullptr, data->Offset, data->Stride };
+		}
+		return S_OK;
+	}
+
+	HRESULT APIENTRY setStreamSourceUm(HANDLE /*hDevice*/, const D3DDDIARG_SETSTREAMSOURCEUM* data, const void* umBuffer)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall("pfnSetStreamSourceUm");
+		if (0 == data->Stream)
+		{
+			g_streamSource = { nullptr, static_cast<const BYTE*>(umBuffer), 0, data->Stride };
+		}
+		return S_OK;
+	}
+
+	template <typename MemberDataPtr, MemberDataPtr ptr, typename Result, typename... Params>
+	Result APIENTRY countingFunc(Params...)
+	{
+		Compat::ScopedCriticalSection lock(g_cs);
+		countCall(FuncName<MemberDataPtr, ptr>::s_name);
+		return Result();
+	}
+
+	class CountingVisitor
+	{
+	public:
+		CountingVisitor(D3DDDI_DEVICEFUNCS& vtable)
+			: m_vtable(vtable)
+		{
+		}
+
+		template <typename MemberDataPtr, MemberDataPtr ptr>
+		void visit(const char* funcName)
+		{
+			FuncName<MemberDataPtr, ptr>::s_name = funcName;
+			m_vtable.*ptr = &countingFunc<MemberDataPtr, ptr>;
+		}
+
+	private:
+		D3DDDI_DEVICEFUNCS& m_vtable;
+	};
+
+	D3DDDI_DEVICEFUNCS createVtable()
+	{
+		D3DDDI_DEVICEFUNCS vtable = {};
+		CountingVisitor visitor(vtable);
+		forEach<D3DDDI_DEVICEFUNCS>(visitor);
+
+		vtable.pfnBlt = &blt;
+		vtable.pfnClear = &clear;
+		vtable.pfnColorFill = &colorFill;
+		vtable.pfnCreateQuery = &createQuery;
+		vtable.pfnCreateResource = &createResource;
+		vtable.pfnCreateResource2 = &createResource2;
+		vtable.pfnDestroyQuery = &destroyQuery;
+		vtable.pfnDestroyResource = &destroyResource;
+		vtable.pfnDrawIndexedPrimitive = &drawIndexedPrimitive;
+		vtable.pfnDrawIndexedPrimitive2 = &drawIndexedPrimitive2;
+		vtable.pfnDrawPrimitive = &drawPrimitive;
+		vtable.pfnGetQueryData = &getQueryData;
+		vtable.pfnIssueQuery = &issueQuery;
+		vtable.pfnLock = &lock;
+		vtable.pfnSetIndices = &setIndices;
+		vtable.pfnSetRenderTarget = &setRenderTarget;
+		vtable.pfnSetStreamSource = &setStreamSource;
+		vtable.pfnSetStreamSourceUm = &setStreamSourceUm;
+		return vtable;
+	}
+}
+
+namespace D3dDdi
+{
+	namespace SoftwareDevice
+	{
+		void capturePrimitives(std::vector<BYTE>* primitiveVertices)
+		{
+			Compat::ScopedCriticalSection lock(g_cs);
+			g_primitiveVertices = primitiveVertices;
+		}
+
+		Stats getStats()
+		{
+			Compat::ScopedCriticalSection lock(g_cs);
+			return g_stats;
+		}
+
+		const D3DDDI_DEVICEFUNCS& getVtable()
+		{
+			static const D3DDDI_DEVICEFUNCS vtable(createVtable());
+			return vtable;
+		}
+
+		void setQueryBehavior(bool areSupported, bool areSignaled)
+		{
+			Compat::ScopedCriticalSection lock(g_cs);
+			g_areQueriesSupported = areSupported;
+			g_areQueriesSignaled = areSignaled;
+		}
+
+		void resetStats()
+		{
+			Compat::ScopedCriticalSection lock(g_cs);
+			const UINT resourceCount = g_stats.resourceCount;
+			const ULONGLONG resourceBytes = g_stats.resourceBytes;
+			g_stats = {};
+			g_stats.resourceCount = resourceCount;
+			g_stats.resourceBytes = resourceBytes;
+		}
+	}
+}
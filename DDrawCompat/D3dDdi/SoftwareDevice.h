@@ -0,0 +1,38 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <d3d.h>
+#include <d3dumddi.h>
+
+namespace D3dDdi
+{
+	namespace SoftwareDevice
+	{
+		struct Stats
+		{
+			std::map<std::string, UINT> callCounts;
+			ULONGLONG bltBytes;
+			ULONGLONG colorFillBytes;
+			ULONGLONG lockedBytes;
+			ULONGLONG primitiveCount;
+			ULONGLONG vertexCount;
+			ULONGLONG invalidIndexCount;
+			UINT discardCount;
+			UINT resourceCount;
+			ULONGLONG resourceBytes;
+		};
+
+		// While set, the vertex data of every drawn primitive is appended to primitiveVertices, with strips and fans
+		// assembled into separate primitives in the order the driver would rasterize them
+		void capturePrimitives(std::vector<BYTE>* primitiveVertices);
+		Stats getStats();
+		const D3DDDI_DEVICEFUNCS& getVtable();
+		void resetStats();
+		// Event queries are supported and signaled as soon as they are issued by default. Queries that are created
+		// while unsupported fail, and unsignaled ones stay pending like fences the GPU hasn't reached yet.
+		void setQueryBehavior(bool areSupported, bool areSignaled);
+	}
+}
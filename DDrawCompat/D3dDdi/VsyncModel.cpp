@@ -0,0 +1,94 @@
+#include <D3dDdi/VsyncModel.h>
+
+namespace
+{
+	const UINT LOCKED_SAMPLE_COUNT = 4;
+	const long long MAX_PERIOD_WEIGHT = 8;
+}
+
+namespace D3dDdi
+{
+	VsyncModel::VsyncModel()
+		: m_phase{}
+		, m_sampleCount(0)
+		, m_lockedSampleCount(0)
+	{
+	}
+
+	void VsyncModel::addVblank(long long time, bool isNextVblank)
+	{
+		if (0 == m_sampleCount++)
+		{
+			m_phase.anchor = time;
+			return;
+		}
+
+		const long long elapsed = time - m_phase.anchor;
+		if (elapsed <= 0)
+		{
+			return;
+		}
+
+		if (0 == m_phase.period)
+		{
+			m_phase.period = elapsed;
+			m_phase.anchor = time;
+			++m_phase.anchorCounter;
+			return;
+		}
+
+		const long long vblankCount = isNextVblank ? 1 : max((elapsed + m_phase.period / 2) / m_phase.period, 1);
+		const long long error = elapsed - vblankCount * m_phase.period;
+		UINT counter = m_phase.anchorCounter + static_cast<UINT>(vblankCount);
+		const UINT predictedCounter = getCounter(m_phase, time);
+		if (static_cast<INT>(predictedCounter - counter) > 0)
+		{
+			counter = predictedCounter;
+		}
+
+		if (error > m_phase.period / 4 || error < -m_phase.period / 4)
+		{
+			m_lockedSampleCount = 0;
+			if (1 == vblankCount)
+			{
+				m_phase.period = elapsed;
+			}
+		}
+		else
+		{
+			// Samples spanning more vblanks measure the period more precisely, so they get more weight
+			const long long weight = min(vblankCount, MAX_PERIOD_WEIGHT);
+			m_phase.period += (elapsed / vblankCount - m_phase.period) * weight / MAX_PERIOD_WEIGHT;
+			if (vblankCount > 1 && isLocked())
+			{
+				m_lockedSampleCount = LOCKED_SAMPLE_COUNT - 1;
+			}
+			else if (m_lockedSampleCount < LOCKED_SAMPLE_COUNT)
+			{
+				++m_lockedSampleCount;
+			}
+		}
+
+		m_phase.anchor = time;
+		m_phase.anchorCounter = counter;
+	}
+
+	UINT VsyncModel::getCounter(const Phase& phase, long long time)
+	{
+		if (0 == phase.period || time <= phase.anchor)
+		{
+			return phase.anchorCounter;
+		}
+		return phase.anchorCounter + static_cast<UINT>((time - phase.anchor) / phase.period);
+	}
+
+	long long VsyncModel::getVblankTime(const Phase& phase, UINT counter)
+	{
+		return phase.anchor + static_cast<INT>(counter - phase.anchorCounter) * phase.period;
+	}
+
+	bool VsyncModel::isLocked() const
+	{
+		return m_lockedSampleCount >= LOCKED_SAMPLE_COUNT;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Windows.h>
+
+namespace D3dDdi
+{
+	// Learns the refresh period and phase from observed vblank timestamps, so that the vsync counter and the
+	// time of any vblank can be computed instead of waited for. Observations don't have to be consecutive;
+	// the number of vblanks between two of them is inferred from the current period estimate.
+	// A sample spanning several vblanks can't tell a refresh rate change to an integer multiple or fraction of the
+	// period apart, so it unlocks a locked model until the following vblank is added with isNextVblank set.
+	// Timestamps are in arbitrary monotonic units (QPC ticks in practice). Not thread-safe.
+	class VsyncModel
+	{
+	public:
+		struct Phase
+		{
+			long long anchor;
+			long long period;
+			UINT anchorCounter;
+		};
+
+		VsyncModel();
+
+		void addVblank(long long time, bool isNextVblank = false);
+		Phase getPhase() const { return m_phase; }
+		bool isLocked() const;
+
+		static UINT getCounter(const Phase& phase, long long time);
+		static long long getVblankTime(const Phase& phase, UINT counter);
+
+	private:
+		Phase m_phase;
+		UINT m_sampleCount;
+		UINT m_lockedSampleCount;
+	};
+}
@@ -1,14 +1,25 @@
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <type_traits>
 #include <vector>
 
+#ifdef _MSC_VER
 #include <intrin.h>
+#define AVX2_TARGET
+#pragma warning(disable : 4127)
+#else
+#include <x86intrin.h>
+#define __forceinline inline __attribute__((always_inline))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
 
 #include "Common/ScopedCriticalSection.h"
+#include "Common/WorkerPool.h"
+#include "Config/Config.h"
+#include "D3dDdi/FormatInfo.h"
 #include "DDraw/Blitter.h"
 
-#pragma warning(disable : 4127)
-
 namespace
 {
 	Compat::CriticalSection g_overlappingBltCs;
@@ -104,17 +115,6 @@ namespace
 		return vec;
 	}
 
-	template <int pixelsPerVector, int count>
-	__forceinline void loadSrcVectorRemainder(__m128i& vec1, __m128i& vec2,
-		const BYTE*& src, int& offset, int delta, std::integral_constant<int, count>)
-	{
-		vec1 = _mm_insert_epi16(vec1, *(src + (offset >> 16)), (pixelsPerVector - count) / 2);
-		offset += delta;
-		vec2 = _mm_insert_epi16(vec2, *(src + (offset >> 16)), (pixelsPerVector - count) / 2);
-		offset += delta;
-		loadSrcVectorRemainder<pixelsPerVector>(vec1, vec2, src, offset, delta, std::integral_constant<int, count - 2>());
-	}
-
 	template <int pixelsPerVector>
 	__forceinline void loadSrcVectorRemainder(__m128i& vec1, __m128i& vec2,
 		const BYTE*& src, int& offset, int delta, std::integral_constant<int, 1> /*count*/)
@@ -135,6 +135,17 @@ namespace
 	{
 	}
 
+	template <int pixelsPerVector, int count>
+	__forceinline void loadSrcVectorRemainder(__m128i& vec1, __m128i& vec2,
+		const BYTE*& src, int& offset, int delta, std::integral_constant<int, count>)
+	{
+		vec1 = _mm_insert_epi16(vec1, *(src + (offset >> 16)), (pixelsPerVector - count) / 2);
+		offset += delta;
+		vec2 = _mm_insert_epi16(vec2, *(src + (offset >> 16)), (pixelsPerVector - count) / 2);
+		offset += delta;
+		loadSrcVectorRemainder<pixelsPerVector>(vec1, vec2, src, offset, delta, std::integral_constant<int, count - 2>());
+	}
+
 	template <int pixelsPerVector, int count>
 	__forceinline void loadSrcVectorRemainder(__m128i& vec,
 		const BYTE* src, int& offset, int delta, std::integral_constant<int, count>)
@@ -146,6 +157,12 @@ namespace
 		vec = _mm_or_si128(vec, vec2);
 	}
 
+	template <int pixelsPerVector>
+	__forceinline void loadSrcVectorRemainder(__m128i& /*vec*/,
+		const WORD* /*src*/, int& /*offset*/, int /*delta*/, std::integral_constant<int, 0> /*count*/)
+	{
+	}
+
 	template <int pixelsPerVector, int count>
 	__forceinline typename std::enable_if<0 != count>::type loadSrcVectorRemainder(__m128i& vec,
 		const WORD* src, int& offset, int delta, std::integral_constant<int, count>)
@@ -157,7 +174,7 @@ namespace
 
 	template <int pixelsPerVector>
 	__forceinline void loadSrcVectorRemainder(__m128i& /*vec*/,
-		const WORD* /*src*/, int& /*offset*/, int /*delta*/, std::integral_constant<int, 0> /*count*/)
+		const DWORD* /*src*/, int& /*offset*/, int /*delta*/, std::integral_constant<int, 0> /*count*/)
 	{
 	}
 
@@ -172,12 +189,6 @@ namespace
 		loadSrcVectorRemainder<pixelsPerVector>(vec, src, offset, delta, std::integral_constant<int, count - 1>());
 	}
 
-	template <int pixelsPerVector>
-	__forceinline void loadSrcVectorRemainder(__m128i& /*vec*/,
-		const DWORD* /*src*/, int& /*offset*/, int /*delta*/, std::integral_constant<int, 0> /*count*/)
-	{
-	}
-
 	template <int vectorSize, bool stretch, bool mirror, typename Pixel>
 	__forceinline __m128i loadSrcVector(const Pixel*& src, int& offset, int delta)
 	{
@@ -384,7 +395,7 @@ namespace
 		{
 			bltVectorRow<vectorSize, stretch, mirror, useDstColorKey, useSrcColorKey>(
 				reinterpret_cast<Pixel*>(dst),
-				reinterpret_cast<const Pixel*>(src + (offsetY >> 16) * srcPitch),
+				reinterpret_cast<const Pixel*>(src + (offsetY >> 16) * static_cast<int>(srcPitch)),
 				dstWidth, offsetX, deltaX, dstColorKey, srcColorKey);
 			dst += dstPitch;
 			offsetY += deltaY;
@@ -485,7 +496,7 @@ namespace
 							for (int useSrcColorKey = 0; useSrcColorKey <= 1; ++useSrcColorKey)
 							{
 								vectorizedBltFuncs[bytesPerPixel - 1][width][stretch][mirror][useDstColorKey][useSrcColorKey] =
-									getVectorizedBltFunc(bytesPerPixel, static_cast<DWORD>(pow(2, width)),
+									getVectorizedBltFunc(bytesPerPixel, 1u << width,
 										stretch, mirror, useDstColorKey, useSrcColorKey);
 							}
 						}
@@ -498,6 +509,371 @@ namespace
 
 	const auto g_vectorizedBltFuncs(getVectorizedBltFuncs());
 
+	template <int n> AVX2_TARGET __m256i _mm256_cmpeq_epi(__m256i a, __m256i b);
+	template <> AVX2_TARGET __m256i _mm256_cmpeq_epi<8>(__m256i a, __m256i b) { return _mm256_cmpeq_epi8(a, b); }
+	template <> AVX2_TARGET __m256i _mm256_cmpeq_epi<16>(__m256i a, __m256i b) { return _mm256_cmpeq_epi16(a, b); }
+	template <> AVX2_TARGET __m256i _mm256_cmpeq_epi<32>(__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); }
+
+	template <int n> AVX2_TARGET __m256i _mm256_set1_epi(DWORD a);
+	template <> AVX2_TARGET __m256i _mm256_set1_epi<8>(DWORD a) { return _mm256_set1_epi8(static_cast<uint8_t>(a)); }
+	template <> AVX2_TARGET __m256i _mm256_set1_epi<16>(DWORD a) { return _mm256_set1_epi16(static_cast<uint16_t>(a)); }
+	template <> AVX2_TARGET __m256i _mm256_set1_epi<32>(DWORD a) { return _mm256_set1_epi32(a); }
+
+	bool isAvx2Supported()
+	{
+#ifndef _MSC_VER
+		return __builtin_cpu_supports("avx2");
+#else
+		int cpuInfo[4] = {};
+		__cpuid(cpuInfo, 0);
+		if (cpuInfo[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuid(cpuInfo, 1);
+		const int osXSave = 1 << 27;
+		const int avx = 1 << 28;
+		if ((cpuInfo[2] & (osXSave | avx)) != (osXSave | avx) ||
+			(_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+
+		__cpuidex(cpuInfo, 7, 0);
+		const int avx2 = 1 << 5;
+		return 0 != (cpuInfo[1] & avx2);
+#endif
+	}
+
+	template <typename Pixel>
+	AVX2_TARGET __forceinline __m256i reverseVector(__m256i vec)
+	{
+		if (4 == sizeof(Pixel))
+		{
+			return _mm256_permutevar8x32_epi32(vec, _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		}
+
+		const __m256i mask = 2 == sizeof(Pixel)
+			? _mm256_set_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+				1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)
+			: _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+				0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		vec = _mm256_shuffle_epi8(vec, mask);
+		return _mm256_permute4x64_epi64(vec, _MM_SHUFFLE(1, 0, 3, 2));
+	}
+
+	AVX2_TARGET __forceinline __m256i loadStretchedSrcVector(const DWORD* src, int& offset, int delta)
+	{
+		const __m256i offsets = _mm256_add_epi32(_mm256_set1_epi32(offset),
+			_mm256_setr_epi32(0, delta, 2 * delta, 3 * delta, 4 * delta, 5 * delta, 6 * delta, 7 * delta));
+		offset += 8 * delta;
+		return _mm256_i32gather_epi32(reinterpret_cast<const int*>(src), _mm256_srai_epi32(offsets, 16), 4);
+	}
+
+	template <typename Pixel>
+	AVX2_TARGET __forceinline __m256i loadStretchedSrcVector(const Pixel* src, int& offset, int delta)
+	{
+		const __m128i low = loadSrcVector<16, true, false>(src, offset, delta);
+		const __m128i high = loadSrcVector<16, true, false>(src, offset, delta);
+		return _mm256_set_m128i(high, low);
+	}
+
+	template <bool stretch, bool mirror, typename Pixel>
+	AVX2_TARGET __forceinline __m256i loadSrcVectorAvx2(const Pixel*& src, int& offset, int delta)
+	{
+		if (stretch)
+		{
+			return loadStretchedSrcVector(src, offset, delta);
+		}
+
+		const int pixelsPerVector = 32 / sizeof(Pixel);
+		__m256i vec = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+		if (mirror)
+		{
+			vec = reverseVector<Pixel>(vec);
+			src -= pixelsPerVector;
+		}
+		else
+		{
+			src += pixelsPerVector;
+		}
+		return vec;
+	}
+
+	template <typename Pixel>
+	AVX2_TARGET __forceinline __m256i compareColorKey(__m256i vec, DWORD colorKey)
+	{
+		__m256i colorKeyVec = _mm256_set1_epi<sizeof(Pixel) * 8>(colorKey);
+		if (4 == sizeof(Pixel))
+		{
+			__m256i colorKeyMask = _mm256_set1_epi<sizeof(Pixel) * 8>(0x00FFFFFF);
+			vec = _mm256_and_si256(vec, colorKeyMask);
+		}
+		return _mm256_cmpeq_epi<sizeof(Pixel) * 8>(vec, colorKeyVec);
+	}
+
+	template <typename Pixel, bool useDstColorKey, bool useSrcColorKey>
+	AVX2_TARGET __forceinline __m256i bltVector(__m256i dst, __m256i src, DWORD dstColorKey, DWORD srcColorKey)
+	{
+		if (useDstColorKey && useSrcColorKey)
+		{
+			__m256i maskDst = compareColorKey<Pixel>(dst, dstColorKey);
+			__m256i maskSrc = compareColorKey<Pixel>(src, srcColorKey);
+			__m256i mask = _mm256_andnot_si256(maskSrc, maskDst);
+			return _mm256_blendv_epi8(dst, src, mask);
+		}
+		else if (useDstColorKey)
+		{
+			return _mm256_blendv_epi8(dst, src, compareColorKey<Pixel>(dst, dstColorKey));
+		}
+		else if (useSrcColorKey)
+		{
+			return _mm256_blendv_epi8(src, dst, compareColorKey<Pixel>(src, srcColorKey));
+		}
+		else
+		{
+			return src;
+		}
+	}
+
+	template <bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey, typename Pixel>
+	AVX2_TARGET __forceinline void bltVectorAvx2(Pixel*& dst, const Pixel*& src, int& offset, int delta,
+		DWORD dstColorKey, DWORD srcColorKey)
+	{
+		__m256i s = loadSrcVectorAvx2<stretch, mirror>(src, offset, delta);
+		__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+		d = bltVector<Pixel, useDstColorKey, useSrcColorKey>(d, s, dstColorKey, srcColorKey);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), d);
+		dst += 32 / sizeof(Pixel);
+	}
+
+	template <bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey, typename Pixel>
+	AVX2_TARGET __forceinline void bltVectorRowAvx2(Pixel* dst, const Pixel* src, DWORD width, int offset, int delta,
+		DWORD dstColorKey, DWORD srcColorKey)
+	{
+		const int pixelsPerVector = 32 / sizeof(Pixel);
+
+		for (DWORD i = width / pixelsPerVector - 1; i != 0; --i)
+		{
+			bltVectorAvx2<stretch, mirror, useDstColorKey, useSrcColorKey>(
+				dst, src, offset, delta, dstColorKey, srcColorKey);
+		}
+
+		const DWORD remainder = width % pixelsPerVector;
+		auto src1 = src;
+		auto offset1 = offset;
+		__m256i s1 = loadSrcVectorAvx2<stretch, mirror>(src1, offset1, delta);
+		if (stretch)
+		{
+			offset += remainder * delta;
+		}
+		else if (mirror)
+		{
+			src -= remainder;
+		}
+		else
+		{
+			src += remainder;
+		}
+		__m256i s2 = loadSrcVectorAvx2<stretch, mirror>(src, offset, delta);
+		__m256i d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+		__m256i d2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + remainder));
+		d1 = bltVector<Pixel, useDstColorKey, useSrcColorKey>(d1, s1, dstColorKey, srcColorKey);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), d1);
+		d2 = bltVector<Pixel, useDstColorKey, useSrcColorKey>(d2, s2, dstColorKey, srcColorKey);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + remainder), d2);
+	}
+
+	template <typename Pixel, bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey>
+	AVX2_TARGET __forceinline std::enable_if_t<3 != sizeof(Pixel)> vectorizedBltAvx2(
+		BYTE* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight,
+		const BYTE* src, DWORD srcPitch, int offsetX, int deltaX, int offsetY, int deltaY,
+		DWORD dstColorKey, DWORD srcColorKey)
+	{
+		if (!stretch && mirror)
+		{
+			src -= 32 - sizeof(Pixel);
+		}
+
+		for (DWORD i = dstHeight; i != 0; --i)
+		{
+			bltVectorRowAvx2<stretch, mirror, useDstColorKey, useSrcColorKey>(
+				reinterpret_cast<Pixel*>(dst),
+				reinterpret_cast<const Pixel*>(src + (offsetY >> 16) * static_cast<int>(srcPitch)),
+				dstWidth, offsetX, deltaX, dstColorKey, srcColorKey);
+			dst += dstPitch;
+			offsetY += deltaY;
+		}
+
+		_mm256_zeroupper();
+	}
+
+	template <typename Pixel, bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey>
+	AVX2_TARGET __forceinline std::enable_if_t<3 == sizeof(Pixel)> vectorizedBltAvx2(
+		BYTE* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight,
+		const BYTE* src, DWORD srcPitch, int offsetX, int deltaX, int offsetY, int deltaY,
+		DWORD dstColorKey, DWORD srcColorKey)
+	{
+		if (!stretch && !mirror && !useDstColorKey && !useSrcColorKey)
+		{
+			vectorizedBltAvx2<BYTE, false, false, false, false>(dst, dstPitch, dstWidth * 3, dstHeight,
+				src, srcPitch, offsetX, deltaX, offsetY, deltaY, dstColorKey, srcColorKey);
+		}
+		else
+		{
+			vectorizedBlt<Pixel, 16, stretch, mirror, useDstColorKey, useSrcColorKey>(
+				dst, dstPitch, dstWidth, dstHeight,
+				src, srcPitch, offsetX, deltaX, offsetY, deltaY, dstColorKey, srcColorKey);
+		}
+	}
+
+	template <typename Pixel, bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey>
+	AVX2_TARGET void vectorizedBltFuncAvx2(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight,
+		const void* src, DWORD srcPitch, int offsetX, int deltaX, int offsetY, int deltaY,
+		DWORD dstColorKey, DWORD srcColorKey)
+	{
+		vectorizedBltAvx2<Pixel, stretch, mirror, useDstColorKey, useSrcColorKey>(
+			static_cast<BYTE*>(dst), dstPitch, dstWidth, dstHeight,
+			static_cast<const BYTE*>(src), srcPitch, offsetX, deltaX, offsetY, deltaY, dstColorKey, srcColorKey);
+	}
+
+	template <typename Pixel, bool stretch, bool mirror, bool useDstColorKey>
+	auto getVectorizedBltFuncAvx2(bool useSrcColorKey)
+	{
+		return useSrcColorKey
+			? &vectorizedBltFuncAvx2<Pixel, stretch, mirror, useDstColorKey, true>
+			: &vectorizedBltFuncAvx2<Pixel, stretch, mirror, useDstColorKey, false>;
+	}
+
+	template <typename Pixel, bool stretch, bool mirror>
+	auto getVectorizedBltFuncAvx2(bool useDstColorKey, bool useSrcColorKey)
+	{
+		return useDstColorKey
+			? getVectorizedBltFuncAvx2<Pixel, stretch, mirror, true>(useSrcColorKey)
+			: getVectorizedBltFuncAvx2<Pixel, stretch, mirror, false>(useSrcColorKey);
+	}
+
+	template <typename Pixel, bool stretch>
+	auto getVectorizedBltFuncAvx2(bool mirror, bool useDstColorKey, bool useSrcColorKey)
+	{
+		return mirror
+			? getVectorizedBltFuncAvx2<Pixel, stretch, true>(useDstColorKey, useSrcColorKey)
+			: getVectorizedBltFuncAvx2<Pixel, stretch, false>(useDstColorKey, useSrcColorKey);
+	}
+
+	template <typename Pixel>
+	auto getVectorizedBltFuncAvx2(bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey)
+	{
+		return stretch
+			? getVectorizedBltFuncAvx2<Pixel, true>(mirror, useDstColorKey, useSrcColorKey)
+			: getVectorizedBltFuncAvx2<Pixel, false>(mirror, useDstColorKey, useSrcColorKey);
+	}
+
+	auto getVectorizedBltFuncAvx2(DWORD bytesPerPixel,
+		bool stretch, bool mirror, bool useDstColorKey, bool useSrcColorKey)
+	{
+		switch (bytesPerPixel)
+		{
+		case 4: return getVectorizedBltFuncAvx2<DWORD>(stretch, mirror, useDstColorKey, useSrcColorKey);
+		case 3: return getVectorizedBltFuncAvx2<UInt24>(stretch, mirror, useDstColorKey, useSrcColorKey);
+		case 2: return getVectorizedBltFuncAvx2<WORD>(stretch, mirror, useDstColorKey, useSrcColorKey);
+		default: return getVectorizedBltFuncAvx2<BYTE>(stretch, mirror, useDstColorKey, useSrcColorKey);
+		}
+	}
+
+	auto getVectorizedBltFuncsAvx2()
+	{
+		typename MultiDimArray<decltype(&vectorizedBltFunc<BYTE, 1, false, false, false, false>), 4, 2, 2, 2, 2>::type vectorizedBltFuncs = {};
+		if (!isAvx2Supported())
+		{
+			return vectorizedBltFuncs;
+		}
+
+		for (int bytesPerPixel = 1; bytesPerPixel <= 4; ++bytesPerPixel)
+		{
+			for (int stretch = 0; stretch <= 1; ++stretch)
+			{
+				for (int mirror = 0; mirror <= 1; ++mirror)
+				{
+					for (int useDstColorKey = 0; useDstColorKey <= 1; ++useDstColorKey)
+					{
+						for (int useSrcColorKey = 0; useSrcColorKey <= 1; ++useSrcColorKey)
+						{
+							vectorizedBltFuncs[bytesPerPixel - 1][stretch][mirror][useDstColorKey][useSrcColorKey] =
+								getVectorizedBltFuncAvx2(bytesPerPixel, stretch, mirror, useDstColorKey, useSrcColorKey);
+						}
+					}
+				}
+			}
+		}
+		return vectorizedBltFuncs;
+	}
+
+	const auto g_vectorizedBltFuncsAvx2(getVectorizedBltFuncsAvx2());
+
+	AVX2_TARGET void expandPaletteRowAvx2(DWORD* dst, const BYTE* src, DWORD width, const DWORD* colorTable)
+	{
+		DWORD x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			const __m256i indexes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x),
+				_mm256_i32gather_epi32(reinterpret_cast<const int*>(colorTable), indexes, 4));
+		}
+
+		for (; x < width; ++x)
+		{
+			dst[x] = colorTable[src[x]];
+		}
+
+		_mm256_zeroupper();
+	}
+
+	void expandPaletteRow(DWORD* dst, const BYTE* src, DWORD width, const DWORD* colorTable)
+	{
+		DWORD x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			DWORD indexes = 0;
+			memcpy(&indexes, src + x, sizeof(indexes));
+			dst[x] = colorTable[indexes & 0xFF];
+			dst[x + 1] = colorTable[(indexes >> 8) & 0xFF];
+			dst[x + 2] = colorTable[(indexes >> 16) & 0xFF];
+			dst[x + 3] = colorTable[indexes >> 24];
+		}
+
+		for (; x < width; ++x)
+		{
+			dst[x] = colorTable[src[x]];
+		}
+	}
+
+	template <typename Func>
+	void runStriped(DWORD dstHeight, DWORD dstByteWidth, Func func)
+	{
+		unsigned stripeCount = 1;
+		if (dstByteWidth * dstHeight >= Config::minStripedBltSize)
+		{
+			stripeCount = std::min(Compat::WorkerPool::getConcurrency(), Config::maxStripedBltThreads);
+			stripeCount = std::min<unsigned>(stripeCount, dstHeight / Config::minStripedBltStripeHeight);
+		}
+
+		if (stripeCount <= 1)
+		{
+			func(0, dstHeight);
+			return;
+		}
+
+		auto stripeFunc = [&](unsigned index)
+		{
+			const DWORD firstRow = dstHeight * index / stripeCount;
+			const DWORD endRow = dstHeight * (index + 1) / stripeCount;
+			func(firstRow, endRow - firstRow);
+		};
+		Compat::WorkerPool::parallelFor(stripeCount, stripeFunc);
+	}
+
 	bool doOverlappingBlt(BYTE* dst, DWORD pitch, DWORD dstWidth, DWORD dstHeight,
 		const BYTE* src, LONG srcWidth, LONG srcHeight,
 		DWORD bytesPerPixel, const DWORD* dstColorKey, const DWORD* srcColorKey)
@@ -648,8 +1024,21 @@ namespace
 		[nullptr != dstColorKey]
 		[nullptr != srcColorKey];
 
-		vectorizedBltFunc(dst, dstPitch, dstWidth, dstHeight,
-			src, srcPitch, offsetX, deltaX, offsetY, deltaY, dstCk, srcCk);
+		if (dstByteWidth >= 32 && g_vectorizedBltFuncsAvx2[0][0][0][0][0])
+		{
+			vectorizedBltFunc = g_vectorizedBltFuncsAvx2
+				[bytesPerPixel - 1]
+			[dstWidth != absSrcWidth]
+			[mirrorLeftRight]
+			[nullptr != dstColorKey]
+			[nullptr != srcColorKey];
+		}
+
+		runStriped(dstHeight, dstByteWidth, [&](DWORD firstRow, DWORD rowCount)
+			{
+				vectorizedBltFunc(dst + firstRow * dstPitch, dstPitch, dstWidth, rowCount,
+					src, srcPitch, offsetX, deltaX, offsetY + static_cast<int>(firstRow) * deltaY, deltaY, dstCk, srcCk);
+			});
 	}
 
 	template <typename Pixel>
@@ -678,6 +1067,432 @@ namespace
 			dst += dstPitch;
 		}
 	}
+
+	struct ChannelInfo
+	{
+		BYTE pos;
+		BYTE bitCount;
+	};
+
+	std::array<ChannelInfo, 4> getChannelInfos(const D3dDdi::FormatInfo& fi)
+	{
+		return { { { fi.bluePos, fi.blueBitCount }, { fi.greenPos, fi.greenBitCount },
+			{ fi.redPos, fi.redBitCount }, { fi.alphaPos, fi.alphaBitCount } } };
+	}
+
+	bool isCanonicalFormat(const D3dDdi::FormatInfo& fi)
+	{
+		return 4 == fi.bytesPerPixel &&
+			8 == fi.redBitCount && 16 == fi.redPos &&
+			8 == fi.greenBitCount && 8 == fi.greenPos &&
+			8 == fi.blueBitCount && 0 == fi.bluePos &&
+			(0 == fi.alphaBitCount || 24 == fi.alphaPos);
+	}
+
+	class FormatConverter
+	{
+	public:
+		FormatConverter(const D3dDdi::FormatInfo& formatInfo)
+			: m_bytesPerPixel(formatInfo.bytesPerPixel)
+			, m_missingAlpha(_mm_set1_epi32(0 == formatInfo.alphaBitCount ? 0xFF000000 : 0))
+		{
+			const auto channels = getChannelInfos(formatInfo);
+			for (unsigned i = 0; i < 4; ++i)
+			{
+				const DWORD bitCount = channels[i].bitCount;
+				const int shift = static_cast<int>(i * 8 + 8 - bitCount) - channels[i].pos;
+				m_bitCounts[i] = bitCount;
+				m_formatMasks[i] = _mm_set1_epi32(((1u << bitCount) - 1) << channels[i].pos);
+				m_canonicalMasks[i] = _mm_set1_epi32(((1u << bitCount) - 1) << (i * 8 + 8 - bitCount));
+				m_byteMasks[i] = _mm_set1_epi32(0xFFu << (i * 8));
+				m_leftShifts[i] = _mm_cvtsi32_si128(std::max(shift, 0));
+				m_rightShifts[i] = _mm_cvtsi32_si128(std::max(-shift, 0));
+			}
+		}
+
+		void expandRow(DWORD* dst, const BYTE* src, DWORD width) const
+		{
+			DWORD x = 0;
+			if (4 == m_bytesPerPixel)
+			{
+				for (; x + 4 <= width; x += 4)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+						expand(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4))));
+				}
+				for (; x < width; ++x)
+				{
+					dst[x] = _mm_cvtsi128_si32(expand(_mm_loadu_si32(src + x * 4)));
+				}
+			}
+			else
+			{
+				const __m128i zero = _mm_setzero_si128();
+				for (; x + 4 <= width; x += 4)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+						expand(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x * 2)), zero)));
+				}
+				for (; x < width; ++x)
+				{
+					dst[x] = _mm_cvtsi128_si32(expand(_mm_cvtsi32_si128(reinterpret_cast<const WORD*>(src)[x])));
+				}
+			}
+		}
+
+		void packRow(BYTE* dst, const DWORD* src, DWORD width) const
+		{
+			DWORD x = 0;
+			if (4 == m_bytesPerPixel)
+			{
+				for (; x + 4 <= width; x += 4)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),
+						pack(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x))));
+				}
+				for (; x < width; ++x)
+				{
+					reinterpret_cast<DWORD*>(dst)[x] = _mm_cvtsi128_si32(pack(_mm_cvtsi32_si128(src[x])));
+				}
+			}
+			else
+			{
+				for (; x + 4 <= width; x += 4)
+				{
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 2),
+						packTo16(pack(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)))));
+				}
+				for (; x < width; ++x)
+				{
+					reinterpret_cast<WORD*>(dst)[x] = static_cast<WORD>(
+						_mm_cvtsi128_si32(packTo16(pack(_mm_cvtsi32_si128(src[x])))));
+				}
+			}
+		}
+
+	private:
+		__m128i expand(__m128i pixels) const
+		{
+			__m128i result = m_missingAlpha;
+			for (unsigned i = 0; i < 4; ++i)
+			{
+				__m128i channel = _mm_and_si128(pixels, m_formatMasks[i]);
+				channel = _mm_srl_epi32(_mm_sll_epi32(channel, m_leftShifts[i]), m_rightShifts[i]);
+				for (DWORD replicated = m_bitCounts[i]; 0 != replicated && replicated < 8; replicated *= 2)
+				{
+					channel = _mm_or_si128(channel,
+						_mm_and_si128(_mm_srl_epi32(channel, _mm_cvtsi32_si128(replicated)), m_byteMasks[i]));
+				}
+				result = _mm_or_si128(result, channel);
+			}
+			return result;
+		}
+
+		__m128i pack(__m128i pixels) const
+		{
+			__m128i result = _mm_setzero_si128();
+			for (unsigned i = 0; i < 4; ++i)
+			{
+				__m128i channel = _mm_and_si128(pixels, m_canonicalMasks[i]);
+				channel = _mm_sll_epi32(_mm_srl_epi32(channel, m_leftShifts[i]), m_rightShifts[i]);
+				result = _mm_or_si128(result, channel);
+			}
+			return result;
+		}
+
+		static __m128i packTo16(__m128i pixels)
+		{
+			const __m128i bias = _mm_set1_epi32(0x8000);
+			pixels = _mm_sub_epi32(pixels, bias);
+			return _mm_add_epi16(_mm_packs_epi32(pixels, pixels), _mm_set1_epi16(-0x8000));
+		}
+
+		DWORD m_bytesPerPixel;
+		DWORD m_bitCounts[4];
+		__m128i m_missingAlpha;
+		__m128i m_formatMasks[4];
+		__m128i m_canonicalMasks[4];
+		__m128i m_byteMasks[4];
+		__m128i m_leftShifts[4];
+		__m128i m_rightShifts[4];
+	};
+
+	struct FilterTap
+	{
+		DWORD index;
+		DWORD count;
+		DWORD weight;
+	};
+
+	struct FilterParams
+	{
+		BYTE* dst;
+		DWORD dstPitch;
+		DWORD dstWidth;
+		const D3dDdi::FormatInfo& dstFormatInfo;
+		const BYTE* src;
+		DWORD srcPitch;
+		DWORD srcWidth;
+		DWORD srcHeight;
+		const D3dDdi::FormatInfo& srcFormatInfo;
+		DDraw::Blitter::Filter filter;
+		std::vector<FilterTap> xTaps;
+		std::vector<FilterTap> yTaps;
+	};
+
+	class SrcRowReader
+	{
+	public:
+		SrcRowReader(const FilterParams& params)
+			: m_params(params)
+			, m_converter(params.srcFormatInfo)
+			, m_isDirect(isCanonicalFormat(params.srcFormatInfo) &&
+				(0 != params.srcFormatInfo.alphaBitCount || 0 == params.dstFormatInfo.alphaBitCount))
+			, m_rowIndex{ MAXDWORD, MAXDWORD }
+		{
+			if (!m_isDirect)
+			{
+				m_rows[0].resize(params.srcWidth);
+				m_rows[1].resize(params.srcWidth);
+			}
+		}
+
+		const DWORD* getRow(DWORD y)
+		{
+			const BYTE* src = m_params.src + y * m_params.srcPitch;
+			if (m_isDirect)
+			{
+				return reinterpret_cast<const DWORD*>(src);
+			}
+
+			const DWORD slot = y & 1;
+			if (m_rowIndex[slot] != y)
+			{
+				m_converter.expandRow(m_rows[slot].data(), src, m_params.srcWidth);
+				m_rowIndex[slot] = y;
+			}
+			return m_rows[slot].data();
+		}
+
+	private:
+		const FilterParams& m_params;
+		const FormatConverter m_converter;
+		const bool m_isDirect;
+		std::vector<DWORD> m_rows[2];
+		DWORD m_rowIndex[2];
+	};
+
+	std::vector<FilterTap> getFilterTaps(DDraw::Blitter::Filter filter, DWORD srcSize, DWORD dstSize)
+	{
+		std::vector<FilterTap> taps(dstSize);
+		const DWORD delta = static_cast<DWORD>((static_cast<long long>(srcSize) << 16) / dstSize);
+		for (DWORD i = 0; i < dstSize; ++i)
+		{
+			auto& tap = taps[i];
+			switch (filter)
+			{
+			case DDraw::Blitter::FILTER_POINT:
+				tap.index = static_cast<DWORD>((delta / 2 + i * static_cast<long long>(delta)) >> 16);
+				tap.count = 1;
+				tap.weight = 0;
+				break;
+
+			case DDraw::Blitter::FILTER_BILINEAR:
+			{
+				const long long pos = std::max<long long>(
+					((2 * i + 1) * static_cast<long long>(srcSize) << 15) / dstSize - 0x8000, 0);
+				tap.index = static_cast<DWORD>(pos >> 16);
+				tap.count = 2;
+				tap.weight = static_cast<DWORD>(pos >> 8) & 0xFF;
+				if (tap.index >= srcSize - 1)
+				{
+					tap.index = srcSize - 1;
+					tap.weight = 0;
+				}
+				break;
+			}
+
+			case DDraw::Blitter::FILTER_BOX:
+			{
+				const DWORD end = static_cast<DWORD>((i + 1) * static_cast<long long>(srcSize) / dstSize);
+				tap.index = static_cast<DWORD>(i * static_cast<long long>(srcSize) / dstSize);
+				tap.count = std::max(end, tap.index + 1) - tap.index;
+				tap.weight = 0;
+				break;
+			}
+			}
+		}
+		return taps;
+	}
+
+	void pointColumns(DWORD* dst, const DWORD* row, const std::vector<FilterTap>& taps)
+	{
+		for (DWORD x = 0; x < taps.size(); ++x)
+		{
+			dst[x] = row[taps[x].index];
+		}
+	}
+
+	__forceinline __m128i lerpVector(__m128i a, __m128i b, __m128i weightA, __m128i weightB)
+	{
+		return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, weightA), _mm_mullo_epi16(b, weightB)), 8);
+	}
+
+	void lerpRows(DWORD* dst, const DWORD* row0, const DWORD* row1, DWORD width, DWORD weight)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i weight0 = _mm_set1_epi16(static_cast<short>(256 - weight));
+		const __m128i weight1 = _mm_set1_epi16(static_cast<short>(weight));
+
+		DWORD x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x));
+			const __m128i lo = lerpVector(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), weight0, weight1);
+			const __m128i hi = lerpVector(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), weight0, weight1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+		}
+
+		for (; x < width; ++x)
+		{
+			const __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(row0[x]), zero);
+			const __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(row1[x]), zero);
+			dst[x] = _mm_cvtsi128_si32(_mm_packus_epi16(lerpVector(a, b, weight0, weight1), zero));
+		}
+	}
+
+	__forceinline __m128i lerpPixelPair(const DWORD* row, const FilterTap& tap)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i weights = _mm_cvtsi32_si128((tap.weight << 16) | (256 - tap.weight));
+		weights = _mm_unpacklo_epi16(weights, weights);
+		weights = _mm_unpacklo_epi32(weights, weights);
+		return _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + tap.index)), zero), weights);
+	}
+
+	void lerpColumns(DWORD* dst, const DWORD* row, const std::vector<FilterTap>& taps)
+	{
+		const DWORD width = taps.size();
+		DWORD x = 0;
+		for (; x + 2 <= width; x += 2)
+		{
+			const __m128i a = lerpPixelPair(row, taps[x]);
+			const __m128i b = lerpPixelPair(row, taps[x + 1]);
+			const __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b)), 8);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum, sum));
+		}
+
+		if (x < width)
+		{
+			const __m128i a = lerpPixelPair(row, taps[x]);
+			const __m128i sum = _mm_srli_epi16(_mm_add_epi16(a, _mm_srli_si128(a, 8)), 8);
+			dst[x] = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+		}
+	}
+
+	void accumulateRow(DWORD* accumulator, const DWORD* row, DWORD width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		auto accumulate = [&](DWORD x, __m128i pixel)
+		{
+			__m128i* acc = reinterpret_cast<__m128i*>(accumulator + x * 4);
+			_mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), pixel));
+		};
+
+		DWORD x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+			const __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+			const __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+			accumulate(x, _mm_unpacklo_epi16(lo, zero));
+			accumulate(x + 1, _mm_unpackhi_epi16(lo, zero));
+			accumulate(x + 2, _mm_unpacklo_epi16(hi, zero));
+			accumulate(x + 3, _mm_unpackhi_epi16(hi, zero));
+		}
+
+		for (; x < width; ++x)
+		{
+			accumulate(x, _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(row[x]), zero), zero));
+		}
+	}
+
+	void averageColumns(DWORD* dst, const DWORD* accumulator, const std::vector<FilterTap>& taps, DWORD rowCount)
+	{
+		for (DWORD x = 0; x < taps.size(); ++x)
+		{
+			const DWORD* acc = accumulator + taps[x].index * 4;
+			__m128i sum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc));
+			for (DWORD i = 1; i < taps[x].count; ++i)
+			{
+				sum = _mm_add_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i * 4)));
+			}
+
+			const __m128 scale = _mm_set1_ps(1.0f / (taps[x].count * rowCount));
+			__m128i avg = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale));
+			avg = _mm_packs_epi32(avg, avg);
+			dst[x] = _mm_cvtsi128_si32(_mm_packus_epi16(avg, avg));
+		}
+	}
+
+	void filterRows(const FilterParams& params, DWORD firstRow, DWORD rowCount)
+	{
+		SrcRowReader reader(params);
+		const FormatConverter dstConverter(params.dstFormatInfo);
+		const bool isDstDirect = isCanonicalFormat(params.dstFormatInfo);
+		std::vector<DWORD> row(DDraw::Blitter::FILTER_BILINEAR == params.filter ? params.srcWidth + 1 : 0);
+		std::vector<DWORD> accumulator(DDraw::Blitter::FILTER_BOX == params.filter ? params.srcWidth * 4 : 0);
+		std::vector<DWORD> dstRow(isDstDirect ? 0 : params.dstWidth);
+
+		for (DWORD y = firstRow; y < firstRow + rowCount; ++y)
+		{
+			BYTE* dst = params.dst + y * params.dstPitch;
+			DWORD* out = isDstDirect ? reinterpret_cast<DWORD*>(dst) : dstRow.data();
+			const DWORD* filtered = out;
+			const auto& tap = params.yTaps[y];
+
+			switch (params.filter)
+			{
+			case DDraw::Blitter::FILTER_POINT:
+				if (params.srcWidth == params.dstWidth)
+				{
+					filtered = reader.getRow(tap.index);
+				}
+				else
+				{
+					pointColumns(out, reader.getRow(tap.index), params.xTaps);
+				}
+				break;
+
+			case DDraw::Blitter::FILTER_BILINEAR:
+				lerpRows(row.data(), reader.getRow(tap.index),
+					reader.getRow(std::min(tap.index + 1, params.srcHeight - 1)), params.srcWidth, tap.weight);
+				row[params.srcWidth] = row[params.srcWidth - 1];
+				lerpColumns(out, row.data(), params.xTaps);
+				break;
+
+			case DDraw::Blitter::FILTER_BOX:
+				std::fill(accumulator.begin(), accumulator.end(), 0);
+				for (DWORD i = 0; i < tap.count; ++i)
+				{
+					accumulateRow(accumulator.data(), reader.getRow(tap.index + i), params.srcWidth);
+				}
+				averageColumns(out, accumulator.data(), params.xTaps, tap.count);
+				break;
+			}
+
+			if (!isDstDirect)
+			{
+				dstConverter.packRow(dst, filtered, params.dstWidth);
+			}
+			else if (filtered != out)
+			{
+				memcpy(out, filtered, params.dstWidth * sizeof(DWORD));
+			}
+		}
+	}
+
 }
 
 namespace DDraw
@@ -693,15 +1508,61 @@ namespace DDraw
 				bytesPerPixel, dstColorKey, srcColorKey);
 		}
 
-		void colorFill(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight, DWORD bytesPerPixel, DWORD color)
+		void expandPalette(void* dst, DWORD dstPitch, const void* src, DWORD srcPitch,
+			DWORD width, DWORD height, const DWORD* colorTable)
+		{
+			const auto expandRow = g_vectorizedBltFuncsAvx2[0][0][0][0][0] ? &expandPaletteRowAvx2 : &expandPaletteRow;
+			runStriped(height, width * 4, [&](DWORD firstRow, DWORD rowCount)
+				{
+					for (DWORD y = firstRow; y < firstRow + rowCount; ++y)
+					{
+						expandRow(reinterpret_cast<DWORD*>(static_cast<BYTE*>(dst) + y * dstPitch),
+							static_cast<const BYTE*>(src) + y * srcPitch, width, colorTable);
+					}
+				});
+		}
+
+		void filteredBlt(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight, const D3dDdi::FormatInfo& dstFormatInfo,
+			const void* src, DWORD srcPitch, DWORD srcWidth, DWORD srcHeight, const D3dDdi::FormatInfo& srcFormatInfo,
+			Filter filter)
 		{
-			switch (bytesPerPixel)
+			if (0 == dstWidth || 0 == dstHeight || 0 == srcWidth || 0 == srcHeight)
 			{
-			case 1: return ::colorFill<BYTE>(static_cast<BYTE*>(dst), dstPitch, dstWidth, dstHeight, color);
-			case 2: return ::colorFill<WORD>(static_cast<BYTE*>(dst), dstPitch, dstWidth, dstHeight, color);
-			case 3: return ::colorFill<UInt24>(static_cast<BYTE*>(dst), dstPitch, dstWidth, dstHeight, color);
-			case 4: return ::colorFill<DWORD>(static_cast<BYTE*>(dst), dstPitch, dstWidth, dstHeight, color);
+				return;
 			}
+
+			FilterParams params = { static_cast<BYTE*>(dst), dstPitch, dstWidth, dstFormatInfo,
+				static_cast<const BYTE*>(src), srcPitch, srcWidth, srcHeight, srcFormatInfo, filter,
+				getFilterTaps(filter, srcWidth, dstWidth), getFilterTaps(filter, srcHeight, dstHeight) };
+
+			runStriped(dstHeight, dstWidth * dstFormatInfo.bytesPerPixel, [&](DWORD firstRow, DWORD rowCount)
+				{
+					filterRows(params, firstRow, rowCount);
+				});
+		}
+
+		bool isFilterSupported(const D3dDdi::FormatInfo& formatInfo)
+		{
+			return (2 == formatInfo.bytesPerPixel || 4 == formatInfo.bytesPerPixel) &&
+				0 != formatInfo.redBitCount && formatInfo.redBitCount <= 8 &&
+				0 != formatInfo.greenBitCount && formatInfo.greenBitCount <= 8 &&
+				0 != formatInfo.blueBitCount && formatInfo.blueBitCount <= 8 &&
+				formatInfo.alphaBitCount <= 8;
+		}
+
+		void colorFill(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight, DWORD bytesPerPixel, DWORD color)
+		{
+			runStriped(dstHeight, dstWidth * bytesPerPixel, [&](DWORD firstRow, DWORD rowCount)
+				{
+					BYTE* stripe = static_cast<BYTE*>(dst) + firstRow * dstPitch;
+					switch (bytesPerPixel)
+					{
+					case 1: return ::colorFill<BYTE>(stripe, dstPitch, dstWidth, rowCount, color);
+					case 2: return ::colorFill<WORD>(stripe, dstPitch, dstWidth, rowCount, color);
+					case 3: return ::colorFill<UInt24>(stripe, dstPitch, dstWidth, rowCount, color);
+					case 4: return ::colorFill<DWORD>(stripe, dstPitch, dstWidth, rowCount, color);
+					}
+				});
 		}
 	}
 }
@@ -2,13 +2,31 @@
 
 #include <Windows.h>
 
+namespace D3dDdi
+{
+	struct FormatInfo;
+}
+
 namespace DDraw
 {
 	namespace Blitter
 	{
+		enum Filter
+		{
+			FILTER_POINT,
+			FILTER_BILINEAR,
+			FILTER_BOX
+		};
+
 		void blt(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight,
 			const void* src, DWORD srcPitch, LONG srcWidth, LONG srcHeight,
 			DWORD bytesPerPixel, const DWORD* dstColorKey, const DWORD* srcColorKey);
+		void expandPalette(void* dst, DWORD dstPitch, const void* src, DWORD srcPitch,
+			DWORD width, DWORD height, const DWORD* colorTable);
+		void filteredBlt(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight, const D3dDdi::FormatInfo& dstFormatInfo,
+			const void* src, DWORD srcPitch, DWORD srcWidth, DWORD srcHeight, const D3dDdi::FormatInfo& srcFormatInfo,
+			Filter filter);
+		bool isFilterSupported(const D3dDdi::FormatInfo& formatInfo);
 		void colorFill(void* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight, DWORD bytesPerPixel, DWORD color);
 	}
 }
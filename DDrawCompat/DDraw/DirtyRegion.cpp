@@ -0,0 +1,109 @@
+#include <Config/Config.h>
+#include <DDraw/DirtyRegion.h>
+
+namespace
+{
+	ULONGLONG getArea(const RECT& rect)
+	{
+		return static_cast<ULONGLONG>(rect.right - rect.left) * (rect.bottom - rect.top);
+	}
+
+	bool contains(const RECT& outer, const RECT& inner)
+	{
+		return inner.left >= outer.left && inner.top >= outer.top &&
+			inner.right <= outer.right && inner.bottom <= outer.bottom;
+	}
+}
+
+namespace DDraw
+{
+	DirtyRegion::DirtyRegion()
+		: m_isFull(false)
+	{
+	}
+
+	void DirtyRegion::add(const RECT& rect)
+	{
+		if (m_isFull || IsRectEmpty(&rect))
+		{
+			return;
+		}
+
+		for (auto it = m_rects.begin(); it != m_rects.end();)
+		{
+			if (contains(*it, rect))
+			{
+				return;
+			}
+			it = contains(rect, *it) ? m_rects.erase(it) : it + 1;
+		}
+
+		if (m_rects.size() < Config::maxDirtyRects)
+		{
+			m_rects.push_back(rect);
+			return;
+		}
+
+		auto bestIt = m_rects.begin();
+		ULONGLONG bestGrowth = MAXULONGLONG;
+		RECT bestUnion = {};
+		for (auto it = m_rects.begin(); it != m_rects.end(); ++it)
+		{
+			RECT unionRect = {};
+			UnionRect(&unionRect, &*it, &rect);
+			const ULONGLONG growth = getArea(unionRect) - getArea(*it);
+			if (growth < bestGrowth)
+			{
+				bestIt = it;
+				bestGrowth = growth;
+				bestUnion = unionRect;
+			}
+		}
+
+		m_rects.erase(bestIt);
+		add(bestUnion);
+	}
+
+	void DirtyRegion::addAll()
+	{
+		m_rects.clear();
+		m_isFull = true;
+	}
+
+	void DirtyRegion::clear()
+	{
+		m_rects.clear();
+		m_isFull = false;
+	}
+
+	const std::vector<RECT>& DirtyRegion::getRects() const
+	{
+		return m_rects;
+	}
+
+	bool DirtyRegion::isEmpty() const
+	{
+		return !m_isFull && m_rects.empty();
+	}
+
+	bool DirtyRegion::isFull() const
+	{
+		return m_isFull;
+	}
+
+	DirtyRegion& DirtyRegion::operator|=(const DirtyRegion& other)
+	{
+		if (other.m_isFull)
+		{
+			addAll();
+		}
+		else
+		{
+			for (const auto& rect : other.m_rects)
+			{
+				add(rect);
+			}
+		}
+		return *this;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include <Windows.h>
+
+namespace DDraw
+{
+	class DirtyRegion
+	{
+	public:
+		DirtyRegion();
+
+		void add(const RECT& rect);
+		void addAll();
+		void clear();
+
+		const std::vector<RECT>& getRects() const;
+		bool isEmpty() const;
+		bool isFull() const;
+
+		DirtyRegion& operator|=(const DirtyRegion& other);
+
+	private:
+		std::vector<RECT> m_rects;
+		bool m_isFull;
+	};
+}
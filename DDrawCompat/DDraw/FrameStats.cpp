@@ -0,0 +1,209 @@
+#include <array>
+#include <atomic>
+#include <memory>
+#include <sstream>
+
+#include <Common/Log.h>
+#include <Common/Time.h>
+#include <DDraw/FrameStats.h>
+
+namespace
+{
+	const UINT RING_SIZE = 1024;
+	const UINT HISTOGRAM_BUCKET_COUNT = 50;
+
+	// Written only under the DirectDraw lock, except for qpcFlipEnd. Readers detect a slot being reused
+	// while copying it by checking frameId before and after, seqlock style.
+	struct FrameSlot
+	{
+		std::atomic<UINT> frameId;
+		std::atomic<UINT> flags;
+		std::atomic<UINT> flipInterval;
+		std::atomic<long long> qpcFlip;
+		std::atomic<long long> qpcPresentBegin;
+		std::atomic<long long> qpcPresentEnd;
+		std::atomic<long long> qpcDisplay;
+		std::atomic<long long> qpcFlipEnd;
+	};
+
+	std::array<FrameSlot, RING_SIZE> g_frames = {};
+	std::atomic<UINT> g_frameCount = 0;
+
+	FrameSlot* getFrame(UINT frameId)
+	{
+		if (0 == frameId)
+		{
+			return nullptr;
+		}
+
+		FrameSlot& frame = g_frames[frameId % RING_SIZE];
+		return frameId == frame.frameId.load(std::memory_order_relaxed) ? &frame : nullptr;
+	}
+
+	FrameSlot* getCurrentFrame()
+	{
+		return getFrame(g_frameCount.load(std::memory_order_acquire));
+	}
+
+	void logHistogramBuckets(const char* name, const std::array<UINT, HISTOGRAM_BUCKET_COUNT>& histogram)
+	{
+		Compat::Log() << "  " << name << " (ms):";
+		for (UINT i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i)
+		{
+			if (0 != histogram[i])
+			{
+				std::ostringstream bucket;
+				if (HISTOGRAM_BUCKET_COUNT - 1 == i)
+				{
+					bucket << ">= " << i;
+				}
+				else
+				{
+					bucket << i << '-' << i + 1;
+				}
+				Compat::Log() << "    " << bucket.str() << ": " << histogram[i];
+			}
+		}
+	}
+
+	void updateHistogram(std::array<UINT, HISTOGRAM_BUCKET_COUNT>& histogram, long long qpcBegin, long long qpcEnd)
+	{
+		if (0 != qpcBegin && 0 != qpcEnd && qpcEnd >= qpcBegin)
+		{
+			const long long ms = Time::qpcToMs(qpcEnd - qpcBegin);
+			++histogram[static_cast<UINT>(min(ms, static_cast<long long>(HISTOGRAM_BUCKET_COUNT - 1)))];
+		}
+	}
+}
+
+namespace DDraw
+{
+	namespace FrameStats
+	{
+		UINT getCurrentFrameId()
+		{
+			return g_frameCount.load(std::memory_order_acquire);
+		}
+
+		UINT getFrameRecords(FrameRecord* records, UINT maxCount)
+		{
+			const UINT frameCount = g_frameCount.load(std::memory_order_acquire);
+			const UINT count = min(min(frameCount, RING_SIZE), maxCount);
+			UINT recordCount = 0;
+
+			for (UINT frameId = frameCount - count + 1; frameId <= frameCount && 0 != frameId; ++frameId)
+			{
+				const FrameSlot& frame = g_frames[frameId % RING_SIZE];
+				if (frameId != frame.frameId.load(std::memory_order_acquire))
+				{
+					continue;
+				}
+
+				FrameRecord& record = records[recordCount];
+				record.frameId = frameId;
+				record.flags = frame.flags.load(std::memory_order_relaxed);
+				record.flipInterval = frame.flipInterval.load(std::memory_order_relaxed);
+				record.qpcFlip = frame.qpcFlip.load(std::memory_order_relaxed);
+				record.qpcPresentBegin = frame.qpcPresentBegin.load(std::memory_order_relaxed);
+				record.qpcPresentEnd = frame.qpcPresentEnd.load(std::memory_order_relaxed);
+				record.qpcDisplay = frame.qpcDisplay.load(std::memory_order_relaxed);
+				record.qpcFlipEnd = frame.qpcFlipEnd.load(std::memory_order_relaxed);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (frameId == frame.frameId.load(std::memory_order_relaxed))
+				{
+					++recordCount;
+				}
+			}
+
+			return recordCount;
+		}
+
+		void logHistogram()
+		{
+			std::unique_ptr<FrameRecord[]> records(new FrameRecord[RING_SIZE]);
+			const UINT recordCount = getFrameRecords(records.get(), RING_SIZE);
+			if (0 == recordCount)
+			{
+				return;
+			}
+
+			std::array<UINT, HISTOGRAM_BUCKET_COUNT> frameTimes = {};
+			std::array<UINT, HISTOGRAM_BUCKET_COUNT> latencies = {};
+			UINT delayedCount = 0;
+			UINT skippedCount = 0;
+
+			for (UINT i = 0; i < recordCount; ++i)
+			{
+				const FrameRecord& record = records[i];
+				if (0 != i)
+				{
+					updateHistogram(frameTimes, records[i - 1].qpcFlip, record.qpcFlip);
+				}
+				updateHistogram(latencies, record.qpcFlip, record.qpcDisplay);
+
+				if (record.flags & FRAME_DELAYED)
+				{
+					++delayedCount;
+				}
+				if (record.flags & FRAME_SKIPPED)
+				{
+					++skippedCount;
+				}
+			}
+
+			Compat::Log() << "Frame statistics for the last " << recordCount << " flips: " <<
+				delayedCount << " delayed, " << skippedCount << " skipped";
+			logHistogramBuckets("Frame time", frameTimes);
+			logHistogramBuckets("Flip to display latency", latencies);
+		}
+
+		void onFlip(long long qpcFlip, UINT flipInterval, UINT flags)
+		{
+			FrameSlot* prevFrame = getCurrentFrame();
+			if (prevFrame && 0 == prevFrame->qpcPresentBegin.load(std::memory_order_relaxed))
+			{
+				prevFrame->flags.fetch_or(FRAME_SKIPPED, std::memory_order_relaxed);
+			}
+
+			const UINT frameId = g_frameCount.load(std::memory_order_relaxed) + 1;
+			FrameSlot& frame = g_frames[frameId % RING_SIZE];
+			frame.frameId.store(0, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			frame.flags.store(flags, std::memory_order_relaxed);
+			frame.flipInterval.store(flipInterval, std::memory_order_relaxed);
+			frame.qpcFlip.store(qpcFlip, std::memory_order_relaxed);
+			frame.qpcPresentBegin.store(0, std::memory_order_relaxed);
+			frame.qpcPresentEnd.store(0, std::memory_order_relaxed);
+			frame.qpcDisplay.store(0, std::memory_order_relaxed);
+			frame.qpcFlipEnd.store(0, std::memory_order_relaxed);
+
+			frame.frameId.store(frameId, std::memory_order_release);
+			g_frameCount.store(frameId, std::memory_order_release);
+		}
+
+		void onFlipEnd(long long qpcFlipEnd)
+		{
+			FrameSlot* frame = getCurrentFrame();
+			long long qpcUnset = 0;
+			if (frame)
+			{
+				frame->qpcFlipEnd.compare_exchange_strong(qpcUnset, qpcFlipEnd, std::memory_order_relaxed);
+			}
+		}
+
+		void onPresent(UINT frameId, long long qpcPresentBegin, long long qpcPresentEnd, long long qpcDisplay)
+		{
+			FrameSlot* frame = getFrame(frameId);
+			if (frame && 0 == frame->qpcPresentBegin.load(std::memory_order_relaxed))
+			{
+				// A queued frame may still be presented after the next flip marked it as skipped
+				frame->flags.fetch_and(~FRAME_SKIPPED, std::memory_order_relaxed);
+				frame->qpcPresentEnd.store(qpcPresentEnd, std::memory_order_relaxed);
+				frame->qpcDisplay.store(qpcDisplay, std::memory_order_relaxed);
+				frame->qpcPresentBegin.store(qpcPresentBegin, std::memory_order_relaxed);
+			}
+		}
+	}
+}
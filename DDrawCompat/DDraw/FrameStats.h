@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Windows.h>
+
+namespace DDraw
+{
+	namespace FrameStats
+	{
+		enum FrameFlag : UINT
+		{
+			FRAME_DELAYED = 1,
+			FRAME_SKIPPED = 2,
+			FRAME_NOVSYNC = 4
+		};
+
+		// All timestamps are QPC values, 0 if the stage has not been reached (yet).
+		// qpcDisplay is the predicted time of the vblank at which the presented frame becomes visible.
+		struct FrameRecord
+		{
+			UINT frameId;
+			UINT flags;
+			UINT flipInterval;
+			long long qpcFlip;
+			long long qpcPresentBegin;
+			long long qpcPresentEnd;
+			long long qpcDisplay;
+			long long qpcFlipEnd;
+		};
+
+		UINT getCurrentFrameId();
+		UINT getFrameRecords(FrameRecord* records, UINT maxCount);
+		void logHistogram();
+		void onFlip(long long qpcFlip, UINT flipInterval, UINT flags);
+		void onFlipEnd(long long qpcFlipEnd);
+		void onPresent(UINT frameId, long long qpcPresentBegin, long long qpcPresentEnd, long long qpcDisplay);
+	}
+}
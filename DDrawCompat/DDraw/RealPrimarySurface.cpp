@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <Common/CompatPtr.h>
@@ -8,8 +12,11 @@
 #include <Config/Config.h>
 #include <D3dDdi/Device.h>
 #include <D3dDdi/KernelModeThunks.h>
+#include <DDraw/Blitter.h>
 #include <DDraw/DirectDraw.h>
 #include <DDraw/DirectDrawSurface.h>
+#include <DDraw/DirtyRegion.h>
+#include <DDraw/FrameStats.h>
 #include <DDraw/IReleaseNotifier.h>
 #include <DDraw/RealPrimarySurface.h>
 #include <DDraw/ScopedThreadLock.h>
@@ -18,6 +25,7 @@
 #include <Gdi/AccessGuard.h>
 #include <Gdi/Caret.h>
 #include <Gdi/Gdi.h>
+#include <Gdi/Palette.h>
 #include <Gdi/VirtualScreen.h>
 #include <Gdi/Window.h>
 #include <Win32/DisplayMode.h>
@@ -26,37 +34,109 @@ namespace
 {
 	void onRelease();
 
+	const DWORD BACK_BUFFER_COUNT = 2;
+	const DWORD IDLE_TIMEOUT_MS = 100;
+	const long long PRESENT_MARGIN_MS = 2;
+	const DWORD PRESENT_QUEUE_SIZE = 2;
+
+	// A live present refers to the primary itself and is only copied to a presentation buffer
+	// if the primary chain is flipped again before the update thread gets to present it
+	struct QueuedPresent
+	{
+		CompatWeakPtr<IDirectDrawSurface7> surface;
+		DDraw::DirtyRegion dirtyRegion;
+		UINT flipInterval;
+		UINT frameId;
+		bool isGdiSurface;
+		bool isLive;
+	};
+
 	CompatWeakPtr<IDirectDrawSurface7> g_frontBuffer;
 	CompatWeakPtr<IDirectDrawSurface7> g_paletteConverter;
+	std::array<CompatWeakPtr<IDirectDrawSurface7>, PRESENT_QUEUE_SIZE> g_presentationBuffers;
+	std::array<DDraw::DirtyRegion, PRESENT_QUEUE_SIZE> g_presentationBufferDirtyRegions;
+	std::vector<QueuedPresent> g_presentQueue;
 	CompatWeakPtr<IDirectDrawClipper> g_clipper;
 	DDSURFACEDESC2 g_surfaceDesc = {};
 	DDraw::IReleaseNotifier g_releaseNotifier(onRelease);
 
 	bool g_stopUpdateThread = false;
 	HANDLE g_updateThread = nullptr;
+	HANDLE g_updateEvent = nullptr;
+	HANDLE g_updateTimer = nullptr;
 	bool g_isFullScreen = false;
 	DDraw::Surface* g_lastFlipSurface = nullptr;
 
+	long long g_qpcNextFrame = 0;
+	thread_local long long g_qpcFrameLimitDeadline = 0;
+
 	bool g_isUpdatePending = false;
 	bool g_waitingForPrimaryUnlock = false;
 	std::atomic<long long> g_qpcLastUpdate = 0;
 	long long g_qpcFlipEnd = 0;
 	UINT g_flipEndVsyncCount = 0;
 	UINT g_presentEndVsyncCount = 0;
+	UINT g_realFlipEndVsyncCount = 0;
+
+	DDraw::DirtyRegion g_dirtyRegion;
+	std::atomic<bool> g_isFullUpdatePending = true;
+	std::array<DDraw::DirtyRegion, BACK_BUFFER_COUNT> g_backBufferDirtyRegions;
+	DWORD g_layeredWindowPresentCount = 0;
+	HANDLE g_lastPresentedResource = nullptr;
+	std::map<HWND, Gdi::Region> g_presentedWindowRegions;
 
 	CompatPtr<IDirectDrawSurface7> getBackBuffer();
 	CompatPtr<IDirectDrawSurface7> getLastSurface();
+	void releasePresentationBuffers();
+	void signalUpdateThread();
+	DDraw::DirtyRegion takeDirtyRegion(IDirectDrawSurface7* src);
+	bool waitForUpdate(long long qpcDeadline, DWORD timeout);
 
-	void bltToWindow(CompatRef<IDirectDrawSurface7> src)
+	void bltDirtyRegion(CompatRef<IDirectDrawSurface7> dst, CompatRef<IDirectDrawSurface7> src,
+		const DDraw::DirtyRegion& dirtyRegion)
 	{
+		if (dirtyRegion.isFull())
+		{
+			dst->Blt(&dst, nullptr, &src, nullptr, DDBLT_WAIT, nullptr);
+			return;
+		}
+
+		DDSURFACEDESC2 desc = {};
+		desc.dwSize = sizeof(desc);
+		src->GetSurfaceDesc(&src, &desc);
+		const RECT bounds = { 0, 0, static_cast<LONG>(desc.dwWidth), static_cast<LONG>(desc.dwHeight) };
+
+		for (auto rect : dirtyRegion.getRects())
+		{
+			if (IntersectRect(&rect, &rect, &bounds))
+			{
+				dst->Blt(&dst, &rect, &src, &rect, DDBLT_WAIT, nullptr);
+			}
+		}
+	}
+
+	void bltToWindow(CompatRef<IDirectDrawSurface7> src, const DDraw::DirtyRegion& dirtyRegion)
+	{
+		std::map<HWND, Gdi::Region> presentedWindowRegions;
+		DDraw::DirtyRegion fullRegion;
+		fullRegion.addAll();
+
 		for (auto windowPair : Gdi::Window::getWindows())
 		{
-			if (!windowPair.second->isLayered() && !windowPair.second->getVisibleRegion().isEmpty())
+			Gdi::Region visibleRegion = windowPair.second->getVisibleRegion();
+			if (!windowPair.second->isLayered() && !visibleRegion.isEmpty())
 			{
-				g_clipper->SetHWnd(g_clipper, 0, windowPair.second->getPresentationWindow());
-				g_frontBuffer->Blt(g_frontBuffer, nullptr, &src, nullptr, DDBLT_WAIT, nullptr);
+				HWND presentationWindow = windowPair.second->getPresentationWindow();
+				auto it = g_presentedWindowRegions.find(presentationWindow);
+				const bool isWindowChanged = it == g_presentedWindowRegions.end() || !(it->second == visibleRegion);
+
+				g_clipper->SetHWnd(g_clipper, 0, presentationWindow);
+				bltDirtyRegion(*g_frontBuffer, src, isWindowChanged ? fullRegion : dirtyRegion);
+				presentedWindowRegions.emplace(presentationWindow, std::move(visibleRegion));
 			}
 		}
+
+		std::swap(g_presentedWindowRegions, presentedWindowRegions);
 	}
 
 	void bltToWindowViaGdi(Gdi::Region* primaryRegion)
@@ -108,12 +188,12 @@ namespace
 		}
 	}
 
-	void bltVisibleLayeredWindowsToBackBuffer()
+	bool bltVisibleLayeredWindowsToBackBuffer()
 	{
 		auto backBuffer(getBackBuffer());
 		if (!backBuffer)
 		{
-			return;
+			return false;
 		}
 
 		HDC backBufferDc = nullptr;
@@ -133,7 +213,7 @@ namespace
 				D3dDdi::KernelModeThunks::setDcFormatOverride(D3DDDIFMT_UNKNOWN);
 				if (!backBufferDc)
 				{
-					return;
+					return false;
 				}
 			}
 
@@ -166,28 +246,99 @@ namespace
 			CALL_ORIG_FUNC(ReleaseDC)(windowPair.first, windowDc);
 		}
 
-		if (backBufferDc)
+		if (!backBufferDc)
 		{
-			SelectClipRgn(backBufferDc, nullptr);
-			backBuffer->ReleaseDC(backBuffer, backBufferDc);
+			return false;
 		}
+
+		SelectClipRgn(backBufferDc, nullptr);
+		backBuffer->ReleaseDC(backBuffer, backBufferDc);
+		return true;
 	}
 
-	void bltToPrimaryChain(CompatRef<IDirectDrawSurface7> src)
+	void bltToPrimaryChain(CompatRef<IDirectDrawSurface7> src, const DDraw::DirtyRegion& dirtyRegion)
 	{
 		if (!g_isFullScreen)
 		{
-			bltToWindow(src);
+			bltToWindow(src, dirtyRegion);
 			return;
 		}
 
+		// The back buffer was last presented BACK_BUFFER_COUNT presents ago, so it also misses the changes
+		// made since then. Layered windows are drawn directly to the back buffers and are only erased by a
+		// full copy.
+		DDraw::DirtyRegion backBufferDirtyRegion(dirtyRegion);
+		for (const auto& prevDirtyRegion : g_backBufferDirtyRegions)
+		{
+			backBufferDirtyRegion |= prevDirtyRegion;
+		}
+		if (0 != g_layeredWindowPresentCount)
+		{
+			--g_layeredWindowPresentCount;
+			backBufferDirtyRegion.addAll();
+		}
+
+		std::move_backward(g_backBufferDirtyRegions.begin(), g_backBufferDirtyRegions.end() - 1,
+			g_backBufferDirtyRegions.end());
+		g_backBufferDirtyRegions[0] = dirtyRegion;
+
 		auto backBuffer(getBackBuffer());
 		if (backBuffer)
 		{
-			backBuffer->Blt(backBuffer, nullptr, &src, nullptr, DDBLT_WAIT, nullptr);
+			bltDirtyRegion(*backBuffer, src, backBufferDirtyRegion);
 		}
 	}
 
+	void bltToPaletteConverter(CompatRef<IDirectDrawSurface7> src, const DDraw::DirtyRegion& dirtyRegion)
+	{
+		if (dirtyRegion.isEmpty())
+		{
+			return;
+		}
+
+		DDSURFACEDESC2 srcDesc = {};
+		srcDesc.dwSize = sizeof(srcDesc);
+		if (FAILED(src->Lock(&src, nullptr, &srcDesc, DDLOCK_WAIT | DDLOCK_READONLY, nullptr)))
+		{
+			return;
+		}
+
+		DDSURFACEDESC2 dstDesc = {};
+		dstDesc.dwSize = sizeof(dstDesc);
+		if (SUCCEEDED(g_paletteConverter->Lock(g_paletteConverter, nullptr, &dstDesc, DDLOCK_WAIT | DDLOCK_WRITEONLY, nullptr)))
+		{
+			DWORD colorTable[256] = {};
+			auto palette(Gdi::Palette::getHardwarePalette());
+			for (UINT i = 0; i < 256; ++i)
+			{
+				colorTable[i] = (palette[i].peRed << 16) | (palette[i].peGreen << 8) | palette[i].peBlue;
+			}
+
+			const RECT bounds = { 0, 0, static_cast<LONG>(min(srcDesc.dwWidth, dstDesc.dwWidth)),
+				static_cast<LONG>(min(srcDesc.dwHeight, dstDesc.dwHeight)) };
+			auto rects(dirtyRegion.getRects());
+			if (dirtyRegion.isFull())
+			{
+				rects.assign(1, bounds);
+			}
+
+			for (auto rect : rects)
+			{
+				if (IntersectRect(&rect, &rect, &bounds))
+				{
+					DDraw::Blitter::expandPalette(
+						static_cast<BYTE*>(dstDesc.lpSurface) + rect.top * dstDesc.lPitch + rect.left * 4,
+						dstDesc.lPitch,
+						static_cast<BYTE*>(srcDesc.lpSurface) + rect.top * srcDesc.lPitch + rect.left,
+						srcDesc.lPitch, rect.right - rect.left, rect.bottom - rect.top, colorTable);
+				}
+			}
+			g_paletteConverter->Unlock(g_paletteConverter, nullptr);
+		}
+
+		src->Unlock(&src, nullptr);
+	}
+
 	template <typename TDirectDraw>
 	HRESULT createPaletteConverter(CompatRef<TDirectDraw> dd)
 	{
@@ -220,6 +371,111 @@ namespace
 		return result;
 	}
 
+	template <typename TDirectDraw>
+	void createPresentationBuffers(CompatRef<TDirectDraw> dd)
+	{
+		auto dm = DDraw::getDisplayMode(*CompatPtr<IDirectDraw7>::from(&dd));
+
+		typename DDraw::Types<TDirectDraw>::TSurfaceDesc desc = {};
+		desc.dwSize = sizeof(desc);
+		desc.dwFlags = DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT | DDSD_CAPS;
+		desc.dwWidth = dm.dwWidth;
+		desc.dwHeight = dm.dwHeight;
+		desc.ddpfPixelFormat = dm.ddpfPixelFormat;
+		// Palettized copies are read back by the CPU for the palette conversion
+		desc.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN |
+			(dm.ddpfPixelFormat.dwRGBBitCount <= 8 ? DDSCAPS_SYSTEMMEMORY : DDSCAPS_VIDEOMEMORY);
+
+		for (auto& presentationBuffer : g_presentationBuffers)
+		{
+			CompatPtr<DDraw::Types<TDirectDraw>::TCreatedSurface> surface;
+			HRESULT result = dd->CreateSurface(&dd, &desc, &surface.getRef(), nullptr);
+			if (FAILED(result))
+			{
+				Compat::Log() << "Failed to create the presentation buffers, presenting synchronously: "
+					<< Compat::hex(result);
+				releasePresentationBuffers();
+				return;
+			}
+			presentationBuffer = Compat::queryInterface<IDirectDrawSurface7>(surface.get());
+		}
+
+		for (auto& dirtyRegion : g_presentationBufferDirtyRegions)
+		{
+			dirtyRegion.addAll();
+		}
+	}
+
+	bool copyToPresentationBuffer(QueuedPresent& present, CompatRef<IDirectDrawSurface7> src)
+	{
+		auto isFree = [](CompatWeakPtr<IDirectDrawSurface7> buffer) {
+			return std::none_of(g_presentQueue.begin(), g_presentQueue.end(),
+				[&](const QueuedPresent& queuedPresent) { return queuedPresent.surface.get() == buffer.get(); });
+		};
+
+		auto it = std::find_if(g_presentationBuffers.begin(), g_presentationBuffers.end(), isFree);
+		if (it == g_presentationBuffers.end())
+		{
+			// The update thread is a full queue behind, so the oldest frame is dropped
+			it = std::find_if(g_presentationBuffers.begin(), g_presentationBuffers.end(),
+				[](CompatWeakPtr<IDirectDrawSurface7> buffer) { return buffer.get() == g_presentQueue.front().surface.get(); });
+			if (it == g_presentationBuffers.end())
+			{
+				return false;
+			}
+
+			DDraw::DirtyRegion droppedRegion(std::move(g_presentQueue.front().dirtyRegion));
+			g_presentQueue.erase(g_presentQueue.begin());
+			(g_presentQueue.empty() ? present : g_presentQueue.front()).dirtyRegion |= droppedRegion;
+		}
+
+		auto buffer(*it);
+		auto& bufferDirtyRegion = g_presentationBufferDirtyRegions[it - g_presentationBuffers.begin()];
+		if (DDERR_SURFACELOST == buffer->IsLost(buffer))
+		{
+			if (FAILED(buffer->Restore(buffer)))
+			{
+				return false;
+			}
+			bufferDirtyRegion.addAll();
+		}
+
+		// Only the parts that changed since this buffer was last filled are copied
+		bltDirtyRegion(*buffer, src, bufferDirtyRegion);
+		bufferDirtyRegion.clear();
+		present.surface = buffer;
+		present.isLive = false;
+		return true;
+	}
+
+	bool enqueuePresent(CompatWeakPtr<IDirectDrawSurface7> src, UINT flipInterval)
+	{
+		if (!src || !g_presentationBuffers[0] || !g_updateThread)
+		{
+			return false;
+		}
+
+		QueuedPresent present;
+		present.surface = src;
+		present.dirtyRegion = takeDirtyRegion(src);
+		present.flipInterval = flipInterval;
+		present.frameId = DDraw::FrameStats::getCurrentFrameId();
+		present.isGdiSurface = src.get() == DDraw::PrimarySurface::getGdiSurface().get();
+		present.isLive = src.get() == DDraw::PrimarySurface::getPrimary().get();
+
+		if (!present.isLive && !copyToPresentationBuffer(present, *src))
+		{
+			g_dirtyRegion |= present.dirtyRegion;
+			return false;
+		}
+
+		g_presentQueue.push_back(std::move(present));
+		g_isUpdatePending = false;
+		g_waitingForPrimaryUnlock = false;
+		signalUpdateThread();
+		return true;
+	}
+
 	CompatPtr<IDirectDrawSurface7> getBackBuffer()
 	{
 		DDSCAPS2 caps = {};
@@ -245,6 +501,38 @@ namespace
 		return lastSurface;
 	}
 
+	long long getUpdateDeadline()
+	{
+		// A locked primary is presented by RealPrimarySurface::update when it gets unlocked
+		if (!g_isUpdatePending || g_waitingForPrimaryUnlock)
+		{
+			return 0;
+		}
+
+		// Present shortly before the first vblank that isn't already claimed by a pending present,
+		// but not within 1 ms after a flip wait ended, to let the application start drawing the next frame
+		const UINT vsyncCounter = D3dDdi::KernelModeThunks::getVsyncCounter();
+		const UINT targetVsyncCounter = static_cast<INT>(g_presentEndVsyncCount - vsyncCounter) >= 0
+			? g_presentEndVsyncCount + 1 : vsyncCounter + 1;
+		const long long qpcDeadline = D3dDdi::KernelModeThunks::getQpcVsync(targetVsyncCounter) -
+			Time::msToQpc(PRESENT_MARGIN_MS);
+		return max(qpcDeadline, g_qpcFlipEnd + Time::msToQpc(1));
+	}
+
+	long long getFrameLimitPeriod()
+	{
+		if (0 != Config::frameLimitFps)
+		{
+			return static_cast<long long>(Time::g_qpcFrequency / Config::frameLimitFps);
+		}
+		if (0 != Config::frameLimitRefreshMultiple)
+		{
+			return static_cast<long long>(
+				D3dDdi::KernelModeThunks::getQpcVsyncPeriod() / Config::frameLimitRefreshMultiple);
+		}
+		return 0;
+	}
+
 	UINT getFlipInterval(DWORD flags)
 	{
 		if (flags & DDFLIP_NOVSYNC)
@@ -275,6 +563,74 @@ namespace
 		return static_cast<INT>(D3dDdi::KernelModeThunks::getVsyncCounter() - g_presentEndVsyncCount) < 0;
 	}
 
+	bool isPrimaryBusy(CompatWeakPtr<IDirectDrawSurface7> primary)
+	{
+		RECT emptyRect = {};
+		HRESULT result = primary ? primary->BltFast(primary, 0, 0, primary, &emptyRect, DDBLTFAST_WAIT) : DD_OK;
+		return DDERR_SURFACEBUSY == result || DDERR_LOCKEDSURFACES == result;
+	}
+
+	void initFrameLimit()
+	{
+		if (0 != Config::frameLimitFps)
+		{
+			Compat::Log() << "Limiting the frame rate to " << Config::frameLimitFps << " FPS";
+		}
+		else if (0 != Config::frameLimitRefreshMultiple)
+		{
+			Compat::Log() << "Limiting the frame rate to " << Config::frameLimitRefreshMultiple << "x the refresh rate";
+		}
+	}
+
+	void invalidateAll()
+	{
+		g_isFullUpdatePending = true;
+		for (auto& dirtyRegion : g_backBufferDirtyRegions)
+		{
+			dirtyRegion.addAll();
+		}
+		g_layeredWindowPresentCount = 0;
+		g_lastPresentedResource = nullptr;
+		for (auto& dirtyRegion : g_presentationBufferDirtyRegions)
+		{
+			dirtyRegion.addAll();
+		}
+		g_presentedWindowRegions.clear();
+	}
+
+	void waitForFrameLimit()
+	{
+		Time::waitForQpc(g_qpcFrameLimitDeadline);
+	}
+
+	void limitFrameRate()
+	{
+		const long long qpcFramePeriod = getFrameLimitPeriod();
+		if (0 == qpcFramePeriod)
+		{
+			return;
+		}
+
+		const long long qpcNow = Time::queryPerformanceCounter();
+		if (qpcNow < g_qpcNextFrame)
+		{
+			// Called after the present is issued, so this delays the application's next frame instead of this one.
+			// The wait starts once the Flip hook has returned and released the DirectDraw lock, so the update thread
+			// can present in the meantime without other threads entering DirectDraw in the middle of the Flip.
+			g_qpcFrameLimitDeadline = g_qpcNextFrame;
+			g_qpcNextFrame += qpcFramePeriod;
+			DDraw::ScopedThreadLock::deferUntilUnlocked(&waitForFrameLimit);
+		}
+		else if (qpcNow - g_qpcNextFrame < qpcFramePeriod)
+		{
+			g_qpcNextFrame += qpcFramePeriod;
+		}
+		else
+		{
+			g_qpcNextFrame = qpcNow + qpcFramePeriod;
+		}
+	}
+
 	void onRelease()
 	{
 		LOG_FUNC("RealPrimarySurface::onRelease");
@@ -284,7 +640,9 @@ namespace
 		g_isFullScreen = false;
 		g_waitingForPrimaryUnlock = false;
 		g_paletteConverter.release();
+		releasePresentationBuffers();
 		g_surfaceDesc = {};
+		invalidateAll();
 	}
 
 	void onRestore()
@@ -306,6 +664,7 @@ namespace
 		g_isFullScreen = isFlippable;
 		g_isUpdatePending = false;
 		g_qpcLastUpdate = Time::queryPerformanceCounter() - Time::msToQpc(Config::delayedFlipModeTimeout);
+		invalidateAll();
 
 		if (isFlippable)
 		{
@@ -316,7 +675,8 @@ namespace
 		}
 	}
 
-	void presentToPrimaryChain(CompatWeakPtr<IDirectDrawSurface7> src)
+	void presentToPrimaryChain(CompatWeakPtr<IDirectDrawSurface7> src, const DDraw::DirtyRegion& dirtyRegion,
+		bool isGdiSurface)
 	{
 		LOG_FUNC("RealPrimarySurface::presentToPrimaryChain", src);
 
@@ -325,6 +685,7 @@ namespace
 		if (!g_frontBuffer || !src || DDraw::RealPrimarySurface::isLost())
 		{
 			bltToWindowViaGdi(nullptr);
+			g_isFullUpdatePending = true;
 			return;
 		}
 
@@ -333,56 +694,136 @@ namespace
 
 		if (Win32::DisplayMode::getBpp() <= 8)
 		{
-			HDC paletteConverterDc = nullptr;
-			g_paletteConverter->GetDC(g_paletteConverter, &paletteConverterDc);
-			HDC srcDc = nullptr;
-			D3dDdi::Device::setReadOnlyGdiLock(true);
-			D3dDdi::KernelModeThunks::setDcPaletteOverride(true);
-			src->GetDC(src, &srcDc);
-			D3dDdi::KernelModeThunks::setDcPaletteOverride(false);
-			D3dDdi::Device::setReadOnlyGdiLock(false);
+			bltToPaletteConverter(*src, dirtyRegion);
+			bltToPrimaryChain(*g_paletteConverter, dirtyRegion);
+		}
+		else
+		{
+			bltToPrimaryChain(*src, dirtyRegion);
+		}
+
+		if (g_isFullScreen && isGdiSurface && bltVisibleLayeredWindowsToBackBuffer())
+		{
+			g_layeredWindowPresentCount = BACK_BUFFER_COUNT + 1;
+		}
+	}
+
+	void presentNow(CompatWeakPtr<IDirectDrawSurface7> src, const DDraw::DirtyRegion& dirtyRegion, bool isGdiSurface,
+		UINT flipInterval, UINT frameId)
+	{
+		const long long qpcPresentBegin = Time::queryPerformanceCounter();
+		presentToPrimaryChain(src, dirtyRegion, isGdiSurface);
+
+		if (g_isFullScreen)
+		{
+			g_frontBuffer->Flip(g_frontBuffer, getBackBuffer(), DDFLIP_WAIT);
+			g_realFlipEndVsyncCount = D3dDdi::KernelModeThunks::getVsyncCounter() + 1;
+		}
+		g_presentEndVsyncCount = D3dDdi::KernelModeThunks::getVsyncCounter() + max(flipInterval, 1);
+		DDraw::FrameStats::onPresent(frameId, qpcPresentBegin, Time::queryPerformanceCounter(),
+			D3dDdi::KernelModeThunks::getQpcVsync(g_presentEndVsyncCount));
+	}
 
-			if (paletteConverterDc && srcDc)
+	void presentQueued()
+	{
+		while (true)
+		{
+			UINT realFlipEndVsyncCount = 0;
 			{
-				CALL_ORIG_FUNC(BitBlt)(paletteConverterDc,
-					0, 0, g_surfaceDesc.dwWidth, g_surfaceDesc.dwHeight, srcDc, 0, 0, SRCCOPY);
+				DDraw::ScopedThreadLock lock;
+				if (g_presentQueue.empty())
+				{
+					return;
+				}
+
+				if (!g_isFullScreen ||
+					static_cast<INT>(D3dDdi::KernelModeThunks::getVsyncCounter() - g_realFlipEndVsyncCount) >= 0)
+				{
+					const QueuedPresent present(std::move(g_presentQueue.front()));
+					g_presentQueue.erase(g_presentQueue.begin());
+					if (present.isLive && present.surface.get() != DDraw::PrimarySurface::getPrimary().get())
+					{
+						continue;
+					}
+
+					// A live present reads the primary itself, which RealPrimarySurface::update presents on unlock
+					if (present.isLive && isPrimaryBusy(present.surface))
+					{
+						g_dirtyRegion |= present.dirtyRegion;
+						g_isUpdatePending = true;
+						g_waitingForPrimaryUnlock = true;
+						continue;
+					}
+
+					presentNow(present.surface, present.dirtyRegion, present.isGdiSurface,
+						present.flipInterval, present.frameId);
+					continue;
+				}
+				realFlipEndVsyncCount = g_realFlipEndVsyncCount;
 			}
 
-			src->ReleaseDC(src, srcDc);
-			g_paletteConverter->ReleaseDC(g_paletteConverter, paletteConverterDc);
+			// Blitting to the back buffers or flipping again would block until the previous flip is done,
+			// so wait for it without holding the DirectDraw lock
+			D3dDdi::KernelModeThunks::waitForVsyncCounter(realFlipEndVsyncCount);
+		}
+	}
+
+	void releasePresentationBuffers()
+	{
+		g_presentQueue.clear();
+		for (auto& presentationBuffer : g_presentationBuffers)
+		{
+			presentationBuffer.release();
+		}
+	}
 
-			bltToPrimaryChain(*g_paletteConverter);
+	void signalUpdateThread()
+	{
+		if (g_updateEvent)
+		{
+			SetEvent(g_updateEvent);
 		}
-		else
+	}
+
+	DDraw::DirtyRegion takeDirtyRegion(IDirectDrawSurface7* src)
+	{
+		// Tracked against the source surface, not the presentation buffer a queued frame is presented from.
+		// Flips swap the driver resources behind the same surface, so those identify what was presented.
+		DDraw::DirtyRegion dirtyRegion;
+		std::swap(dirtyRegion, g_dirtyRegion);
+		HANDLE resource = src ? DDraw::getDriverResourceHandle(*src) : nullptr;
+		if (g_isFullUpdatePending.exchange(false) || resource != g_lastPresentedResource)
 		{
-			bltToPrimaryChain(*src);
+			dirtyRegion.addAll();
 		}
+		g_lastPresentedResource = resource;
 
-		if (g_isFullScreen && src == DDraw::PrimarySurface::getGdiSurface())
+		for (auto& bufferDirtyRegion : g_presentationBufferDirtyRegions)
 		{
-			bltVisibleLayeredWindowsToBackBuffer();
+			bufferDirtyRegion |= dirtyRegion;
 		}
+		return dirtyRegion;
 	}
 
 	void updateNow(CompatWeakPtr<IDirectDrawSurface7> src, UINT flipInterval)
 	{
-		presentToPrimaryChain(src);
-		g_isUpdatePending = false;
-		g_waitingForPrimaryUnlock = false;
-
-		if (g_isFullScreen)
+		// The surface is at least as recent as any queued frame
+		for (const auto& present : g_presentQueue)
 		{
-			g_frontBuffer->Flip(g_frontBuffer, getBackBuffer(), DDFLIP_WAIT);
+			g_dirtyRegion |= present.dirtyRegion;
 		}
-		g_presentEndVsyncCount = D3dDdi::KernelModeThunks::getVsyncCounter() + max(flipInterval, 1);
+		g_presentQueue.clear();
+
+		presentNow(src, takeDirtyRegion(src), src.get() == DDraw::PrimarySurface::getGdiSurface().get(), flipInterval,
+			DDraw::FrameStats::getCurrentFrameId());
+		g_isUpdatePending = false;
+		g_waitingForPrimaryUnlock = false;
 	}
 
 	void updateNowIfNotBusy()
 	{
 		auto primary(DDraw::PrimarySurface::getPrimary());
-		RECT emptyRect = {};
-		HRESULT result = primary ? primary->BltFast(primary, 0, 0, primary, &emptyRect, DDBLTFAST_WAIT) : DD_OK;
-		g_waitingForPrimaryUnlock = DDERR_SURFACEBUSY == result || DDERR_LOCKEDSURFACES == result;
+		g_waitingForPrimaryUnlock = isPrimaryBusy(primary);
 
 		if (!g_waitingForPrimaryUnlock)
 		{
@@ -393,34 +834,61 @@ namespace
 
 	DWORD WINAPI updateThreadProc(LPVOID /*lpParameter*/)
 	{
-		bool skipWaitForVsync = false;
+		long long qpcDeadline = 0;
 
 		while (!g_stopUpdateThread)
 		{
-			if (!skipWaitForVsync)
+			// Caret visibility changes are not signaled, so the idle wait is still bounded
+			if (!waitForUpdate(qpcDeadline, min(Gdi::Caret::blink(), IDLE_TIMEOUT_MS)) || g_stopUpdateThread)
 			{
-				D3dDdi::KernelModeThunks::waitForVsync();
+				continue;
 			}
-			skipWaitForVsync = false;
-			Gdi::Caret::blink();
-			Sleep(1);
+
+			presentQueued();
 
 			DDraw::ScopedThreadLock lock;
-			if (g_isUpdatePending && !isPresentPending())
+			qpcDeadline = getUpdateDeadline();
+			if (0 != qpcDeadline && Time::queryPerformanceCounter() >= qpcDeadline)
 			{
-				if (Time::qpcToMs(Time::queryPerformanceCounter() - g_qpcFlipEnd) < 1)
-				{
-					skipWaitForVsync = true;
-				}
-				else
-				{
-					updateNowIfNotBusy();
-				}
+				updateNowIfNotBusy();
+				qpcDeadline = getUpdateDeadline();
 			}
 		}
 
 		return 0;
 	}
+
+	bool waitForUpdate(long long qpcDeadline, DWORD timeout)
+	{
+		HANDLE handles[] = { g_updateEvent, g_updateTimer };
+		DWORD handleCount = 1;
+
+		if (0 != qpcDeadline)
+		{
+			const long long qpcRemaining = qpcDeadline - Time::queryPerformanceCounter();
+			if (qpcRemaining <= 0)
+			{
+				return true;
+			}
+
+			LARGE_INTEGER dueTime = {};
+			dueTime.QuadPart = -qpcRemaining * 10000000 / Time::g_qpcFrequency;
+			if (g_updateTimer && SetWaitableTimer(g_updateTimer, &dueTime, 0, nullptr, nullptr, FALSE))
+			{
+				handleCount = 2;
+			}
+			else
+			{
+				timeout = min(timeout, static_cast<DWORD>(Time::qpcToMs(qpcRemaining + Time::g_qpcFrequency / 1000 - 1)));
+			}
+		}
+
+		if (WAIT_TIMEOUT != WaitForMultipleObjects(handleCount, handles, FALSE, timeout))
+		{
+			return true;
+		}
+		return 0 != qpcDeadline && Time::queryPerformanceCounter() >= qpcDeadline;
+	}
 }
 
 namespace DDraw
@@ -460,6 +928,7 @@ namespace DDraw
 			return result;
 		}
 
+		createPresentationBuffers(dd);
 		g_frontBuffer = CompatPtr<IDirectDrawSurface7>::from(surface.get()).detach();
 		g_frontBuffer->SetPrivateData(g_frontBuffer, IID_IReleaseNotifier,
 			&g_releaseNotifier, sizeof(&g_releaseNotifier), DDSPD_IUNKNOWNPOINTER);
@@ -475,10 +944,14 @@ namespace DDraw
 
 	HRESULT RealPrimarySurface::flip(CompatPtr<IDirectDrawSurface7> surfaceTargetOverride, DWORD flags)
 	{
+		const long long qpcFlip = Time::queryPerformanceCounter();
 		const DWORD flipInterval = getFlipInterval(flags);
 		if (0 == flipInterval)
 		{
+			FrameStats::onFlip(qpcFlip, 0, FrameStats::FRAME_NOVSYNC);
 			g_isUpdatePending = true;
+			signalUpdateThread();
+			limitFrameRate();
 			return DD_OK;
 		}
 
@@ -490,13 +963,23 @@ namespace DDraw
 			{
 				CompatPtr<IDirectDrawSurface7> prevPrimarySurface(
 					surfaceTargetOverride ? surfaceTargetOverride : PrimarySurface::getLastSurface());
-				updateNow(prevPrimarySurface, 0);
+				if (!enqueuePresent(prevPrimarySurface, 0))
+				{
+					updateNow(prevPrimarySurface, 0);
+				}
 			}
+			FrameStats::onFlip(qpcFlip, flipInterval, FrameStats::FRAME_DELAYED);
 			g_isUpdatePending = true;
+			signalUpdateThread();
 		}
 		else
 		{
-			updateNow(PrimarySurface::getPrimary(), flipInterval);
+			FrameStats::onFlip(qpcFlip, flipInterval, 0);
+			auto primary(PrimarySurface::getPrimary());
+			if (!enqueuePresent(primary, flipInterval))
+			{
+				updateNow(primary, flipInterval);
+			}
 		}
 		g_flipEndVsyncCount = D3dDdi::KernelModeThunks::getVsyncCounter() + flipInterval;
 		g_presentEndVsyncCount = g_flipEndVsyncCount;
@@ -510,11 +993,14 @@ namespace DDraw
 		{
 			g_lastFlipSurface = nullptr;
 		}
+
+		limitFrameRate();
 		return DD_OK;
 	}
 
 	void RealPrimarySurface::flush()
 	{
+		presentQueued();
 		DDraw::ScopedThreadLock lock;
 		if (g_isUpdatePending && !isPresentPending())
 		{
@@ -541,6 +1027,9 @@ namespace DDraw
 
 	void RealPrimarySurface::init()
 	{
+		initFrameLimit();
+		g_updateEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		g_updateTimer = Time::createWaitableTimer();
 		g_updateThread = CreateThread(nullptr, 0, &updateThreadProc, nullptr, 0, nullptr);
 		SetThreadPriority(g_updateThread, THREAD_PRIORITY_TIME_CRITICAL);
 	}
@@ -570,6 +1059,7 @@ namespace DDraw
 		}
 
 		g_stopUpdateThread = true;
+		signalUpdateThread();
 		if (WAIT_OBJECT_0 != WaitForSingleObject(g_updateThread, 1000))
 		{
 			TerminateThread(g_updateThread, 0);
@@ -578,6 +1068,31 @@ namespace DDraw
 		g_updateThread = nullptr;
 	}
 
+	void RealPrimarySurface::prepareFlip()
+	{
+		DDraw::ScopedThreadLock lock;
+		auto it = std::find_if(g_presentQueue.begin(), g_presentQueue.end(),
+			[](const QueuedPresent& present) { return present.isLive; });
+		if (it == g_presentQueue.end())
+		{
+			return;
+		}
+
+		// The flip is about to replace the contents of the primary that the live present refers to
+		QueuedPresent present(std::move(*it));
+		g_presentQueue.erase(it);
+		if (present.surface.get() == PrimarySurface::getPrimary().get() &&
+			copyToPresentationBuffer(present, *present.surface))
+		{
+			g_presentQueue.push_back(std::move(present));
+		}
+		else
+		{
+			g_isFullUpdatePending = true;
+			g_isUpdatePending = true;
+		}
+	}
+
 	HRESULT RealPrimarySurface::restore()
 	{
 		DDraw::ScopedThreadLock lock;
@@ -591,8 +1106,10 @@ namespace DDraw
 
 	void RealPrimarySurface::scheduleUpdate()
 	{
+		g_isFullUpdatePending = true;
 		g_qpcLastUpdate = Time::queryPerformanceCounter();
 		g_isUpdatePending = true;
+		signalUpdateThread();
 	}
 
 	HRESULT RealPrimarySurface::setGammaRamp(DDGAMMARAMP* rampData)
@@ -607,15 +1124,27 @@ namespace DDraw
 		return gammaControl->SetGammaRamp(gammaControl, 0, rampData);
 	}
 
-	void RealPrimarySurface::update()
+	void RealPrimarySurface::update(const RECT* rect)
 	{
 		DDraw::ScopedThreadLock lock;
+		if (rect)
+		{
+			g_dirtyRegion.add(*rect);
+		}
+		else
+		{
+			g_isFullUpdatePending = true;
+		}
 		g_qpcLastUpdate = Time::queryPerformanceCounter();
 		g_isUpdatePending = true;
 		if (g_waitingForPrimaryUnlock)
 		{
 			updateNowIfNotBusy();
 		}
+		else
+		{
+			signalUpdateThread();
+		}
 	}
 
 	bool RealPrimarySurface::waitForFlip(Surface* surface, bool wait)
@@ -636,6 +1165,7 @@ namespace DDraw
 		if (D3dDdi::KernelModeThunks::waitForVsyncCounter(g_flipEndVsyncCount))
 		{
 			g_qpcFlipEnd = Time::queryPerformanceCounter();
+			FrameStats::onFlipEnd(g_qpcFlipEnd);
 		}
 		return true;
 	}
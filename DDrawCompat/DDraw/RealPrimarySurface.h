@@ -22,12 +22,13 @@ namespace DDraw
 		static void init();
 		static bool isFullScreen();
 		static bool isLost();
+		static void prepareFlip();
 		static void release();
 		static void removeUpdateThread();
 		static HRESULT restore();
 		static void scheduleUpdate();
 		static HRESULT setGammaRamp(DDGAMMARAMP* rampData);
-		static void update();
+		static void update(const RECT* rect = nullptr);
 		static bool waitForFlip(Surface* surface, bool wait = true);
 	};
 }
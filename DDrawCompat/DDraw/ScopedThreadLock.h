@@ -10,11 +10,40 @@ namespace DDraw
 		ScopedThreadLock()
 		{
 			Dll::g_origProcs.AcquireDDThreadLock();
+			++s_lockCount;
 		}
 
 		~ScopedThreadLock()
 		{
 			Dll::g_origProcs.ReleaseDDThreadLock();
+			if (0 == --s_lockCount)
+			{
+				runDeferredFunc();
+			}
 		}
+
+		// Runs func once the outermost lock on this thread is released, for waits that shouldn't block other threads
+		static void deferUntilUnlocked(void (*func)())
+		{
+			s_deferredFunc = func;
+			if (0 == s_lockCount)
+			{
+				runDeferredFunc();
+			}
+		}
+
+	private:
+		static void runDeferredFunc()
+		{
+			if (s_deferredFunc)
+			{
+				auto func = s_deferredFunc;
+				s_deferredFunc = nullptr;
+				func();
+			}
+		}
+
+		static inline thread_local unsigned s_lockCount = 0;
+		static inline thread_local void (*s_deferredFunc)() = nullptr;
 	};
 }
@@ -21,6 +21,12 @@ namespace
 
 namespace DDraw
 {
+	PrimarySurface::PrimarySurface()
+		: m_lockedRect{}
+		, m_lockCount(0)
+	{
+	}
+
 	PrimarySurface::~PrimarySurface()
 	{
 		LOG_FUNC("PrimarySurface::~PrimarySurface");
@@ -8,9 +8,12 @@
 
 namespace DDraw
 {
+	template <typename TSurface> class PrimarySurfaceImpl;
+
 	class PrimarySurface : public Surface
 	{
 	public:
+		PrimarySurface();
 		virtual ~PrimarySurface();
 
 		template <typename TDirectDraw, typename TSurface, typename TSurfaceDesc>
@@ -35,6 +38,12 @@ namespace DDraw
 		static CompatWeakPtr<IDirectDrawPalette> s_palette;
 
 	private:
+		template <typename TDirectDrawSurface>
+		friend class PrimarySurfaceImpl;
+
 		virtual void createImpl() override;
+
+		RECT m_lockedRect;
+		DWORD m_lockCount;
 	};
 }
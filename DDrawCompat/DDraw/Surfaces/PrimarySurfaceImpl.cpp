@@ -95,7 +95,7 @@ namespace DDraw
 		if (SUCCEEDED(result))
 		{
 			bltToGdi(This, lpDestRect, lpDDSrcSurface, lpSrcRect, dwFlags, lpDDBltFx);
-			RealPrimarySurface::update();
+			RealPrimarySurface::update(lpDestRect);
 		}
 		return result;
 	}
@@ -112,7 +112,17 @@ namespace DDraw
 		HRESULT result = SurfaceImpl::BltFast(This, dwX, dwY, lpDDSrcSurface, lpSrcRect, dwTrans);
 		if (SUCCEEDED(result))
 		{
-			RealPrimarySurface::update();
+			if (lpSrcRect)
+			{
+				RECT dstRect = { static_cast<LONG>(dwX), static_cast<LONG>(dwY),
+					static_cast<LONG>(dwX) + lpSrcRect->right - lpSrcRect->left,
+					static_cast<LONG>(dwY) + lpSrcRect->bottom - lpSrcRect->top };
+				RealPrimarySurface::update(&dstRect);
+			}
+			else
+			{
+				RealPrimarySurface::update();
+			}
 		}
 		return result;
 	}
@@ -138,6 +148,7 @@ namespace DDraw
 			return Blt(This, nullptr, surfaceTargetOverride.get(), nullptr, DDBLT_WAIT, nullptr);
 		}
 
+		RealPrimarySurface::prepareFlip();
 		HRESULT result = SurfaceImpl::Flip(This, surfaceTargetOverride, DDFLIP_WAIT);
 		if (FAILED(result))
 		{
@@ -195,6 +206,18 @@ namespace DDraw
 		if (SUCCEEDED(result))
 		{
 			restorePrimaryCaps(lpDDSurfaceDesc->ddsCaps.dwCaps);
+			auto& primary = static_cast<PrimarySurface&>(*this->m_data);
+			++primary.m_lockCount;
+			if (!(dwFlags & DDLOCK_READONLY))
+			{
+				RECT rect = { 0, 0, static_cast<LONG>(lpDDSurfaceDesc->dwWidth),
+					static_cast<LONG>(lpDDSurfaceDesc->dwHeight) };
+				if (lpDestRect)
+				{
+					IntersectRect(&rect, &rect, lpDestRect);
+				}
+				UnionRect(&primary.m_lockedRect, &primary.m_lockedRect, &rect);
+			}
 		}
 		return result;
 	}
@@ -248,7 +271,16 @@ namespace DDraw
 		HRESULT result = SurfaceImpl::Unlock(This, lpRect);
 		if (SUCCEEDED(result))
 		{
-			RealPrimarySurface::update();
+			// Unlock doesn't tell which lock it ends, so the writable locks are presented until the last one ends
+			auto& primary = static_cast<PrimarySurface&>(*this->m_data);
+			if (!IsRectEmpty(&primary.m_lockedRect))
+			{
+				RealPrimarySurface::update(&primary.m_lockedRect);
+			}
+			if (0 != primary.m_lockCount && 0 == --primary.m_lockCount)
+			{
+				primary.m_lockedRect = {};
+			}
 		}
 		return result;
 	}
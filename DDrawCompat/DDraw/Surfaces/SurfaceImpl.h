@@ -46,7 +46,6 @@ namespace DDraw
 
 		static const Vtable<TSurface>& s_origVtable;
 
-	private:
 		Surface* m_data;
 	};
 }
@@ -10,8 +10,12 @@
 #include <Common/Hook.h>
 #include <Common/Log.h>
 #include <Common/Time.h>
+#include <Config/Config.h>
+#include <D3dDdi/DdiRecorder.h>
 #include <D3dDdi/Hooks.h>
+#include <D3dDdi/LockBufferPool.h>
 #include <DDraw/DirectDraw.h>
+#include <DDraw/FrameStats.h>
 #include <DDraw/Hooks.h>
 #include <Direct3d/Hooks.h>
 #include <Dll/Dll.h>
@@ -269,7 +273,10 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 
 		const BOOL disablePriorityBoost = TRUE;
 		SetProcessPriorityBoost(GetCurrentProcess(), disablePriorityBoost);
-		SetProcessAffinityMask(GetCurrentProcess(), 1);
+		if (!Config::multiCoreStripedBlts)
+		{
+			SetProcessAffinityMask(GetCurrentProcess(), 1);
+		}
 		timeBeginPeriod(1);
 		setDpiAwareness();
 		SetThemeAppProperties(0);
@@ -277,6 +284,7 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 		Win32::MemoryManagement::installHooks();
 		Win32::MsgHooks::installHooks();
 		Time::init();
+		D3dDdi::DdiRecorder::init();
 
 		const DWORD disableMaxWindowedMode = 12;
 		CALL_ORIG_PROC(SetAppCompatData)(disableMaxWindowedMode, 0);
@@ -296,11 +304,25 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 			FreeLibrary(g_origDDrawModule);
 		}
 		timeEndPeriod(1);
+		Time::dllThreadDetach();
+
+		D3dDdi::DdiRecorder::uninit();
+		if (!lpvReserved)
+		{
+			// On process termination, other threads may have been terminated while holding the pool's lock
+			// or the heap lock
+			auto lockBufferStats(D3dDdi::LockBufferPool::getStats());
+			Compat::Log() << "Lock buffer pool: " << lockBufferStats.hits << " hits, " << lockBufferStats.misses <<
+				" misses, " << lockBufferStats.bytesInUse << " bytes in use, " << lockBufferStats.bytesPooled <<
+				" bytes pooled";
+			DDraw::FrameStats::logHistogram();
+		}
 		Compat::Log() << "DDrawCompat detached successfully";
 	}
 	else if (fdwReason == DLL_THREAD_DETACH)
 	{
 		Gdi::dllThreadDetach();
+		Time::dllThreadDetach();
 	}
 
 	return TRUE;
@@ -81,34 +81,38 @@ namespace Gdi
 {
 	namespace Caret
 	{
-		void blink()
+		DWORD blink()
 		{
 			D3dDdi::ScopedCriticalSection lock;
 			if (!g_caret.isVisible)
 			{
-				return;
+				return INFINITE;
 			}
 
 			UINT caretBlinkTime = GetCaretBlinkTime();
 			if (INFINITE == caretBlinkTime)
 			{
-				return;
+				return INFINITE;
 			}
 
 			const long long qpcNow = Time::queryPerformanceCounter();
-			if (Time::qpcToMs(qpcNow - g_qpcLastBlink) >= caretBlinkTime)
+			const long long msSinceLastBlink = Time::qpcToMs(qpcNow - g_qpcLastBlink);
+			if (msSinceLastBlink < caretBlinkTime)
 			{
-				g_qpcLastBlink = qpcNow;
-
-				GUITHREADINFO gti = {};
-				gti.cbSize = sizeof(gti);
-				GetGUIThreadInfo(GetWindowThreadProcessId(g_caret.hwnd, nullptr), &gti);
-				if (!(gti.flags & (GUI_INMENUMODE | GUI_POPUPMENUMODE | GUI_SYSTEMMENUMODE)))
-				{
-					g_caret.isDrawn = !g_caret.isDrawn;
-					drawCaret();
-				}
+				return static_cast<DWORD>(caretBlinkTime - msSinceLastBlink);
 			}
+
+			g_qpcLastBlink = qpcNow;
+
+			GUITHREADINFO gti = {};
+			gti.cbSize = sizeof(gti);
+			GetGUIThreadInfo(GetWindowThreadProcessId(g_caret.hwnd, nullptr), &gti);
+			if (!(gti.flags & (GUI_INMENUMODE | GUI_POPUPMENUMODE | GUI_SYSTEMMENUMODE)))
+			{
+				g_caret.isDrawn = !g_caret.isDrawn;
+				drawCaret();
+			}
+			return caretBlinkTime;
 		}
 
 		void installHooks()
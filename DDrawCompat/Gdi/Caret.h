@@ -1,10 +1,12 @@
 #pragma once
 
+#include <Windows.h>
+
 namespace Gdi
 {
 	namespace Caret
 	{
-		void blink();
+		DWORD blink();
 		void installHooks();
 		void uninstallHooks();
 	}
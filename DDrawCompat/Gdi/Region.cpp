@@ -111,6 +111,11 @@ namespace Gdi
 		return combine(other, RGN_DIFF);
 	}
 
+	bool Region::operator==(const Region& other) const
+	{
+		return EqualRgn(m_region, other.m_region);
+	}
+
 	void swap(Region& rgn1, Region& rgn2)
 	{
 		std::swap(rgn1.m_region, rgn2.m_region);
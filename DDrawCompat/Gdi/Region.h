@@ -29,6 +29,8 @@ namespace Gdi
 		Region operator|=(const Region& other);
 		Region operator-=(const Region& other);
 
+		bool operator==(const Region& other) const;
+
 		friend void swap(Region& rgn1, Region& rgn2);
 
 	private:
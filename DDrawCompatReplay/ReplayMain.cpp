@@ -0,0 +1,31 @@
+#include <cstdio>
+
+#include <Common/Log.h>
+#include <Common/Time.h>
+#include <D3dDdi/DdiReplay.h>
+
+// Replays a DDI capture file against the software device and logs the timing report to
+// DDrawCompat-DDrawCompatReplay.log, e.g.:
+// DDrawCompatReplay C:\capture.ddi
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		std::printf("Usage: DDrawCompatReplay <capture file>\n");
+		return 1;
+	}
+
+	Compat::Log::initLogging("DDrawCompatReplay");
+	Time::init();
+
+	D3dDdi::DdiReplay::Report report = {};
+	if (!D3dDdi::DdiReplay::replay(argv[1], report))
+	{
+		std::printf("Failed to replay %s\n", argv[1]);
+		return 1;
+	}
+
+	D3dDdi::DdiReplay::logReport(report);
+	std::printf("Replayed %u calls, %u skipped\n", report.recordCount, report.skippedRecordCount);
+	return 0;
+}
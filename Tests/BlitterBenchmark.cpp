@@ -0,0 +1,273 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <DDraw/Blitter.h>
+
+// Checks DDraw::Blitter::blt and colorFill against a scalar reference for every bytesPerPixel, stretch,
+// mirror and color key combination, then reports the throughput of each kernel.
+// Usage: BlitterBenchmark [--verify] [--quick]
+
+namespace
+{
+	struct BltCase
+	{
+		const char* name;
+		int srcWidthNum;
+		int srcWidthDen;
+		bool mirrorX;
+		bool mirrorY;
+		bool srcColorKey;
+		bool dstColorKey;
+	};
+
+	const BltCase BLT_CASES[] = {
+		{ "copy", 1, 1, false, false, false, false },
+		{ "stretch x2", 1, 2, false, false, false, false },
+		{ "shrink x2", 2, 1, false, false, false, false },
+		{ "mirror x", 1, 1, true, false, false, false },
+		{ "mirror y", 1, 1, false, true, false, false },
+		{ "src color key", 1, 1, false, false, true, false },
+		{ "dst color key", 1, 1, false, false, false, true },
+		{ "stretch mirror src key", 2, 3, true, true, true, false }
+	};
+
+	DWORD getKeyMask(DWORD bytesPerPixel)
+	{
+		return 4 == bytesPerPixel ? 0x00FFFFFF : ((1u << (8 * bytesPerPixel)) - 1) & 0x00FFFFFF;
+	}
+
+	DWORD getPixel(const BYTE* p, DWORD bytesPerPixel)
+	{
+		DWORD value = 0;
+		std::memcpy(&value, p, bytesPerPixel);
+		return value;
+	}
+
+	void referenceBlt(BYTE* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight,
+		const BYTE* src, DWORD srcPitch, LONG srcWidth, LONG srcHeight,
+		DWORD bytesPerPixel, const DWORD* dstColorKey, const DWORD* srcColorKey)
+	{
+		const bool mirrorX = srcWidth < 0;
+		const bool mirrorY = srcHeight < 0;
+		const DWORD absSrcWidth = mirrorX ? -srcWidth : srcWidth;
+		const DWORD absSrcHeight = mirrorY ? -srcHeight : srcHeight;
+		const int deltaX = (absSrcWidth << 16) / dstWidth;
+		const int deltaY = (absSrcHeight << 16) / dstHeight;
+		const DWORD keyMask = getKeyMask(bytesPerPixel);
+
+		for (DWORD y = 0; y < dstHeight; ++y)
+		{
+			const DWORD mirroredY = mirrorY ? dstHeight - 1 - y : y;
+			const int srcY = (deltaY / 2 + static_cast<int>(mirroredY) * deltaY) >> 16;
+			for (DWORD x = 0; x < dstWidth; ++x)
+			{
+				const DWORD mirroredX = mirrorX ? dstWidth - 1 - x : x;
+				const int srcX = (deltaX / 2 + static_cast<int>(mirroredX) * deltaX) >> 16;
+				BYTE* d = dst + y * dstPitch + x * bytesPerPixel;
+				const BYTE* s = src + srcY * srcPitch + srcX * bytesPerPixel;
+				if (dstColorKey && (getPixel(d, bytesPerPixel) & keyMask) != (*dstColorKey & keyMask))
+				{
+					continue;
+				}
+				if (srcColorKey && (getPixel(s, bytesPerPixel) & keyMask) == (*srcColorKey & keyMask))
+				{
+					continue;
+				}
+				std::memcpy(d, s, bytesPerPixel);
+			}
+		}
+	}
+
+	void referenceColorFill(BYTE* dst, DWORD dstPitch, DWORD dstWidth, DWORD dstHeight, DWORD bytesPerPixel, DWORD color)
+	{
+		for (DWORD y = 0; y < dstHeight; ++y)
+		{
+			for (DWORD x = 0; x < dstWidth; ++x)
+			{
+				std::memcpy(dst + y * dstPitch + x * bytesPerPixel, &color, bytesPerPixel);
+			}
+		}
+	}
+
+	unsigned verify()
+	{
+		std::mt19937 rng(1);
+		const DWORD widths[] = { 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 40, 63, 64, 65, 100, 257 };
+		unsigned runCount = 0;
+		unsigned failureCount = 0;
+
+		for (DWORD bytesPerPixel = 1; bytesPerPixel <= 4; ++bytesPerPixel)
+		{
+			for (DWORD width : widths)
+			{
+				for (const auto& bltCase : BLT_CASES)
+				{
+					const DWORD height = 5;
+					const LONG srcWidth = (width * bltCase.srcWidthNum + bltCase.srcWidthDen - 1) / bltCase.srcWidthDen;
+					const LONG srcHeight = 7;
+					const DWORD srcPitch = srcWidth * bytesPerPixel + 13;
+					const DWORD dstPitch = width * bytesPerPixel + 7;
+
+					// Few distinct byte values, so that color keys match often
+					std::vector<BYTE> src(srcPitch * srcHeight);
+					std::vector<BYTE> dst(dstPitch * height + 64);
+					for (auto& b : src)
+					{
+						b = rng() % 4;
+					}
+					for (auto& b : dst)
+					{
+						b = rng() % 4;
+					}
+					std::vector<BYTE> expected(dst);
+
+					const DWORD dstColorKey = 0x01010101;
+					const DWORD srcColorKey = 0x02020202;
+					const LONG signedSrcWidth = bltCase.mirrorX ? -srcWidth : srcWidth;
+					const LONG signedSrcHeight = bltCase.mirrorY ? -srcHeight : srcHeight;
+
+					DDraw::Blitter::blt(dst.data(), dstPitch, width, height, src.data(), srcPitch,
+						signedSrcWidth, signedSrcHeight, bytesPerPixel,
+						bltCase.dstColorKey ? &dstColorKey : nullptr, bltCase.srcColorKey ? &srcColorKey : nullptr);
+					referenceBlt(expected.data(), dstPitch, width, height, src.data(), srcPitch,
+						signedSrcWidth, signedSrcHeight, bytesPerPixel,
+						bltCase.dstColorKey ? &dstColorKey : nullptr, bltCase.srcColorKey ? &srcColorKey : nullptr);
+
+					++runCount;
+					if (dst != expected)
+					{
+						++failureCount;
+						std::printf("FAIL blt: bpp=%u width=%u srcWidth=%d case=%s\n",
+							bytesPerPixel, width, srcWidth, bltCase.name);
+					}
+				}
+
+				const DWORD pitch = width * bytesPerPixel + 5;
+				std::vector<BYTE> dst(pitch * 3 + 16, 0xCD);
+				std::vector<BYTE> expected(dst);
+				const DWORD color = rng();
+				DDraw::Blitter::colorFill(dst.data(), pitch, width, 3, bytesPerPixel, color);
+				referenceColorFill(expected.data(), pitch, width, 3, bytesPerPixel, color);
+
+				++runCount;
+				if (dst != expected)
+				{
+					++failureCount;
+					std::printf("FAIL colorFill: bpp=%u width=%u\n", bytesPerPixel, width);
+				}
+			}
+		}
+
+		std::printf("Verified %u cases, %u failed\n", runCount, failureCount);
+		return failureCount;
+	}
+
+	template <typename Func>
+	double measureNs(Func func, double minMs)
+	{
+		typedef std::chrono::steady_clock Clock;
+		func();
+
+		unsigned iterations = 0;
+		const auto start = Clock::now();
+		auto end = start;
+		do
+		{
+			func();
+			++iterations;
+			end = Clock::now();
+		} while (std::chrono::duration<double, std::milli>(end - start).count() < minMs);
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	}
+
+	void report(DWORD bytesPerPixel, const char* name, DWORD width, DWORD height, double ns)
+	{
+		const double pixelCount = static_cast<double>(width) * height;
+		std::printf("%3u  %-24s %5ux%-5u %10.1f %8.3f\n", bytesPerPixel, name, width, height,
+			pixelCount * bytesPerPixel / ns * 1e9 / (1024 * 1024), pixelCount / ns);
+	}
+
+	void benchmark(bool quick)
+	{
+		const double minMs = quick ? 20 : 200;
+		const DWORD sizes[][2] = { { 64, 64 }, { 640, 480 }, { 1920, 1080 } };
+
+		std::printf("bpp  %-24s %11s %10s %8s\n", "kernel", "size", "MB/s", "px/ns");
+		for (DWORD bytesPerPixel = 1; bytesPerPixel <= 4; ++bytesPerPixel)
+		{
+			for (const auto& size : sizes)
+			{
+				const DWORD width = size[0];
+				const DWORD height = size[1];
+				const DWORD dstPitch = width * bytesPerPixel;
+				std::vector<BYTE> dst(dstPitch * height);
+
+				for (const auto& bltCase : BLT_CASES)
+				{
+					const LONG srcWidth = (width * bltCase.srcWidthNum + bltCase.srcWidthDen - 1) / bltCase.srcWidthDen;
+					const LONG srcHeight = (height * bltCase.srcWidthNum + bltCase.srcWidthDen - 1) / bltCase.srcWidthDen;
+					const DWORD srcPitch = srcWidth * bytesPerPixel;
+					std::vector<BYTE> src(srcPitch * srcHeight);
+					for (std::size_t i = 0; i < src.size(); ++i)
+					{
+						src[i] = static_cast<BYTE>(i * 7 % 251);
+					}
+
+					const DWORD dstColorKey = 0;
+					const DWORD srcColorKey = 0x00070707;
+					const double ns = measureNs([&]() {
+						DDraw::Blitter::blt(dst.data(), dstPitch, width, height, src.data(), srcPitch,
+							bltCase.mirrorX ? -srcWidth : srcWidth, bltCase.mirrorY ? -srcHeight : srcHeight,
+							bytesPerPixel, bltCase.dstColorKey ? &dstColorKey : nullptr,
+							bltCase.srcColorKey ? &srcColorKey : nullptr);
+					}, minMs);
+					report(bytesPerPixel, bltCase.name, width, height, ns);
+				}
+
+				const double ns = measureNs([&]() {
+					DDraw::Blitter::colorFill(dst.data(), dstPitch, width, height, bytesPerPixel, 0x12345678);
+				}, minMs);
+				report(bytesPerPixel, "color fill", width, height, ns);
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool verifyOnly = false;
+	bool quick = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		if ("--verify" == arg)
+		{
+			verifyOnly = true;
+		}
+		else if ("--quick" == arg)
+		{
+			quick = true;
+		}
+		else
+		{
+			std::printf("Usage: BlitterBenchmark [--verify] [--quick]\n");
+			return 2;
+		}
+	}
+
+	if (0 != verify())
+	{
+		return 1;
+	}
+
+	if (!verifyOnly)
+	{
+		benchmark(quick);
+	}
+	return 0;
+}
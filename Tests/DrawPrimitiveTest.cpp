@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <D3dDdi/Adapter.h>
+#include <D3dDdi/Device.h>
+#include <D3dDdi/DynamicBuffer.h>
+#include <D3dDdi/Resource.h>
+#include <D3dDdi/SoftwareDevice.h>
+
+// Drives D3dDdi::DrawPrimitive through D3dDdi::Device against D3dDdi::SoftwareDevice. Each draw sequence is run
+// once with a flush after every draw and once batched, and the primitives the software device assembles from the
+// batched draws must match the unbatched ones. The dynamic buffers the batches are loaded into are also tested
+// directly for how they wrap, grow and shrink.
+
+namespace
+{
+	unsigned g_failureCount = 0;
+
+#define CHECK(cond, ...) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			++g_failureCount; \
+			std::printf("FAIL %s:%d: %s: ", __func__, __LINE__, #cond); \
+			std::printf(__VA_ARGS__); \
+			std::printf("\n"); \
+		} \
+	} while (false)
+
+	struct Vertex
+	{
+		float x;
+		UINT id;
+	};
+
+	// DirectDraw limits vertex buffers to D3DMAXNUMVERTICES vertices
+	const UINT VERTEX_COUNT = D3DMAXNUMVERTICES;
+
+	// Mirrors the ring layout and shrink delay of D3dDdi::DynamicBuffer
+	const UINT SEGMENT_COUNT = 4;
+	const UINT SHRINK_FRAME_COUNT = 256;
+	const UINT RING_SIZE = 1024;
+
+	typedef std::function<void(D3dDdi::Device&)> DrawSequence;
+	typedef std::vector<std::vector<UINT>> Primitives;
+
+	std::vector<Vertex> g_vertices;
+	HANDLE g_vertexBuffer = nullptr;
+	bool g_isBatched = false;
+
+	HANDLE createVertexBuffer()
+	{
+		D3DDDI_SURFACEINFO surfaceInfo = {};
+		surfaceInfo.Width = VERTEX_COUNT * sizeof(Vertex);
+		surfaceInfo.Height = 1;
+		surfaceInfo.pSysMem = g_vertices.data();
+
+		D3DDDIARG_CREATERESOURCE2 cr = {};
+		cr.Format = D3DDDIFMT_VERTEXDATA;
+		cr.Pool = D3DDDIPOOL_VIDEOMEMORY;
+		cr.pSurfList = &surfaceInfo;
+		cr.SurfCount = 1;
+		cr.Flags.VertexBuffer = 1;
+		cr.Rotation = D3DDDI_ROTATION_IDENTITY;
+		D3dDdi::SoftwareDevice::getVtable().pfnCreateResource2(nullptr, &cr);
+		return cr.hResource;
+	}
+
+	void draw(D3dDdi::Device& device, D3DPRIMITIVETYPE primitiveType, UINT vStart, UINT primitiveCount)
+	{
+		D3DDDIARG_DRAWPRIMITIVE dp = {};
+		dp.PrimitiveType = primitiveType;
+		dp.VStart = vStart;
+		dp.PrimitiveCount = primitiveCount;
+		device.drawPrimitive(&dp, nullptr);
+		if (!g_isBatched)
+		{
+			device.flushPrimitives();
+		}
+	}
+
+	void drawIndexed(D3dDdi::Device& device, D3DPRIMITIVETYPE primitiveType, INT baseVertexIndex,
+		std::vector<UINT16> indices)
+	{
+		UINT vertexCount = indices.size();
+		UINT primitiveCount = 0;
+		switch (primitiveType)
+		{
+		case D3DPT_POINTLIST:
+			primitiveCount = vertexCount;
+			break;
+		case D3DPT_LINELIST:
+			primitiveCount = vertexCount / 2;
+			break;
+		case D3DPT_LINESTRIP:
+			primitiveCount = vertexCount - 1;
+			break;
+		case D3DPT_TRIANGLELIST:
+			primitiveCount = vertexCount / 3;
+			break;
+		case D3DPT_TRIANGLESTRIP:
+		case D3DPT_TRIANGLEFAN:
+			primitiveCount = vertexCount - 2;
+			break;
+		}
+
+		D3DDDIARG_DRAWINDEXEDPRIMITIVE2 dp = {};
+		dp.PrimitiveType = primitiveType;
+		dp.BaseVertexOffset = baseVertexIndex * static_cast<INT>(sizeof(Vertex));
+		dp.PrimitiveCount = primitiveCount;
+		device.drawIndexedPrimitive2(&dp, sizeof(UINT16), indices.data(), nullptr);
+		if (!g_isBatched)
+		{
+			device.flushPrimitives();
+		}
+	}
+
+	UINT getDriverDrawCount(const D3dDdi::SoftwareDevice::Stats& stats)
+	{
+		UINT count = 0;
+		for (auto name : { "pfnDrawPrimitive", "pfnDrawIndexedPrimitive", "pfnDrawIndexedPrimitive2" })
+		{
+			auto it = stats.callCounts.find(name);
+			if (it != stats.callCounts.end())
+			{
+				count += it->second;
+			}
+		}
+		return count;
+	}
+
+	// Splits the captured vertices into primitives of vpp vertex ids each. Degenerate triangles, which batching adds
+	// to join strips, are dropped, and each primitive is rotated to start with its lowest id, keeping the winding.
+	Primitives getPrimitives(const std::vector<BYTE>& capturedVertices, UINT vpp)
+	{
+		std::vector<UINT> ids(capturedVertices.size() / sizeof(Vertex));
+		for (UINT i = 0; i < ids.size(); ++i)
+		{
+			Vertex vertex = {};
+			std::memcpy(&vertex, capturedVertices.data() + i * sizeof(Vertex), sizeof(vertex));
+			ids[i] = vertex.id;
+		}
+
+		Primitives primitives;
+		for (UINT i = 0; i + vpp <= ids.size(); i += vpp)
+		{
+			std::vector<UINT> primitive(ids.begin() + i, ids.begin() + i + vpp);
+			if (3 == vpp && (primitive[0] == primitive[1] || primitive[1] == primitive[2] || primitive[0] == primitive[2]))
+			{
+				continue;
+			}
+			std::rotate(primitive.begin(), std::min_element(primitive.begin(), primitive.end()), primitive.end());
+			primitives.push_back(primitive);
+		}
+		return primitives;
+	}
+
+	void setStreamSource(D3dDdi::Device& device, bool isUserMemory)
+	{
+		if (isUserMemory)
+		{
+			D3DDDIARG_SETSTREAMSOURCEUM ss = {};
+			ss.Stride = sizeof(Vertex);
+			device.setStreamSourceUm(&ss, g_vertices.data());
+		}
+		else
+		{
+			D3DDDIARG_SETSTREAMSOURCE ss = {};
+			ss.hVertexBuffer = g_vertexBuffer;
+			ss.Stride = sizeof(Vertex);
+			device.setStreamSource(&ss);
+		}
+	}
+
+	Primitives run(D3dDdi::Device& device, bool isUserMemory, bool isBatched, UINT vpp,
+		const DrawSequence& drawSequence, UINT& driverDrawCount)
+	{
+		setStreamSource(device, isUserMemory);
+		device.flushPrimitives();
+		D3dDdi::SoftwareDevice::resetStats();
+
+		std::vector<BYTE> capturedVertices;
+		D3dDdi::SoftwareDevice::capturePrimitives(&capturedVertices);
+		g_isBatched = isBatched;
+		drawSequence(device);
+		device.flushPrimitives();
+		D3dDdi::SoftwareDevice::capturePrimitives(nullptr);
+
+		auto stats = D3dDdi::SoftwareDevice::getStats();
+		driverDrawCount = getDriverDrawCount(stats);
+		CHECK(0 == stats.invalidIndexCount, "%llu indices outside the declared vertex range",
+			static_cast<unsigned long long>(stats.invalidIndexCount));
+		return getPrimitives(capturedVertices, vpp);
+	}
+
+	void testBatching(const char* name, UINT vpp, const DrawSequence& drawSequence)
+	{
+		for (HANDLE adapter : { static_cast<HANDLE>(nullptr), reinterpret_cast<HANDLE>(1) })
+		{
+			D3dDdi::Device device(adapter, reinterpret_cast<HANDLE>(1));
+			const UINT indexSize = D3dDdi::Adapter::get(adapter).getMaxVertexIndex() > 0xFFFF ? 4 : 2;
+
+			for (bool isUserMemory : { true, false })
+			{
+				UINT referenceDrawCount = 0;
+				UINT batchedDrawCount = 0;
+				Primitives reference = run(device, isUserMemory, false, vpp, drawSequence, referenceDrawCount);
+				Primitives batched = run(device, isUserMemory, true, vpp, drawSequence, batchedDrawCount);
+
+				CHECK(!reference.empty(), "%s, INDEX%u, %s: no primitives drawn",
+					name, indexSize * 8, isUserMemory ? "UM" : "VB");
+				CHECK(reference == batched, "%s, INDEX%u, %s: %zu primitives batched into %zu different ones",
+					name, indexSize * 8, isUserMemory ? "UM" : "VB", reference.size(), batched.size());
+				CHECK(batchedDrawCount < referenceDrawCount, "%s, INDEX%u, %s: %u draws batched into %u",
+					name, indexSize * 8, isUserMemory ? "UM" : "VB", referenceDrawCount, batchedDrawCount);
+			}
+		}
+	}
+
+	void testPoints()
+	{
+		testBatching("points", 1, [](D3dDdi::Device& device)
+			{
+				draw(device, D3DPT_POINTLIST, 0, 5);
+				draw(device, D3DPT_POINTLIST, 5, 7);
+				drawIndexed(device, D3DPT_POINTLIST, 20, { 3, 1, 4, 1, 5 });
+				draw(device, D3DPT_POINTLIST, 100, 3);
+			});
+	}
+
+	void testLines()
+	{
+		testBatching("lines", 2, [](D3dDdi::Device& device)
+			{
+				draw(device, D3DPT_LINELIST, 0, 4);
+				draw(device, D3DPT_LINESTRIP, 8, 5);
+				drawIndexed(device, D3DPT_LINELIST, 30, { 0, 1, 1, 2, 7, 3 });
+				drawIndexed(device, D3DPT_LINESTRIP, 40, { 9, 2, 6, 5 });
+				draw(device, D3DPT_LINELIST, 200, 2);
+			});
+	}
+
+	void testTriangles()
+	{
+		testBatching("triangles", 3, [](D3dDdi::Device& device)
+			{
+				draw(device, D3DPT_TRIANGLELIST, 0, 2);
+				draw(device, D3DPT_TRIANGLELIST, 6, 3);
+				draw(device, D3DPT_TRIANGLESTRIP, 20, 5);
+				draw(device, D3DPT_TRIANGLEFAN, 40, 4);
+				drawIndexed(device, D3DPT_TRIANGLELIST, 50, { 0, 1, 2, 2, 1, 3 });
+				drawIndexed(device, D3DPT_TRIANGLESTRIP, 60, { 4, 0, 5, 1, 6, 2 });
+				drawIndexed(device, D3DPT_TRIANGLEFAN, 70, { 8, 0, 1, 2, 3 });
+				draw(device, D3DPT_TRIANGLELIST, 300, 1);
+			});
+	}
+
+	void testTriangleStrips()
+	{
+		testBatching("triangle strips", 3, [](D3dDdi::Device& device)
+			{
+				draw(device, D3DPT_TRIANGLESTRIP, 0, 3);
+				draw(device, D3DPT_TRIANGLESTRIP, 10, 4);
+				drawIndexed(device, D3DPT_TRIANGLESTRIP, 20, { 1, 0, 3, 2, 5 });
+				draw(device, D3DPT_TRIANGLESTRIP, 30, 1);
+				drawIndexed(device, D3DPT_TRIANGLESTRIP, 40, { 0, 1, 2, 3 });
+			});
+	}
+
+	// Loads segmentCount whole segments of a RING_SIZE buffer, one per frame, and returns the index of the first one
+	INT loadSegments(D3dDdi::DynamicBuffer& buffer, UINT segmentCount)
+	{
+		INT firstIndex = -1;
+		for (UINT i = 0; i < segmentCount; ++i)
+		{
+			INT index = buffer.load(g_vertices.data(), RING_SIZE / SEGMENT_COUNT / sizeof(Vertex));
+			buffer.endFrame();
+			if (0 == i)
+			{
+				firstIndex = index;
+			}
+		}
+		return firstIndex;
+	}
+
+	void testWrapIntoBusySegment()
+	{
+		D3dDdi::Device device(nullptr, reinterpret_cast<HANDLE>(1));
+		D3dDdi::SoftwareDevice::setQueryBehavior(true, false);
+		D3dDdi::DynamicVertexBuffer buffer(device, RING_SIZE);
+		buffer.setStride(sizeof(Vertex));
+		loadSegments(buffer, SEGMENT_COUNT);
+
+		D3dDdi::SoftwareDevice::resetStats();
+		INT index = loadSegments(buffer, 1);
+		auto stats = D3dDdi::SoftwareDevice::getStats();
+		CHECK(0 == index, "wrapped to index %d", index);
+		CHECK(2 * RING_SIZE == buffer.getSize(), "size is %u", buffer.getSize());
+		CHECK(0 == stats.discardCount, "%u discards", stats.discardCount);
+
+		// The size the latency required is kept even though each frame only uses a fraction of it
+		D3dDdi::SoftwareDevice::setQueryBehavior(true, true);
+		for (UINT i = 0; i < 2 * SHRINK_FRAME_COUNT; ++i)
+		{
+			buffer.load(g_vertices.data(), 1);
+			buffer.endFrame();
+		}
+		buffer.load(g_vertices.data(), 1);
+		CHECK(2 * RING_SIZE == buffer.getSize(), "shrunk to %u", buffer.getSize());
+	}
+
+	void testWrapWithoutQueries()
+	{
+		D3dDdi::Device device(nullptr, reinterpret_cast<HANDLE>(1));
+		D3dDdi::SoftwareDevice::setQueryBehavior(false, false);
+		D3dDdi::DynamicVertexBuffer buffer(device, RING_SIZE);
+		buffer.setStride(sizeof(Vertex));
+		loadSegments(buffer, SEGMENT_COUNT);
+
+		D3dDdi::SoftwareDevice::resetStats();
+		INT index = loadSegments(buffer, 1);
+		auto stats = D3dDdi::SoftwareDevice::getStats();
+		CHECK(0 == index, "wrapped to index %d", index);
+		CHECK(RING_SIZE == buffer.getSize(), "size is %u", buffer.getSize());
+		CHECK(1 == stats.discardCount, "%u discards", stats.discardCount);
+		D3dDdi::SoftwareDevice::setQueryBehavior(true, true);
+	}
+
+	void testShrink()
+	{
+		D3dDdi::Device device(nullptr, reinterpret_cast<HANDLE>(1));
+		D3dDdi::DynamicVertexBuffer buffer(device, RING_SIZE);
+		buffer.setStride(sizeof(Vertex));
+		buffer.load(g_vertices.data(), 4 * RING_SIZE / sizeof(Vertex));
+		buffer.endFrame();
+
+		buffer.load(g_vertices.data(), 1);
+		const UINT peakSize = buffer.getSize();
+		UINT frameCount = 0;
+		while (buffer.getSize() == peakSize && frameCount <= SHRINK_FRAME_COUNT)
+		{
+			buffer.endFrame();
+			++frameCount;
+			buffer.load(g_vertices.data(), 1);
+		}
+
+		CHECK(peakSize > 4 * RING_SIZE, "grown to %u", peakSize);
+		CHECK(peakSize / 2 == buffer.getSize(), "shrunk from %u to %u", peakSize, buffer.getSize());
+		CHECK(SHRINK_FRAME_COUNT == frameCount, "shrunk after %u frames", frameCount);
+	}
+
+	// Each segment must span at least one byte, or the segment of a position can't be computed
+	void testTinyBuffer()
+	{
+		D3dDdi::Device device(nullptr, reinterpret_cast<HANDLE>(1));
+		D3dDdi::DynamicVertexBuffer buffer(device, 2);
+		buffer.setStride(1);
+		CHECK(buffer.getSize() >= SEGMENT_COUNT, "size is %u", buffer.getSize());
+		for (UINT i = 0; i < 2 * SEGMENT_COUNT; ++i)
+		{
+			INT index = buffer.load(g_vertices.data(), 1);
+			CHECK(index >= 0, "load %u failed", i);
+		}
+	}
+
+	// Batched user memory vertices are copied, so with 32-bit indices a batch can address more than 0xFFFF of them
+	void testLargeBatch()
+	{
+		testBatching("large batch", 3, [](D3dDdi::Device& device)
+			{
+				for (UINT i = 0; i < 1300; ++i)
+				{
+					draw(device, D3DPT_TRIANGLEFAN, i * 64 % (VERTEX_COUNT - 64), 30);
+					draw(device, D3DPT_TRIANGLESTRIP, i * 64 % (VERTEX_COUNT - 64) + 32, 30);
+				}
+			});
+	}
+}
+
+int main()
+{
+	g_vertices.resize(VERTEX_COUNT);
+	for (UINT i = 0; i < VERTEX_COUNT; ++i)
+	{
+		g_vertices[i] = { static_cast<float>(i), i };
+	}
+	g_vertexBuffer = createVertexBuffer();
+
+	testPoints();
+	testLines();
+	testTriangles();
+	testTriangleStrips();
+	testLargeBatch();
+	testWrapIntoBusySegment();
+	testWrapWithoutQueries();
+	testShrink();
+	testTinyBuffer();
+
+	std::printf("%u failures\n", g_failureCount);
+	return 0 == g_failureCount ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <D3dDdi/IndexKernels.h>
+
+// Checks the D3dDdi::IndexKernels functions against scalar references for a range of primitive counts,
+// then reports the throughput of each kernel next to its scalar reference.
+// Usage: IndexKernelBenchmark [--verify] [--quick]
+
+namespace
+{
+	using namespace D3dDdi;
+
+	const UINT GUARD = 0xCDCDCDCD;
+	const UINT GUARD_COUNT = 8;
+
+	namespace Reference
+	{
+		void addIndexOffset(UINT* dst, const UINT16* src, UINT count, INT offset)
+		{
+			for (UINT i = 0; i < count; ++i)
+			{
+				dst[i] = src[i] + offset;
+			}
+		}
+
+		void addIndexOffset(UINT* indices, UINT count, INT offset)
+		{
+			for (UINT i = 0; i < count; ++i)
+			{
+				indices[i] += offset;
+			}
+		}
+
+		void expandIndexedLineStrip(UINT* indices, UINT primitiveCount)
+		{
+			const std::vector<UINT> src(indices, indices + primitiveCount + 1);
+			for (UINT i = 0; i < primitiveCount; ++i)
+			{
+				indices[2 * i] = src[i];
+				indices[2 * i + 1] = src[i + 1];
+			}
+		}
+
+		void expandIndexedTriangleFan(UINT* indices, UINT primitiveCount)
+		{
+			const std::vector<UINT> src(indices, indices + primitiveCount + 2);
+			for (UINT i = 0; i < primitiveCount; ++i)
+			{
+				indices[3 * i] = src[i + 1];
+				indices[3 * i + 1] = src[i + 2];
+				indices[3 * i + 2] = src[0];
+			}
+		}
+
+		void expandIndexedTriangleStrip(UINT* indices, UINT primitiveCount)
+		{
+			const std::vector<UINT> src(indices, indices + primitiveCount + 2);
+			for (UINT i = 0; i < primitiveCount; ++i)
+			{
+				indices[3 * i] = src[i];
+				indices[3 * i + 1] = src[i + 1 + i % 2];
+				indices[3 * i + 2] = src[i + 2 - i % 2];
+			}
+		}
+
+		void generateIndexRange(UINT* dst, UINT base, UINT count)
+		{
+			for (UINT i = 0; i < count; ++i)
+			{
+				dst[i] = base + i;
+			}
+		}
+
+		void generateLineStripList(UINT* dst, UINT base, UINT primitiveCount)
+		{
+			for (UINT i = 0; i < primitiveCount; ++i)
+			{
+				dst[2 * i] = base + i;
+				dst[2 * i + 1] = base + i + 1;
+			}
+		}
+
+		void generateTriangleFanList(UINT* dst, UINT base, UINT primitiveCount)
+		{
+			for (UINT i = 0; i < primitiveCount; ++i)
+			{
+				dst[3 * i] = base + i + 1;
+				dst[3 * i + 1] = base + i + 2;
+				dst[3 * i + 2] = base;
+			}
+		}
+
+		void generateTriangleStripList(UINT* dst, UINT base, UINT primitiveCount)
+		{
+			for (UINT i = 0; i < primitiveCount; ++i)
+			{
+				dst[3 * i] = base + i;
+				dst[3 * i + 1] = base + i + 1 + i % 2;
+				dst[3 * i + 2] = base + i + 2 - i % 2;
+			}
+		}
+
+		UINT16* narrowIndices(UINT* indices, UINT count)
+		{
+			std::vector<UINT16> narrowed(indices, indices + count);
+			std::memcpy(indices, narrowed.data(), count * sizeof(UINT16));
+			return reinterpret_cast<UINT16*>(indices);
+		}
+	}
+
+	// A kernel that transforms a UINT buffer of bufferSize(count) elements in place or from a fixed source
+	struct Kernel
+	{
+		const char* name;
+		std::function<UINT(UINT count)> getBufferSize;
+		std::function<UINT(UINT count)> getOutputBytes;
+		std::function<void(UINT* buffer, UINT count)> run;
+		std::function<void(UINT* buffer, UINT count)> runReference;
+	};
+
+	std::vector<UINT> g_source;
+	std::vector<UINT16> g_source16;
+	const UINT BASE = 70000;
+	const INT OFFSET = -1234;
+
+	void fillSource(UINT* buffer, UINT count)
+	{
+		std::memcpy(buffer, g_source.data(), count * sizeof(UINT));
+	}
+
+	std::vector<Kernel> getKernels()
+	{
+		auto sameSize = [](UINT count) { return count; };
+		auto times2 = [](UINT count) { return 2 * count; };
+		auto times3 = [](UINT count) { return 3 * count; };
+		auto bytes = [](UINT count) { return count * 4; };
+		auto bytes2 = [](UINT count) { return count * 8; };
+		auto bytes3 = [](UINT count) { return count * 12; };
+
+		return {
+			{ "addIndexOffset 16->32", sameSize, bytes,
+				[](UINT* b, UINT n) { IndexKernels::addIndexOffset(b, g_source16.data(), n, OFFSET); },
+				[](UINT* b, UINT n) { Reference::addIndexOffset(b, g_source16.data(), n, OFFSET); } },
+			{ "addIndexOffset 32", sameSize, bytes,
+				[](UINT* b, UINT n) { fillSource(b, n); IndexKernels::addIndexOffset(b, n, OFFSET); },
+				[](UINT* b, UINT n) { fillSource(b, n); Reference::addIndexOffset(b, n, OFFSET); } },
+			{ "expandIndexedLineStrip", times2, bytes2,
+				[](UINT* b, UINT n) { fillSource(b, n + 1); IndexKernels::expandIndexedLineStrip(b, n); },
+				[](UINT* b, UINT n) { fillSource(b, n + 1); Reference::expandIndexedLineStrip(b, n); } },
+			{ "expandIndexedTriangleFan", times3, bytes3,
+				[](UINT* b, UINT n) { fillSource(b, n + 2); IndexKernels::expandIndexedTriangleFan(b, n); },
+				[](UINT* b, UINT n) { fillSource(b, n + 2); Reference::expandIndexedTriangleFan(b, n); } },
+			{ "expandIndexedTriangleStrip", times3, bytes3,
+				[](UINT* b, UINT n) { fillSource(b, n + 2); IndexKernels::expandIndexedTriangleStrip(b, n); },
+				[](UINT* b, UINT n) { fillSource(b, n + 2); Reference::expandIndexedTriangleStrip(b, n); } },
+			{ "generateIndexRange", sameSize, bytes,
+				[](UINT* b, UINT n) { IndexKernels::generateIndexRange(b, BASE, n); },
+				[](UINT* b, UINT n) { Reference::generateIndexRange(b, BASE, n); } },
+			{ "generateLineStripList", times2, bytes2,
+				[](UINT* b, UINT n) { IndexKernels::generateLineStripList(b, BASE, n); },
+				[](UINT* b, UINT n) { Reference::generateLineStripList(b, BASE, n); } },
+			{ "generateTriangleFanList", times3, bytes3,
+				[](UINT* b, UINT n) { IndexKernels::generateTriangleFanList(b, BASE, n); },
+				[](UINT* b, UINT n) { Reference::generateTriangleFanList(b, BASE, n); } },
+			{ "generateTriangleStripList", times3, bytes3,
+				[](UINT* b, UINT n) { IndexKernels::generateTriangleStripList(b, BASE, n); },
+				[](UINT* b, UINT n) { Reference::generateTriangleStripList(b, BASE, n); } },
+			{ "narrowIndices", sameSize, [](UINT count) { return count * 2; },
+				[](UINT* b, UINT n) { fillSource(b, n); IndexKernels::narrowIndices(b, n); },
+				[](UINT* b, UINT n) { fillSource(b, n); Reference::narrowIndices(b, n); } }
+		};
+	}
+
+	unsigned verify(const std::vector<Kernel>& kernels)
+	{
+		unsigned runCount = 0;
+		unsigned failureCount = 0;
+		for (const auto& kernel : kernels)
+		{
+			for (UINT count = 1; count <= 100; ++count)
+			{
+				const UINT size = kernel.getBufferSize(count) + 2;
+				std::vector<UINT> actual(size + GUARD_COUNT, GUARD);
+				std::vector<UINT> expected(actual);
+				kernel.run(actual.data(), count);
+				kernel.runReference(expected.data(), count);
+
+				++runCount;
+				if (0 != std::memcmp(actual.data(), expected.data(), kernel.getOutputBytes(count)) ||
+					0 != std::memcmp(actual.data() + size, expected.data() + size, GUARD_COUNT * sizeof(UINT)))
+				{
+					++failureCount;
+					std::printf("FAIL %s: count=%u\n", kernel.name, count);
+				}
+			}
+		}
+
+		std::printf("Verified %u cases, %u failed\n", runCount, failureCount);
+		return failureCount;
+	}
+
+	double measureNs(const std::function<void()>& func, double minMs)
+	{
+		typedef std::chrono::steady_clock Clock;
+		func();
+
+		unsigned iterations = 0;
+		const auto start = Clock::now();
+		auto end = start;
+		do
+		{
+			func();
+			++iterations;
+			end = Clock::now();
+		} while (std::chrono::duration<double, std::milli>(end - start).count() < minMs);
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	}
+
+	void benchmark(const std::vector<Kernel>& kernels, bool quick)
+	{
+		const double minMs = quick ? 20 : 200;
+		const UINT counts[] = { 64, 4096, 65536 };
+
+		std::printf("%-28s %6s %10s %10s %10s %8s\n", "kernel", "count", "MB/s", "ref MB/s", "idx/ns", "speedup");
+		for (const auto& kernel : kernels)
+		{
+			for (UINT count : counts)
+			{
+				std::vector<UINT> buffer(kernel.getBufferSize(count) + 2);
+				const double ns = measureNs([&]() { kernel.run(buffer.data(), count); }, minMs);
+				const double refNs = measureNs([&]() { kernel.runReference(buffer.data(), count); }, minMs);
+				const double outputBytes = kernel.getOutputBytes(count);
+				std::printf("%-28s %6u %10.1f %10.1f %10.3f %7.2fx\n", kernel.name, count,
+					outputBytes / ns * 1e9 / (1024 * 1024), outputBytes / refNs * 1e9 / (1024 * 1024),
+					kernel.getBufferSize(count) / ns, refNs / ns);
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool verifyOnly = false;
+	bool quick = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		if ("--verify" == arg)
+		{
+			verifyOnly = true;
+		}
+		else if ("--quick" == arg)
+		{
+			quick = true;
+		}
+		else
+		{
+			std::printf("Usage: IndexKernelBenchmark [--verify] [--quick]\n");
+			return 2;
+		}
+	}
+
+	std::mt19937 rng(1);
+	g_source.resize(3 * 65536 + 2);
+	for (auto& index : g_source)
+	{
+		index = rng() % 100000;
+	}
+	g_source16.resize(g_source.size());
+	for (auto& index : g_source16)
+	{
+		index = static_cast<UINT16>(rng());
+	}
+
+	const auto kernels = getKernels();
+	if (0 != verify(kernels))
+	{
+		return 1;
+	}
+
+	if (!verifyOnly)
+	{
+		benchmark(kernels, quick);
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <iostream>
+
+// Stand-in for Common/Log.h, which depends on the DirectDraw and Win32 log formatters. Messages go to std::clog.
+
+#define LOG_DEBUG if (false) Compat::Log()
+#define LOG_FUNC(...)
+#define LOG_RESULT(...) __VA_ARGS__
+
+#define LOG_ONCE(msg) \
+	{ \
+		static bool isAlreadyLogged = false; \
+		if (!isAlreadyLogged) \
+		{ \
+			Compat::Log() << msg; \
+			isAlreadyLogged = true; \
+		} \
+	}
+
+namespace Compat
+{
+	namespace detail
+	{
+		template <typename T>
+		struct Hex
+		{
+			explicit Hex(T val) : val(val) {}
+			T val;
+		};
+
+		template <typename T>
+		std::ostream& operator<<(std::ostream& os, Hex<T> hex)
+		{
+			os << "0x" << std::hex << hex.val << std::dec;
+			return os;
+		}
+	}
+
+	template <typename T> detail::Hex<T> hex(T val)
+	{
+		return detail::Hex<T>(val);
+	}
+
+	class Log
+	{
+	public:
+		~Log()
+		{
+			std::clog << std::endl;
+		}
+
+		template <typename T>
+		Log& operator<<(const T& t)
+		{
+			std::clog << t;
+			return *this;
+		}
+	};
+}
@@ -0,0 +1,80 @@
+#include <D3dDdi/Adapter.h>
+#include <D3dDdi/Device.h>
+#include <D3dDdi/Hooks.h>
+#include <D3dDdi/Resource.h>
+#include <D3dDdi/SoftwareDevice.h>
+
+// Stand-in for the parts of D3dDdi::Adapter and D3dDdi::Device that DrawPrimitive, DynamicBuffer and DeviceState
+// depend on. The real classes query the kernel-mode driver and hook the user-mode driver, while the portable tests
+// always run against D3dDdi::SoftwareDevice. A non-null adapter stands for a driver that can address 32-bit indices.
+
+namespace D3dDdi
+{
+	Adapter::Adapter(HANDLE adapter, HMODULE module)
+		: m_adapter(adapter)
+		, m_module(module)
+		, m_d3dExtendedCaps{}
+		, m_ddrawCaps{}
+		, m_maxVertexIndex(adapter ? 0xFFFFFF : 0xFFFF)
+	{
+	}
+
+	Adapter& Adapter::get(HANDLE adapter)
+	{
+		auto it = s_adapters.find(adapter);
+		if (it != s_adapters.end())
+		{
+			return it->second;
+		}
+
+		return s_adapters.emplace(adapter, Adapter(adapter, nullptr)).first->second;
+	}
+
+	std::map<HANDLE, Adapter> Adapter::s_adapters;
+
+	Device::Device(HANDLE adapter, HANDLE device)
+		: m_origVtable(SoftwareDevice::getVtable())
+		, m_adapter(Adapter::get(adapter))
+		, m_device(device)
+		, m_renderTarget(nullptr)
+		, m_renderTargetSubResourceIndex(0)
+		, m_sharedPrimary(nullptr)
+		, m_drawPrimitive(*this)
+		, m_state(*this)
+		, m_isSrcColorKeySupported(false)
+	{
+	}
+
+	HRESULT Device::createPrivateResource(D3DDDIARG_CREATERESOURCE2& data)
+	{
+		return m_origVtable.pfnCreateResource2(m_device, &data);
+	}
+
+	HRESULT Device::drawIndexedPrimitive2(const D3DDDIARG_DRAWINDEXEDPRIMITIVE2* data,
+		UINT /*indicesSize*/, const void* indexBuffer, const UINT* flagBuffer)
+	{
+		m_state.applyState();
+		return m_drawPrimitive.drawIndexed(*data, static_cast<const UINT16*>(indexBuffer), flagBuffer);
+	}
+
+	HRESULT Device::drawPrimitive(const D3DDDIARG_DRAWPRIMITIVE* data, const UINT* flagBuffer)
+	{
+		m_state.applyState();
+		return m_drawPrimitive.draw(*data, flagBuffer);
+	}
+
+	HRESULT Device::setStreamSource(const D3DDDIARG_SETSTREAMSOURCE* data)
+	{
+		return m_drawPrimitive.setStreamSource(*data);
+	}
+
+	HRESULT Device::setStreamSourceUm(const D3DDDIARG_SETSTREAMSOURCEUM* data, const void* umBuffer)
+	{
+		return m_drawPrimitive.setStreamSourceUm(*data, umBuffer);
+	}
+
+	UINT getDdiVersion()
+	{
+		return D3D_UMD_INTERFACE_VERSION_WDDM2_1_2;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// Minimal stand-in for the Windows SDK headers, covering only what the portable targets use.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+typedef std::uint8_t BYTE;
+typedef std::uint16_t WORD;
+typedef std::uint32_t DWORD;
+typedef std::int32_t LONG;
+typedef std::int32_t INT;
+typedef std::uint32_t UINT;
+typedef std::uint16_t UINT16;
+typedef std::uint32_t UINT32;
+typedef std::uint64_t ULONGLONG;
+typedef int BOOL;
+typedef float FLOAT;
+typedef wchar_t WCHAR;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef LONG HRESULT;
+
+#define FALSE 0
+#define TRUE 1
+#define MAXDWORD 0xFFFFFFFF
+
+#define S_OK static_cast<HRESULT>(0)
+#define E_NOTIMPL static_cast<HRESULT>(0x80004001)
+#define E_FAIL static_cast<HRESULT>(0x80004005)
+#define E_INVALIDARG static_cast<HRESULT>(0x80070057)
+#define SUCCEEDED(hr) (static_cast<HRESULT>(hr) >= 0)
+#define FAILED(hr) (static_cast<HRESULT>(hr) < 0)
+
+#define APIENTRY
+
+#ifndef _MSC_VER
+#define __forceinline inline __attribute__((always_inline))
+#endif
+
+// Like the windef.h macros, these accept mixed argument types, but only of the same signedness, since comparing
+// signed and unsigned values would silently convert the signed one
+template <typename T1, typename T2>
+using EnableIfSameSignedness = std::enable_if_t<std::is_signed_v<T1> == std::is_signed_v<T2>, int>;
+
+template <typename T1, typename T2, EnableIfSameSignedness<T1, T2> = 0>
+constexpr std::common_type_t<T1, T2> max(T1 a, T2 b) { return a > b ? a : b; }
+template <typename T1, typename T2, EnableIfSameSignedness<T1, T2> = 0>
+constexpr std::common_type_t<T1, T2> min(T1 a, T2 b) { return a < b ? a : b; }
+
+struct RECT
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+};
+
+// The portable targets are single-threaded apart from the worker pool, which doesn't use these
+struct CRITICAL_SECTION
+{
+	int unused;
+};
+
+inline void InitializeCriticalSection(CRITICAL_SECTION*) {}
+inline void DeleteCriticalSection(CRITICAL_SECTION*) {}
+inline void EnterCriticalSection(CRITICAL_SECTION*) {}
+inline void LeaveCriticalSection(CRITICAL_SECTION*) {}
+
+inline BOOL EqualRect(const RECT* r1, const RECT* r2)
+{
+	return 0 == std::memcmp(r1, r2, sizeof(RECT));
+}
+
+inline BOOL IntersectRect(RECT* dst, const RECT* src1, const RECT* src2)
+{
+	dst->left = max(src1->left, src2->left);
+	dst->top = max(src1->top, src2->top);
+	dst->right = min(src1->right, src2->right);
+	dst->bottom = min(src1->bottom, src2->bottom);
+	if (dst->left >= dst->right || dst->top >= dst->bottom)
+	{
+		*dst = {};
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,53 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Common/WorkerPool.h"
+
+namespace
+{
+	struct Job
+	{
+		void(*func)(void* context, unsigned index);
+		void* context;
+		unsigned count;
+		std::atomic<unsigned> nextIndex;
+	};
+
+	void runJob(Job& job)
+	{
+		unsigned index = job.nextIndex++;
+		while (index < job.count)
+		{
+			job.func(job.context, index);
+			index = job.nextIndex++;
+		}
+	}
+}
+
+namespace Compat
+{
+	namespace WorkerPool
+	{
+		unsigned getConcurrency()
+		{
+			const unsigned count = std::thread::hardware_concurrency();
+			return 0 != count ? count : 1;
+		}
+
+		void parallelFor(unsigned count, void(*func)(void* context, unsigned index), void* context)
+		{
+			Job job = { func, context, count, {} };
+			std::vector<std::thread> threads;
+			for (unsigned i = 1; i < count; ++i)
+			{
+				threads.emplace_back([&]() { runJob(job); });
+			}
+			runJob(job);
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Windows.h>
+
+typedef DWORD D3DCOLOR;
+typedef float D3DVALUE;
+
+enum D3DPRIMITIVETYPE
+{
+	D3DPT_POINTLIST = 1,
+	D3DPT_LINELIST = 2,
+	D3DPT_LINESTRIP = 3,
+	D3DPT_TRIANGLELIST = 4,
+	D3DPT_TRIANGLESTRIP = 5,
+	D3DPT_TRIANGLEFAN = 6
+};
+
+struct D3DTLVERTEX
+{
+	D3DVALUE sx;
+	D3DVALUE sy;
+	D3DVALUE sz;
+	D3DVALUE rhw;
+	D3DCOLOR color;
+	D3DCOLOR specular;
+	D3DVALUE tu;
+	D3DVALUE tv;
+};
+
+#define D3DCLEAR_TARGET 0x00000001
+#define D3DFVF_XYZRHW 0x004
+#define D3DMAXNUMVERTICES ((1 << 16) - 1)
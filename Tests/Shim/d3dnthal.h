@@ -0,0 +1,16 @@
+#pragma once
+
+#include <Windows.h>
+
+struct D3DNTHAL_D3DEXTENDEDCAPS
+{
+	DWORD dwSize;
+};
+
+struct DDRAW_CAPS
+{
+	DWORD Caps;
+	DWORD Caps2;
+	DWORD CKeyCaps;
+	DWORD FxCaps;
+};
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <d3d.h>
+
+enum D3DDDIFORMAT
+{
+	D3DDDIFMT_UNKNOWN = 0,
+	D3DDDIFMT_R8G8B8 = 20,
+	D3DDDIFMT_A8R8G8B8 = 21,
+	D3DDDIFMT_X8R8G8B8 = 22,
+	D3DDDIFMT_R5G6B5 = 23,
+	D3DDDIFMT_X1R5G5B5 = 24,
+	D3DDDIFMT_A1R5G5B5 = 25,
+	D3DDDIFMT_A4R4G4B4 = 26,
+	D3DDDIFMT_R3G3B2 = 27,
+	D3DDDIFMT_A8 = 28,
+	D3DDDIFMT_A8R3G3B2 = 29,
+	D3DDDIFMT_X4R4G4B4 = 30,
+	D3DDDIFMT_A8B8G8R8 = 32,
+	D3DDDIFMT_X8B8G8R8 = 33,
+	D3DDDIFMT_A8P8 = 40,
+	D3DDDIFMT_P8 = 41,
+	D3DDDIFMT_G8R8 = 91,
+	D3DDDIFMT_R8 = 92,
+	D3DDDIFMT_VERTEXDATA = 100,
+	D3DDDIFMT_INDEX16 = 101,
+	D3DDDIFMT_INDEX32 = 102
+};
+
+enum D3DDDIPOOL
+{
+	D3DDDIPOOL_SYSTEMMEM = 1,
+	D3DDDIPOOL_VIDEOMEMORY = 2,
+	D3DDDIPOOL_LOCALVIDMEM = 3,
+	D3DDDIPOOL_NONLOCALVIDMEM = 4
+};
+
+enum D3DDDI_ROTATION
+{
+	D3DDDI_ROTATION_IDENTITY = 1
+};
+
+enum D3DDDIQUERYTYPE
+{
+	D3DDDIQUERYTYPE_EVENT = 8
+};
+
+enum D3DDDIRENDERSTATETYPE
+{
+	D3DDDIRS_ZENABLE = 7,
+	D3DDDIRS_SCISSORTESTENABLE = 174,
+	D3DDDIRS_BLENDOPALPHA = 209
+};
+
+enum D3DDDITEXTURESTAGESTATETYPE
+{
+	D3DDDITSS_COLOROP = 1,
+	D3DDDITSS_DISABLETEXTURECOLORKEY = 36,
+	D3DDDITSS_TEXTURECOLORKEYVAL = 37
+};
+
+#define D3D_UMD_INTERFACE_VERSION_WIN7 0x2003
+#define D3D_UMD_INTERFACE_VERSION_WIN8 0x3003
+#define D3D_UMD_INTERFACE_VERSION_WDDM1_3 0x4002
+#define D3D_UMD_INTERFACE_VERSION_WDDM2_0 0x5002
+#define D3D_UMD_INTERFACE_VERSION_WDDM2_1_2 0x6004
+
+struct D3DDDI_RESOURCEFLAGS
+{
+	union
+	{
+		struct
+		{
+			UINT RenderTarget : 1;
+			UINT ZBuffer : 1;
+			UINT Dynamic : 1;
+			UINT HintStatic : 1;
+			UINT AutogenMipmap : 1;
+			UINT DMapTexture : 1;
+			UINT WriteOnly : 1;
+			UINT NotLockable : 1;
+			UINT Points : 1;
+			UINT RtPatches : 1;
+			UINT NPatches : 1;
+			UINT SharedResource : 1;
+			UINT DiscardRenderTarget : 1;
+			UINT Video : 1;
+			UINT CaptureBuffer : 1;
+			UINT Primary : 1;
+			UINT Texture : 1;
+			UINT CubeMap : 1;
+			UINT Volume : 1;
+			UINT VertexBuffer : 1;
+			UINT IndexBuffer : 1;
+		};
+		UINT Value;
+	};
+};
+
+struct D3DDDI_SURFACEINFO
+{
+	UINT Width;
+	UINT Height;
+	UINT Depth;
+	const void* pSysMem;
+	UINT SysMemPitch;
+	UINT SysMemSlicePitch;
+};
+
+struct D3DDDIARG_CREATERESOURCE
+{
+	D3DDDIFORMAT Format;
+	D3DDDIPOOL Pool;
+	UINT MultisampleType;
+	UINT MultisampleQuality;
+	const D3DDDI_SURFACEINFO* pSurfList;
+	UINT SurfCount;
+	UINT MipLevels;
+	UINT Fvf;
+	UINT VidPnSourceId;
+	UINT RefreshRate[2];
+	HANDLE hResource;
+	D3DDDI_RESOURCEFLAGS Flags;
+	D3DDDI_ROTATION Rotation;
+};
+
+struct D3DDDIARG_CREATERESOURCE2 : D3DDDIARG_CREATERESOURCE
+{
+	UINT Flags2;
+};
+
+struct D3DDDIRANGE
+{
+	UINT Offset;
+	UINT Size;
+};
+
+struct D3DDDIARG_LOCK
+{
+	HANDLE hResource;
+	UINT SubResourceIndex;
+	union
+	{
+		RECT Area;
+		D3DDDIRANGE Range;
+	};
+	void* pSurfData;
+	UINT Pitch;
+	UINT SlicePitch;
+	struct
+	{
+		UINT ReadOnly : 1;
+		UINT WriteOnly : 1;
+		UINT NoOverwrite : 1;
+		UINT Discard : 1;
+		UINT RangeValid : 1;
+		UINT AreaValid : 1;
+		UINT BoxValid : 1;
+		UINT NotifyOnly : 1;
+	} Flags;
+};
+
+struct D3DDDIARG_UNLOCK
+{
+	HANDLE hResource;
+	UINT SubResourceIndex;
+	struct
+	{
+		UINT NotifyOnly : 1;
+	} Flags;
+};
+
+struct D3DDDIARG_BLT
+{
+	HANDLE hSrcResource;
+	UINT SrcSubResourceIndex;
+	RECT SrcRect;
+	HANDLE hDstResource;
+	UINT DstSubResourceIndex;
+	RECT DstRect;
+	DWORD ColorKey;
+	struct
+	{
+		UINT Point : 1;
+		UINT Linear : 1;
+		UINT SrcColorKey : 1;
+		UINT DstColorKey : 1;
+		UINT MirrorLeftRight : 1;
+		UINT MirrorUpDown : 1;
+		UINT Rotate : 1;
+		UINT Present : 1;
+	} Flags;
+};
+
+struct D3DDDIARG_COLORFILL
+{
+	HANDLE hResource;
+	UINT SubResourceIndex;
+	RECT DstRect;
+	D3DCOLOR Color;
+	UINT Flags;
+};
+
+struct D3DDDIARG_CLEAR
+{
+	UINT Flags;
+	D3DCOLOR FillColor;
+	FLOAT FillDepth;
+	UINT FillStencil;
+};
+
+struct D3DDDIARG_DRAWPRIMITIVE
+{
+	D3DPRIMITIVETYPE PrimitiveType;
+	UINT VStart;
+	UINT PrimitiveCount;
+};
+
+struct D3DDDIARG_DRAWINDEXEDPRIMITIVE
+{
+	D3DPRIMITIVETYPE PrimitiveType;
+	INT BaseVertexIndex;
+	UINT MinIndex;
+	UINT NumVertices;
+	UINT StartIndex;
+	UINT PrimitiveCount;
+};
+
+struct D3DDDIARG_DRAWINDEXEDPRIMITIVE2
+{
+	D3DPRIMITIVETYPE PrimitiveType;
+	INT BaseVertexOffset;
+	UINT MinIndex;
+	UINT NumVertices;
+	UINT StartIndexOffset;
+	UINT PrimitiveCount;
+};
+
+struct D3DDDIARG_SETSTREAMSOURCE
+{
+	UINT Stream;
+	HANDLE hVertexBuffer;
+	UINT Offset;
+	UINT Stride;
+};
+
+struct D3DDDIARG_SETSTREAMSOURCEUM
+{
+	UINT Stream;
+	UINT Stride;
+};
+
+struct D3DDDIARG_SETINDICES
+{
+	HANDLE hIndexBuffer;
+	UINT Stride;
+};
+
+struct D3DDDIARG_RENDERSTATE
+{
+	D3DDDIRENDERSTATETYPE State;
+	UINT Value;
+};
+
+struct D3DDDIARG_TEXTURESTAGESTATE
+{
+	UINT Stage;
+	D3DDDITEXTURESTAGESTATETYPE State;
+	UINT Value;
+};
+
+struct D3DDDIARG_WINFO
+{
+	FLOAT WNear;
+	FLOAT WFar;
+};
+
+struct D3DDDIARG_ZRANGE
+{
+	FLOAT MinZ;
+	FLOAT MaxZ;
+};
+
+struct D3DDDIARG_VIEWPORTINFO
+{
+	UINT X;
+	UINT Y;
+	UINT Width;
+	UINT Height;
+};
+
+struct D3DDDIARG_SETSHADERCONST
+{
+	UINT Register;
+	UINT Count;
+};
+
+typedef D3DDDIARG_SETSHADERCONST D3DDDIARG_SETPIXELSHADERCONST;
+typedef D3DDDIARG_SETSHADERCONST D3DDDIARG_SETPIXELSHADERCONSTB;
+typedef D3DDDIARG_SETSHADERCONST D3DDDIARG_SETPIXELSHADERCONSTI;
+typedef D3DDDIARG_SETSHADERCONST D3DDDIARG_SETVERTEXSHADERCONST;
+typedef D3DDDIARG_SETSHADERCONST D3DDDIARG_SETVERTEXSHADERCONSTB;
+typedef D3DDDIARG_SETSHADERCONST D3DDDIARG_SETVERTEXSHADERCONSTI;
+
+struct D3DDDIARG_CREATEQUERY
+{
+	D3DDDIQUERYTYPE QueryType;
+	HANDLE hQuery;
+};
+
+struct D3DDDIARG_ISSUEQUERY
+{
+	HANDLE hQuery;
+	struct
+	{
+		UINT Begin : 1;
+		UINT End : 1;
+	} Flags;
+};
+
+struct D3DDDIARG_GETQUERYDATA
+{
+	HANDLE hQuery;
+	void* pData;
+};
+
+struct D3DDDIARG_SETRENDERTARGET
+{
+	UINT RenderTargetIndex;
+	HANDLE hRenderTarget;
+	UINT SubResourceIndex;
+};
+
+struct D3DDDIARG_OPENRESOURCE;
+struct D3DDDIARG_PRESENT;
+struct D3DDDIARG_PRESENT1;
+
+// Functions that the portable targets never call are only declared so that the visitors compile
+typedef HRESULT(APIENTRY* PFND3DDDI_UNUSED)(HANDLE);
+
+struct D3DDDI_DEVICEFUNCS
+{
+	HRESULT(APIENTRY* pfnSetRenderState)(HANDLE, const D3DDDIARG_RENDERSTATE*);
+	HRESULT(APIENTRY* pfnUpdateWInfo)(HANDLE, const D3DDDIARG_WINFO*);
+	PFND3DDDI_UNUSED pfnValidateDevice;
+	HRESULT(APIENTRY* pfnSetTextureStageState)(HANDLE, const D3DDDIARG_TEXTURESTAGESTATE*);
+	HRESULT(APIENTRY* pfnSetTexture)(HANDLE, UINT, HANDLE);
+	HRESULT(APIENTRY* pfnSetPixelShader)(HANDLE, HANDLE);
+	HRESULT(APIENTRY* pfnSetPixelShaderConst)(HANDLE, const D3DDDIARG_SETPIXELSHADERCONST*, const FLOAT*);
+	HRESULT(APIENTRY* pfnSetStreamSourceUm)(HANDLE, const D3DDDIARG_SETSTREAMSOURCEUM*, const void*);
+	HRESULT(APIENTRY* pfnSetIndices)(HANDLE, const D3DDDIARG_SETINDICES*);
+	PFND3DDDI_UNUSED pfnSetIndicesUm;
+	HRESULT(APIENTRY* pfnDrawPrimitive)(HANDLE, const D3DDDIARG_DRAWPRIMITIVE*, const UINT*);
+	HRESULT(APIENTRY* pfnDrawIndexedPrimitive)(HANDLE, const D3DDDIARG_DRAWINDEXEDPRIMITIVE*);
+	PFND3DDDI_UNUSED pfnDrawRectPatch;
+	PFND3DDDI_UNUSED pfnDrawTriPatch;
+	PFND3DDDI_UNUSED pfnDrawPrimitive2;
+	HRESULT(APIENTRY* pfnDrawIndexedPrimitive2)(HANDLE, const D3DDDIARG_DRAWINDEXEDPRIMITIVE2*, UINT, const void*, const UINT*);
+	PFND3DDDI_UNUSED pfnVolBlt;
+	PFND3DDDI_UNUSED pfnBufBlt;
+	PFND3DDDI_UNUSED pfnTexBlt;
+	PFND3DDDI_UNUSED pfnStateSet;
+	PFND3DDDI_UNUSED pfnSetPriority;
+	HRESULT(APIENTRY* pfnClear)(HANDLE, const D3DDDIARG_CLEAR*, UINT, const RECT*);
+	PFND3DDDI_UNUSED pfnUpdatePalette;
+	PFND3DDDI_UNUSED pfnSetPalette;
+	HRESULT(APIENTRY* pfnSetVertexShaderConst)(HANDLE, const D3DDDIARG_SETVERTEXSHADERCONST*, const void*);
+	PFND3DDDI_UNUSED pfnMultiplyTransform;
+	PFND3DDDI_UNUSED pfnSetTransform;
+	HRESULT(APIENTRY* pfnSetViewport)(HANDLE, const D3DDDIARG_VIEWPORTINFO*);
+	HRESULT(APIENTRY* pfnSetZRange)(HANDLE, const D3DDDIARG_ZRANGE*);
+	PFND3DDDI_UNUSED pfnSetMaterial;
+	PFND3DDDI_UNUSED pfnSetLight;
+	PFND3DDDI_UNUSED pfnCreateLight;
+	PFND3DDDI_UNUSED pfnDestroyLight;
+	PFND3DDDI_UNUSED pfnSetClipPlane;
+	PFND3DDDI_UNUSED pfnGetInfo;
+	HRESULT(APIENTRY* pfnLock)(HANDLE, D3DDDIARG_LOCK*);
+	HRESULT(APIENTRY* pfnUnlock)(HANDLE, const D3DDDIARG_UNLOCK*);
+	HRESULT(APIENTRY* pfnCreateResource)(HANDLE, D3DDDIARG_CREATERESOURCE*);
+	HRESULT(APIENTRY* pfnDestroyResource)(HANDLE, HANDLE);
+	PFND3DDDI_UNUSED pfnSetDisplayMode;
+	HRESULT(APIENTRY* pfnPresent)(HANDLE, const D3DDDIARG_PRESENT*);
+	HRESULT(APIENTRY* pfnFlush)(HANDLE);
+	PFND3DDDI_UNUSED pfnCreateVertexShaderFunc;
+	HRESULT(APIENTRY* pfnDeleteVertexShaderFunc)(HANDLE, HANDLE);
+	HRESULT(APIENTRY* pfnSetVertexShaderFunc)(HANDLE, HANDLE);
+	PFND3DDDI_UNUSED pfnCreateVertexShaderDecl;
+	HRESULT(APIENTRY* pfnDeleteVertexShaderDecl)(HANDLE, HANDLE);
+	HRESULT(APIENTRY* pfnSetVertexShaderDecl)(HANDLE, HANDLE);
+	HRESULT(APIENTRY* pfnSetVertexShaderConstI)(HANDLE, const D3DDDIARG_SETVERTEXSHADERCONSTI*, const INT*);
+	HRESULT(APIENTRY* pfnSetVertexShaderConstB)(HANDLE, const D3DDDIARG_SETVERTEXSHADERCONSTB*, const BOOL*);
+	PFND3DDDI_UNUSED pfnSetScissorRect;
+	HRESULT(APIENTRY* pfnSetStreamSource)(HANDLE, const D3DDDIARG_SETSTREAMSOURCE*);
+	PFND3DDDI_UNUSED pfnSetStreamSourceFreq;
+	PFND3DDDI_UNUSED pfnSetConvolutionKernelMono;
+	PFND3DDDI_UNUSED pfnComposeRects;
+	HRESULT(APIENTRY* pfnBlt)(HANDLE, const D3DDDIARG_BLT*);
+	HRESULT(APIENTRY* pfnColorFill)(HANDLE, const D3DDDIARG_COLORFILL*);
+	PFND3DDDI_UNUSED pfnDepthFill;
+	HRESULT(APIENTRY* pfnCreateQuery)(HANDLE, D3DDDIARG_CREATEQUERY*);
+	HRESULT(APIENTRY* pfnDestroyQuery)(HANDLE, HANDLE);
+	HRESULT(APIENTRY* pfnIssueQuery)(HANDLE, const D3DDDIARG_ISSUEQUERY*);
+	HRESULT(APIENTRY* pfnGetQueryData)(HANDLE, const D3DDDIARG_GETQUERYDATA*);
+	HRESULT(APIENTRY* pfnSetRenderTarget)(HANDLE, const D3DDDIARG_SETRENDERTARGET*);
+	PFND3DDDI_UNUSED pfnSetDepthStencil;
+	PFND3DDDI_UNUSED pfnGenerateMipSubLevels;
+	HRESULT(APIENTRY* pfnSetPixelShaderConstI)(HANDLE, const D3DDDIARG_SETPIXELSHADERCONSTI*, const INT*);
+	HRESULT(APIENTRY* pfnSetPixelShaderConstB)(HANDLE, const D3DDDIARG_SETPIXELSHADERCONSTB*, const BOOL*);
+	PFND3DDDI_UNUSED pfnCreatePixelShader;
+	HRESULT(APIENTRY* pfnDeletePixelShader)(HANDLE, HANDLE);
+	PFND3DDDI_UNUSED pfnCreateDecodeDevice;
+	PFND3DDDI_UNUSED pfnDestroyDecodeDevice;
+	PFND3DDDI_UNUSED pfnSetDecodeRenderTarget;
+	PFND3DDDI_UNUSED pfnDecodeBeginFrame;
+	PFND3DDDI_UNUSED pfnDecodeEndFrame;
+	PFND3DDDI_UNUSED pfnDecodeExecute;
+	PFND3DDDI_UNUSED pfnDecodeExtensionExecute;
+	PFND3DDDI_UNUSED pfnCreateVideoProcessDevice;
+	PFND3DDDI_UNUSED pfnDestroyVideoProcessDevice;
+	PFND3DDDI_UNUSED pfnVideoProcessBeginFrame;
+	PFND3DDDI_UNUSED pfnVideoProcessEndFrame;
+	PFND3DDDI_UNUSED pfnSetVideoProcessRenderTarget;
+	PFND3DDDI_UNUSED pfnVideoProcessBlt;
+	PFND3DDDI_UNUSED pfnCreateExtensionDevice;
+	PFND3DDDI_UNUSED pfnDestroyExtensionDevice;
+	PFND3DDDI_UNUSED pfnExtensionExecute;
+	PFND3DDDI_UNUSED pfnCreateOverlay;
+	PFND3DDDI_UNUSED pfnUpdateOverlay;
+	PFND3DDDI_UNUSED pfnFlipOverlay;
+	PFND3DDDI_UNUSED pfnGetOverlayColorControls;
+	PFND3DDDI_UNUSED pfnSetOverlayColorControls;
+	PFND3DDDI_UNUSED pfnDestroyOverlay;
+	HRESULT(APIENTRY* pfnDestroyDevice)(HANDLE);
+	PFND3DDDI_UNUSED pfnQueryResourceResidency;
+	HRESULT(APIENTRY* pfnOpenResource)(HANDLE, D3DDDIARG_OPENRESOURCE*);
+	PFND3DDDI_UNUSED pfnGetCaptureAllocationHandle;
+	PFND3DDDI_UNUSED pfnCaptureToSysMem;
+	PFND3DDDI_UNUSED pfnLockAsync;
+	PFND3DDDI_UNUSED pfnUnlockAsync;
+	PFND3DDDI_UNUSED pfnRename;
+	PFND3DDDI_UNUSED pfnCreateVideoProcessor;
+	PFND3DDDI_UNUSED pfnSetVideoProcessBltState;
+	PFND3DDDI_UNUSED pfnGetVideoProcessBltStatePrivate;
+	PFND3DDDI_UNUSED pfnSetVideoProcessStreamState;
+	PFND3DDDI_UNUSED pfnGetVideoProcessStreamStatePrivate;
+	PFND3DDDI_UNUSED pfnVideoProcessBltHD;
+	PFND3DDDI_UNUSED pfnDestroyVideoProcessor;
+	PFND3DDDI_UNUSED pfnCreateAuthenticatedChannel;
+	PFND3DDDI_UNUSED pfnAuthenticatedChannelKeyExchange;
+	PFND3DDDI_UNUSED pfnQueryAuthenticatedChannel;
+	PFND3DDDI_UNUSED pfnConfigureAuthenticatedChannel;
+	PFND3DDDI_UNUSED pfnDestroyAuthenticatedChannel;
+	PFND3DDDI_UNUSED pfnCreateCryptoSession;
+	PFND3DDDI_UNUSED pfnCryptoSessionKeyExchange;
+	PFND3DDDI_UNUSED pfnDestroyCryptoSession;
+	PFND3DDDI_UNUSED pfnEncryptionBlt;
+	PFND3DDDI_UNUSED pfnGetPitch;
+	PFND3DDDI_UNUSED pfnStartSessionKeyRefresh;
+	PFND3DDDI_UNUSED pfnFinishSessionKeyRefresh;
+	PFND3DDDI_UNUSED pfnGetEncryptionBltKey;
+	PFND3DDDI_UNUSED pfnDecryptionBlt;
+	PFND3DDDI_UNUSED pfnResolveSharedResource;
+	PFND3DDDI_UNUSED pfnVolBlt1;
+	PFND3DDDI_UNUSED pfnBufBlt1;
+	PFND3DDDI_UNUSED pfnTexBlt1;
+	PFND3DDDI_UNUSED pfnDiscard;
+	PFND3DDDI_UNUSED pfnOfferResources;
+	PFND3DDDI_UNUSED pfnReclaimResources;
+	PFND3DDDI_UNUSED pfnCheckDirectFlipSupport;
+	HRESULT(APIENTRY* pfnCreateResource2)(HANDLE, D3DDDIARG_CREATERESOURCE2*);
+	PFND3DDDI_UNUSED pfnCheckMultiPlaneOverlaySupport;
+	PFND3DDDI_UNUSED pfnPresentMultiPlaneOverlay;
+	PFND3DDDI_UNUSED pfnReserved1;
+	HRESULT(APIENTRY* pfnFlush1)(HANDLE, UINT);
+	PFND3DDDI_UNUSED pfnCheckCounterInfo;
+	PFND3DDDI_UNUSED pfnCheckCounter;
+	PFND3DDDI_UNUSED pfnUpdateSubresourceUP;
+	HRESULT(APIENTRY* pfnPresent1)(HANDLE, D3DDDIARG_PRESENT1*);
+	PFND3DDDI_UNUSED pfnCheckPresentDurationSupport;
+	PFND3DDDI_UNUSED pfnSetMarker;
+	PFND3DDDI_UNUSED pfnSetMarkerMode;
+	PFND3DDDI_UNUSED pfnTrimResidencySet;
+	PFND3DDDI_UNUSED pfnAcquireResource;
+	PFND3DDDI_UNUSED pfnReleaseResource;
+};
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <Windows.h>
+
+struct IUnknownVtbl;
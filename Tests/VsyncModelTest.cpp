@@ -0,0 +1,228 @@
+#include <cstdio>
+#include <random>
+
+#include <D3dDdi/VsyncModel.h>
+
+// Feeds D3dDdi::VsyncModel synthetic vblank timestamp streams and checks the learned period, the lock state
+// and the counters it derives from them.
+
+namespace
+{
+	using D3dDdi::VsyncModel;
+
+	const long long PERIOD_60HZ = 10000000 / 60;
+	const long long PERIOD_144HZ = 10000000 / 144;
+
+	unsigned g_failureCount = 0;
+
+#define CHECK(cond, ...) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			++g_failureCount; \
+			std::printf("FAIL %s:%d: %s: ", __func__, __LINE__, #cond); \
+			std::printf(__VA_ARGS__); \
+			std::printf("\n"); \
+		} \
+	} while (false)
+
+	long long absDiff(long long a, long long b)
+	{
+		return a > b ? a - b : b - a;
+	}
+
+	// Vblank timestamps of a display with the given period, as observed with up to maxJitter ticks of delay
+	class VblankSource
+	{
+	public:
+		VblankSource(long long start, long long period, int maxJitter)
+			: m_start(start)
+			, m_period(period)
+			, m_rng(1)
+			, m_jitter(0, maxJitter)
+		{
+		}
+
+		long long getTime(long long index) const { return m_start + index * m_period; }
+		long long observe(long long index) { return getTime(index) + m_jitter(m_rng); }
+
+	private:
+		long long m_start;
+		long long m_period;
+		std::mt19937 m_rng;
+		std::uniform_int_distribution<int> m_jitter;
+	};
+
+	void testSteadyJitter()
+	{
+		VblankSource source(123456, PERIOD_60HZ, 500);
+		VsyncModel model;
+		for (long long i = 0; i < 100; ++i)
+		{
+			model.addVblank(source.observe(i));
+			if (i >= 8)
+			{
+				CHECK(model.isLocked(), "vblank %lld", i);
+			}
+		}
+
+		const auto phase = model.getPhase();
+		CHECK(absDiff(phase.period, PERIOD_60HZ) < PERIOD_60HZ / 200, "period %lld", phase.period);
+		for (long long i = 100; i < 110; ++i)
+		{
+			const UINT counter = VsyncModel::getCounter(phase, source.getTime(i) + PERIOD_60HZ / 2);
+			CHECK(counter == i, "vblank %lld, counter %u", i, counter);
+		}
+	}
+
+	void testMissedVblanks()
+	{
+		VblankSource source(0, PERIOD_60HZ, 300);
+		VsyncModel model;
+		std::mt19937 rng(2);
+		std::uniform_int_distribution<int> gap(1, 30);
+
+		long long index = 0;
+		for (int i = 0; i < 200; ++i)
+		{
+			model.addVblank(source.observe(index));
+			const UINT counter = VsyncModel::getCounter(model.getPhase(), source.getTime(index) + PERIOD_60HZ / 2);
+			CHECK(counter == index, "vblank %lld, counter %u", index, counter);
+			index += i < 8 ? 1 : gap(rng);
+		}
+		CHECK(model.isLocked(), "not locked");
+		CHECK(absDiff(model.getPhase().period, PERIOD_60HZ) < PERIOD_60HZ / 200, "period %lld",
+			model.getPhase().period);
+	}
+
+	void testPeriodChange()
+	{
+		VblankSource source60(0, PERIOD_60HZ, 200);
+		VsyncModel model;
+		for (long long i = 0; i < 50; ++i)
+		{
+			model.addVblank(source60.observe(i));
+		}
+		CHECK(model.isLocked(), "not locked at 60 Hz");
+
+		VblankSource source144(source60.getTime(50), PERIOD_144HZ, 200);
+		model.addVblank(source144.observe(0));
+		model.addVblank(source144.observe(1));
+		CHECK(!model.isLocked(), "still locked after the refresh rate changed");
+
+		for (long long i = 2; i < 50; ++i)
+		{
+			model.addVblank(source144.observe(i));
+		}
+		CHECK(model.isLocked(), "not locked at 144 Hz");
+		CHECK(absDiff(model.getPhase().period, PERIOD_144HZ) < PERIOD_144HZ / 200, "period %lld",
+			model.getPhase().period);
+	}
+
+	// Samples vblanks the way the vsync thread does: consecutive ones while the model is unlocked, flagged as such
+	// once it has been trained, and a single one after each resync interval while it is locked
+	void runVsyncThread(VsyncModel& model, VblankSource& source, long long vblankCount, long long resyncVblankCount)
+	{
+		bool isNextVblank = false;
+		long long index = 0;
+		while (index < vblankCount)
+		{
+			model.addVblank(source.observe(index), isNextVblank);
+			isNextVblank = !model.isLocked();
+			index += model.isLocked() ? resyncVblankCount : 1;
+		}
+	}
+
+	void testIntegerMultipleRefreshChange(long long oldPeriod, long long newPeriod)
+	{
+		// The resync interval is a multiple of both periods, so resync samples alone stay in phase
+		const long long resyncInterval = 10000000 / 2;
+		VblankSource oldSource(0, oldPeriod, 200);
+		VsyncModel model;
+		runVsyncThread(model, oldSource, 10 * resyncInterval / oldPeriod, resyncInterval / oldPeriod);
+		CHECK(model.isLocked(), "not locked at period %lld", oldPeriod);
+
+		VblankSource newSource(model.getPhase().anchor + resyncInterval, newPeriod, 200);
+		runVsyncThread(model, newSource, 10 * resyncInterval / newPeriod, resyncInterval / newPeriod);
+		CHECK(model.isLocked(), "not locked after changing period %lld to %lld", oldPeriod, newPeriod);
+		CHECK(absDiff(model.getPhase().period, newPeriod) < newPeriod / 200,
+			"period %lld after changing period %lld to %lld", model.getPhase().period, oldPeriod, newPeriod);
+	}
+
+	void testMonotonicCounter()
+	{
+		VblankSource source(1000, PERIOD_60HZ, 2000);
+		VsyncModel model;
+		std::mt19937 rng(3);
+		std::uniform_int_distribution<long long> step(0, PERIOD_60HZ / 3);
+
+		UINT lastCounter = 0;
+		long long time = 1000;
+		long long nextVblank = 0;
+		for (int i = 0; i < 5000; ++i)
+		{
+			time += step(rng);
+			while (source.getTime(nextVblank) <= time)
+			{
+				model.addVblank(source.observe(nextVblank));
+				nextVblank += 1 + nextVblank % 3;
+			}
+
+			const UINT counter = VsyncModel::getCounter(model.getPhase(), time);
+			CHECK(static_cast<int>(counter - lastCounter) >= 0, "counter went back from %u to %u", lastCounter, counter);
+			lastCounter = counter;
+		}
+	}
+
+	void testVblankTimeRoundTrip()
+	{
+		VblankSource source(-5000, PERIOD_144HZ, 100);
+		VsyncModel model;
+		for (long long i = 0; i < 20; ++i)
+		{
+			model.addVblank(source.observe(i));
+		}
+
+		const auto phase = model.getPhase();
+		for (UINT counter = phase.anchorCounter; counter < phase.anchorCounter + 1000; ++counter)
+		{
+			const long long time = VsyncModel::getVblankTime(phase, counter);
+			CHECK(VsyncModel::getCounter(phase, time) == counter, "counter %u", counter);
+			CHECK(VsyncModel::getCounter(phase, time - 1) == counter - 1 || counter == phase.anchorCounter,
+				"counter %u", counter);
+		}
+	}
+
+	void testStaleTimestamps()
+	{
+		VblankSource source(0, PERIOD_60HZ, 0);
+		VsyncModel model;
+		for (long long i = 0; i < 20; ++i)
+		{
+			model.addVblank(source.observe(i));
+		}
+
+		const auto phase = model.getPhase();
+		model.addVblank(source.observe(19));
+		model.addVblank(source.observe(10));
+		CHECK(model.getPhase().anchor == phase.anchor && model.getPhase().period == phase.period &&
+			model.getPhase().anchorCounter == phase.anchorCounter, "stale timestamps changed the phase");
+		CHECK(model.isLocked(), "stale timestamps unlocked the model");
+	}
+}
+
+int main()
+{
+	testSteadyJitter();
+	testMissedVblanks();
+	testPeriodChange();
+	testIntegerMultipleRefreshChange(PERIOD_60HZ, PERIOD_60HZ / 2);
+	testIntegerMultipleRefreshChange(PERIOD_60HZ / 2, PERIOD_60HZ);
+	testMonotonicCounter();
+	testVblankTimeRoundTrip();
+	testStaleTimestamps();
+
+	std::printf("%u failures\n", g_failureCount);
+	return 0 == g_failureCount ? 0 : 1;
+}